@@ -1,63 +1,107 @@
 #include <cassert>
-#include <sstream>
+#include <iostream>
 
+#include "json.hpp"
 #include "sqlite3.h"
 
 #include "CAdvancedSim.hpp"
 #include "CCloudGCP.hpp"
 #include "CConfigLoader.hpp"
+#include "CFilePopularity.hpp"
 #include "CLinkSelector.hpp"
 #include "CRucio.hpp"
 #include "COutput.hpp"
+#include "COutputAggregator.hpp"
+#include "COutputTables.hpp"
+#include "CTopologyCache.hpp"
+#include "CTopologyGenerator.hpp"
+#include "CTraceReplay.hpp"
 #include "CommonScheduleables.hpp"
 
 
 
-void CAdvancedSim::SetupDefaults()
+bool CAdvancedSim::SetupDefaults(const nlohmann::json& profileJson)
 {
     COutput& output = COutput::GetRef();
     CConfigLoader& config = CConfigLoader::GetRef();
     ////////////////////////////
     // init output db
     ////////////////////////////
-    std::stringstream dbIn;
     bool ok = false;
 
-    ok = output.CreateTable("Sites", "id BIGINT PRIMARY KEY, name varchar(64), locationName varchar(32), cloudName varchar(32)");
+    auto aggregationConfig = profileJson.find("aggregation");
+    if(aggregationConfig != profileJson.end())
+    {
+        TickType tickBucketWidth = 3600;
+        TickType transferDurationBinWidth = 100;
+        std::uint64_t filesizeBinWidth = static_cast<std::uint64_t>(16 * ONE_MiB);
+        bool writeRawRows = false;
+
+        auto prop = aggregationConfig->find("tickBucketWidth");
+        if(prop != aggregationConfig->end())
+            tickBucketWidth = prop->get<TickType>();
+
+        prop = aggregationConfig->find("transferDurationBinWidth");
+        if(prop != aggregationConfig->end())
+            transferDurationBinWidth = prop->get<TickType>();
+
+        prop = aggregationConfig->find("filesizeBinWidth");
+        if(prop != aggregationConfig->end())
+            filesizeBinWidth = prop->get<std::uint64_t>();
+
+        prop = aggregationConfig->find("writeRawRows");
+        if(prop != aggregationConfig->end())
+            writeRawRows = prop->get<bool>();
+
+        mAggregator = std::make_shared<COutputAggregator>(tickBucketWidth, transferDurationBinWidth, filesizeBinWidth);
+
+        if(!writeRawRows)
+        {
+            output.DisableInserts(tables::CFilesTable::mName);
+            output.DisableInserts(tables::CReplicasTable::mName);
+            output.DisableInserts(tables::CTransfersTable::mName);
+        }
+        std::cout << "Aggregating output" << (writeRawRows ? " and writing raw rows" : "") << std::endl;
+    }
+
+    ok = output.CreateTable<tables::CSitesTable>();
     assert(ok);
 
-    ok = output.CreateTable("StorageElements", "id BIGINT PRIMARY KEY, siteId BIGINT, name varchar(64), FOREIGN KEY(siteId) REFERENCES Sites(id)");
+    ok = output.CreateTable<tables::CStorageElementsTable>();
     assert(ok);
 
-    ok = output.CreateTable("LinkSelectors", "id BIGINT PRIMARY KEY, srcSiteId BIGINT, dstSiteId BIGINT, FOREIGN KEY(srcSiteId) REFERENCES Sites(id), FOREIGN KEY(dstSiteId) REFERENCES Sites(id)");
+    ok = output.CreateTable<tables::CLinkSelectorsTable>();
     assert(ok);
 
-    ok = output.CreateTable("Files", "id BIGINT PRIMARY KEY, createdAt BIGINT, expiredAt BIGINT, filesize INTEGER");
+    ok = output.CreateTable<tables::CFilesTable>();
     assert(ok);
 
-    dbIn.str(std::string());
-    dbIn << "id BIGINT PRIMARY KEY,"
-         << "fileId BIGINT,"
-         << "storageElementId BIGINT,"
-         << "createdAt BIGINT,"
-         << "expiredAt BIGINT,"
-         << "FOREIGN KEY(fileId) REFERENCES Files(id),"
-         << "FOREIGN KEY(storageElementId) REFERENCES StorageElements(id)";
-    ok = output.CreateTable("Replicas", dbIn.str());
+    ok = output.CreateTable<tables::CReplicasTable>();
     assert(ok);
 
-    dbIn.str(std::string());
-    dbIn << "id BIGINT PRIMARY KEY,"
-         << "srcReplicaId BIGINT,"
-         << "dstReplicaId BIGINT,"
-         << "startTick BIGINT,"
-         << "endTick BIGINT,"
-         << "FOREIGN KEY(srcReplicaId) REFERENCES Replicas(id),"
-         << "FOREIGN KEY(dstReplicaId) REFERENCES Replicas(id)";
-    ok = output.CreateTable("Transfers", dbIn.str());
+    ok = output.CreateTable<tables::CTransfersTable>();
     assert(ok);
 
-    CStorageElement::mOutputQueryIdx = output.AddPreparedSQLStatement("INSERT INTO Replicas VALUES(?, ?, ?, ?, ?);");
+    if(mAggregator)
+    {
+        ok = COutputAggregator::CreateTables();
+        assert(ok);
+    }
+
+    // e.g. "costSeries": {"tickFreq": 3600} writes the hourly costs of each region
+    std::uint32_t costSeriesTickFreq = 0;
+    auto costSeriesConfig = profileJson.find("costSeries");
+    if(costSeriesConfig != profileJson.end())
+    {
+        auto prop = costSeriesConfig->find("tickFreq");
+        if(prop != costSeriesConfig->end())
+            costSeriesTickFreq = prop->get<std::uint32_t>();
+        else
+            costSeriesTickFreq = static_cast<std::uint32_t>(SECONDS_PER_DAY);
+
+        ok = output.CreateTable<tables::CCloudCostsTable>();
+        assert(ok);
+    }
 
 
     ////////////////////////////
@@ -70,71 +114,144 @@ void CAdvancedSim::SetupDefaults()
     for(std::unique_ptr<IBaseCloud>& cloud : mClouds)
         config.mConfigConsumer.push_back(cloud.get());
 
-    config.TryLoadConfig(std::filesystem::current_path() / "config" / "default.json");
+    const fs::path topologyConfigPath = std::filesystem::current_path() / "config" / "default.json";
+    fs::path topologyCachePath;
+    auto topologyCacheConfig = profileJson.find("topologyCache");
+    if(topologyCacheConfig != profileJson.end())
+    {
+        auto prop = topologyCacheConfig->find("filePath");
+        if(prop != topologyCacheConfig->end())
+            topologyCachePath = prop->get<std::string>();
+    }
 
-    //add all grid sites and storage elements to output DB (before links)
+    // a generated topology replaces the json topology.
+    // The cache is compiled from the json files on the first run and used as long as they are unchanged
+    CTopologyCache topologyCache;
+    auto topologyGeneratorConfig = profileJson.find("topologyGenerator");
+    if(topologyGeneratorConfig != profileJson.end())
+    {
+        CTopologyGenerator topologyGenerator;
+        ok = topologyGenerator.Load(topologyGeneratorConfig.value());
+        assert(ok);
+        topologyGenerator.Generate(mRucio.get(), mClouds[0].get());
+
+        auto networkPricesConfig = topologyGeneratorConfig->find("networkPrices");
+        if(networkPricesConfig != topologyGeneratorConfig->end())
+        {
+            if(!dynamic_cast<gcp::CCloud*>(mClouds[0].get())->LoadNetworkPrices(networkPricesConfig.value()))
+                return false;
+        }
+    }
+    else if(topologyCachePath.empty() || !topologyCache.TryLoad(topologyCachePath, mRucio.get(), mClouds))
+    {
+        config.TryLoadConfig(topologyConfigPath);
+        if(!topologyCachePath.empty())
+            CTopologyCache::Write(topologyCachePath, mRucio.get(), mClouds, config.mLoadedFiles, config.mConsumedConfigs);
+    }
+
+    // links are created later or even lazily during the run, so missing prices must be found now
+    std::vector<const ISite*> gridSites;
     for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
+        gridSites.push_back(gridSite.get());
+    for(const std::unique_ptr<IBaseCloud>& cloud : mClouds)
     {
-        dbIn.str(std::string());
-        dbIn << gridSite->GetId() << ","
-             << "'" << gridSite->GetName() << "',"
-             << "'" << gridSite->GetLocationName() << "',"
-             << "'grid'";
-        ok = ok && output.InsertRow("Sites", dbIn.str());
+        auto gcpCloud = dynamic_cast<const gcp::CCloud*>(cloud.get());
+        if(gcpCloud != nullptr && !gcpCloud->CheckNetworkPrices(gridSites))
+            return false;
+    }
 
-        for(const std::unique_ptr<CStorageElement>& storageElement : gridSite->mStorageElements)
+    auto filePopularityConfig = profileJson.find("filePopularity");
+    if(filePopularityConfig != profileJson.end())
+    {
+        double zipfExponent = 1.0;
+        auto prop = filePopularityConfig->find("zipfExponent");
+        if(prop != filePopularityConfig->end())
+            zipfExponent = prop->get<double>();
+        if(zipfExponent > 0)
         {
-            dbIn.str(std::string());
-            dbIn << storageElement->GetId() << ","
-                 << gridSite->GetId() << ","
-                 << "'" << storageElement->GetName() << "'";
-            ok = ok && output.InsertRow("StorageElements", dbIn.str());
+            std::cout << "Sampling files zipf distributed with exponent " << zipfExponent << std::endl;
+            mRucio->mFilePopularity = std::make_shared<CZipfFilePopularity>(zipfExponent);
         }
+        else
+            std::cout << "Ignoring file popularity with non-positive zipf exponent" << std::endl;
+    }
+
+    // with lazy links, the grid-cloud and cloud-cloud links are created on their first use
+    bool useLazyLinks = false;
+    auto prop = profileJson.find("lazyLinks");
+    if(prop != profileJson.end())
+        useLazyLinks = prop->get<bool>();
+
+    // the topology rows are queued like all other rows, so the consumer writes them with
+    // prepared statements in one transaction once the owner of the output starts the consumer
+    auto siteInserts = CTypedInsertStatements<tables::CSitesTable>::Acquire();
+    auto storageElementInserts = CTypedInsertStatements<tables::CStorageElementsTable>::Acquire();
+    auto linkSelectorInserts = CTypedInsertStatements<tables::CLinkSelectorsTable>::Acquire();
+
+    //add all grid sites and storage elements to output DB (before links)
+    for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
+    {
+        siteInserts->AddRow(gridSite->GetId(), gridSite->GetName(), gridSite->GetLocationName(), std::string("grid"));
+
+        for(const std::unique_ptr<CStorageElement>& storageElement : gridSite->mStorageElements)
+            storageElementInserts->AddRow(storageElement->GetId(), gridSite->GetId(), storageElement->GetName());
     }
 
+    //links between grid sites only exist in generated topologies
+    for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
+        for(CLinkSelector* const link : gridSite->mLinkSelectors)
+            linkSelectorInserts->AddRow(link->GetId(), link->GetSrcSiteId(), link->GetDstSiteId());
+
     //add all cloud regions and buckets to output DB and then create and add all links
     for(const std::unique_ptr<IBaseCloud>& cloud : mClouds)
     {
         for(const std::unique_ptr<ISite>& cloudSite : cloud->mRegions)
         {
             auto region = dynamic_cast<gcp::CRegion*>(cloudSite.get());
-            dbIn.str(std::string());
-            dbIn << region->GetId() << ","
-                 << "'" << region->GetName() << "',"
-                 << "'" << region->GetLocationName() << "',"
-                 << "'" << cloud->GetName() << "'";
-            ok = ok && output.InsertRow("Sites", dbIn.str());
+            siteInserts->AddRow(region->GetId(), region->GetName(), region->GetLocationName(), cloud->GetName());
 
             for(const std::unique_ptr<gcp::CBucket>& bucket : region->mStorageElements)
-            {
-                dbIn.str(std::string());
-                dbIn << bucket->GetId() << ","
-                     << region->GetId() << ","
-                     << "'" << bucket->GetName() << "'";
-                ok = ok && output.InsertRow("StorageElements", dbIn.str());
-            }
+                storageElementInserts->AddRow(bucket->GetId(), region->GetId(), bucket->GetName());
+
+            if(useLazyLinks)
+                continue;
 
             for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
             {
-                CLinkSelector* link = gridSite->CreateLinkSelector(region, ONE_GiB / 32);
-                dbIn.str(std::string());
-                dbIn << link->GetId() << ","
-                     << link->GetSrcSiteId() << ","
-                     << link->GetDstSiteId();
-                ok = ok && output.InsertRow("LinkSelectors", dbIn.str());
-
-                link = region->CreateLinkSelector(gridSite.get(), ONE_GiB / 128);
-                dbIn.str(std::string());
-                dbIn << link->GetId() << ","
-                     << link->GetSrcSiteId() << ","
-                     << link->GetDstSiteId();
-                ok = ok && output.InsertRow("LinkSelectors", dbIn.str());
+                CLinkSelector* link = cloud->CreateLinkSelector(gridSite.get(), region);
+                linkSelectorInserts->AddRow(link->GetId(), link->GetSrcSiteId(), link->GetDstSiteId());
+
+                link = cloud->CreateLinkSelector(region, gridSite.get());
+                linkSelectorInserts->AddRow(link->GetId(), link->GetSrcSiteId(), link->GetDstSiteId());
             }
         }
-    }
 
-    for(const std::unique_ptr<IBaseCloud>& cloud : mClouds)
+        if(useLazyLinks)
+            continue;
+
+        //links between the regions of a cloud, which the lazy link rules record on their first use
         cloud->SetupDefaultCloud();
+        for(const std::unique_ptr<ISite>& srcRegion : cloud->mRegions)
+            for(const std::unique_ptr<ISite>& dstRegion : cloud->mRegions)
+            {
+                const CLinkSelector* link = srcRegion->GetLinkSelector(dstRegion.get());
+                if(link != nullptr)
+                    linkSelectorInserts->AddRow(link->GetId(), link->GetSrcSiteId(), link->GetDstSiteId());
+            }
+    }
+
+    output.QueueInserts(std::move(siteInserts));
+    output.QueueInserts(std::move(storageElementInserts));
+    output.QueueInserts(std::move(linkSelectorInserts));
+
+    if(useLazyLinks)
+    {
+        std::vector<IBaseCloud*> clouds;
+        for(const std::unique_ptr<IBaseCloud>& cloud : mClouds)
+            clouds.push_back(cloud.get());
+        mLazyLinkRules = std::make_unique<CLazyLinkRules>(std::move(clouds));
+        ISite::mLinkRules = mLazyLinkRules.get();
+    }
 
     assert(ok);
 
@@ -149,16 +266,113 @@ void CAdvancedSim::SetupDefaults()
     auto reaper = std::make_shared<CReaper>(mRucio.get(), 600, 600);
 
     auto x2cTransferMgr = std::make_shared<CFixedTimeTransferManager>(20, 100);
+    dataGen->mAggregator = mAggregator;
+    x2cTransferMgr->mAggregator = mAggregator;
     //auto x2cTransferNumGen = std::make_shared<CWavedTransferNumGen>(12, 200, 25, 0.075);
     //auto x2cTransferGen = std::make_shared<CSrcPrioTransferGen>(this, x2cTransferMgr, x2cTransferNumGen, 25);
-    auto x2cTransferGen = std::make_shared<CJobSlotTransferGen>(this, x2cTransferMgr, 25);
 
+    // a job batch occupies its slots for jobDuration ticks and each of its transfers takes transferDuration ticks
+    TickType jobDuration = 900;
+    TickType transferDuration = 60;
+    auto jobSlotTransferGenConfig = profileJson.find("jobSlotTransferGen");
+    if(jobSlotTransferGenConfig != profileJson.end())
+    {
+        auto prop = jobSlotTransferGenConfig->find("jobDuration");
+        if(prop != jobSlotTransferGenConfig->end())
+            jobDuration = prop->get<TickType>();
+
+        prop = jobSlotTransferGenConfig->find("transferDuration");
+        if(prop != jobSlotTransferGenConfig->end())
+            transferDuration = prop->get<TickType>();
+    }
+    auto x2cTransferGen = std::make_shared<CJobSlotTransferGen>(this, x2cTransferMgr, 25, jobDuration, transferDuration);
+
+
+    // a trace can either be an external workload trace or a decision log recorded by a previous run
+    fs::path tracePath, traceCSVPath, decisionLogPath;
+    bool recordDecisions = false;
+
+    auto traceReplayConfig = profileJson.find("traceReplay");
+    if(traceReplayConfig != profileJson.end())
+    {
+        auto prop = traceReplayConfig->find("filePath");
+        if(prop != traceReplayConfig->end())
+            tracePath = prop->get<std::string>();
+
+        prop = traceReplayConfig->find("csvFilePath");
+        if(prop != traceReplayConfig->end())
+            traceCSVPath = prop->get<std::string>();
+
+        if(tracePath.empty() && !traceCSVPath.empty())
+            tracePath = fs::path(traceCSVPath).replace_extension(".trace");
+
+        // the csv only has to be converted once
+        if(!traceCSVPath.empty() && (!fs::exists(tracePath) || (fs::last_write_time(traceCSVPath) > fs::last_write_time(tracePath))))
+            CTraceWriter::ConvertCSV(traceCSVPath, tracePath);
+    }
+
+    auto decisionLogConfig = profileJson.find("decisionLog");
+    if(decisionLogConfig != profileJson.end())
+    {
+        auto prop = decisionLogConfig->find("filePath");
+        if(prop != decisionLogConfig->end())
+            decisionLogPath = prop->get<std::string>();
+
+        prop = decisionLogConfig->find("mode");
+        if(prop != decisionLogConfig->end() && !decisionLogPath.empty())
+        {
+            const std::string mode = prop->get<std::string>();
+            if(mode == "record")
+                recordDecisions = true;
+            else if(mode == "replay")
+                tracePath = decisionLogPath;
+            else
+                std::cout << "Ignoring unknown decision log mode: " << mode << std::endl;
+        }
+    }
+
+    std::shared_ptr<CTraceReplay> traceReplay;
+    if(!tracePath.empty())
+    {
+        std::vector<CStorageElement*> storageElements;
+        for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
+            for(const std::unique_ptr<CStorageElement>& storageElement : gridSite->mStorageElements)
+                storageElements.push_back(storageElement.get());
+        for(const std::unique_ptr<ISite>& cloudSite : mClouds[0]->mRegions)
+            for(const std::unique_ptr<gcp::CBucket>& bucket : dynamic_cast<gcp::CRegion*>(cloudSite.get())->mStorageElements)
+                storageElements.push_back(bucket.get());
+
+        traceReplay = std::make_shared<CTraceReplay>(this);
+        traceReplay->mFixedTimeTransferMgr = x2cTransferMgr;
+        traceReplay->mAggregator = mAggregator;
+        if(!traceReplay->Open(tracePath, storageElements))
+        {
+            std::cout << "Falling back to generated workload" << std::endl;
+            traceReplay = nullptr;
+        }
+    }
+    else if(recordDecisions)
+    {
+        auto decisionRecorder = std::make_shared<CTraceWriter>();
+        if(decisionRecorder->Open(decisionLogPath))
+        {
+            std::cout << "Recording generator decisions to " << decisionLogPath << std::endl;
+            dataGen->mDecisionRecorder = decisionRecorder;
+            x2cTransferGen->mDecisionRecorder = decisionRecorder;
+        }
+    }
 
     auto heartbeat = std::make_shared<CHeartbeat>(this, x2cTransferMgr, nullptr, static_cast<std::uint32_t>(SECONDS_PER_DAY), static_cast<TickType>(SECONDS_PER_DAY));
-    heartbeat->mProccessDurations["DataGen"] = &(dataGen->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["X2CTransferUpdate"] = &(x2cTransferMgr->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["X2CTransferGen"] = &(x2cTransferGen->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["Reaper"] = &(reaper->mUpdateDurationSummed);
+    heartbeat->mProccessDurations["X2CTransferUpdate"] = x2cTransferMgr;
+    heartbeat->mProccessDurations["Reaper"] = reaper;
+    if(traceReplay)
+        heartbeat->mProccessDurations["TraceReplay"] = traceReplay;
+    else
+    {
+        heartbeat->mProccessDurations["DataGen"] = dataGen;
+        heartbeat->mProccessDurations["X2CTransferGen"] = x2cTransferGen;
+        heartbeat->mCacheStats["X2CSrcSelectionCache"] = x2cTransferGen->mSrcSelectionCacheStats;
+    }
 
 
     for(const std::unique_ptr<CGridSite>& gridSite : mRucio->mGridSites)
@@ -177,15 +391,34 @@ void CAdvancedSim::SetupDefaults()
         {
             x2cTransferGen->mSrcStorageElementIdToPrio[bucket->GetId()] = 1;
             //x2cTransferGen->mDstStorageElements.push_back(bucket.get());
-            CJobSlotTransferGen::SJobSlotInfo jobslot = {region->mNumJobSlots, {}};
-            x2cTransferGen->mDstInfo.push_back( std::make_pair(bucket.get(), jobslot) );
+            x2cTransferGen->mDstInfo.emplace_back(bucket.get(), CJobSlotTransferGen::CJobSlotInfo(region->mNumJobSlots));
         }
     }
 
-    mSchedule.push(std::make_shared<CBillingGenerator>(this));
-    mSchedule.push(dataGen);
+    mSchedule.push(std::make_shared<CBillingGenerator>(this, SECONDS_PER_MONTH, SECONDS_PER_MONTH, costSeriesTickFreq));
+    if(!traceReplay)
+        mSchedule.push(dataGen);
     mSchedule.push(reaper);
     mSchedule.push(x2cTransferMgr);
-    mSchedule.push(x2cTransferGen);
+    if(traceReplay)
+        mSchedule.push(traceReplay);
+    else
+        mSchedule.push(x2cTransferGen);
     mSchedule.push(heartbeat);
+    return true;
+}
+
+CAdvancedSim::~CAdvancedSim()
+{
+    if(ISite::mLinkRules == mLazyLinkRules.get())
+        ISite::mLinkRules = nullptr;
+}
+
+void CAdvancedSim::Run(const TickType maxTick)
+{
+    IBaseSim::Run(maxTick);
+    if(mAggregator)
+        mAggregator->WriteOutput();
+    if(mLazyLinkRules)
+        std::cout << "Created " << mLazyLinkRules->GetNumCreatedLinks() << " links on their first use" << std::endl;
 }
@@ -1,9 +1,19 @@
 #pragma once
 
 #include "IBaseSim.hpp"
+#include "CLazyLinkRules.hpp"
+
+class COutputAggregator;
 
 class CAdvancedSim : public IBaseSim
 {
+private:
+    std::shared_ptr<COutputAggregator> mAggregator;
+    std::unique_ptr<CLazyLinkRules> mLazyLinkRules;
+
 public:
-    void SetupDefaults() override;
+    ~CAdvancedSim();
+
+    bool SetupDefaults(const nlohmann::json& profileJson) override;
+    void Run(const TickType maxTick) override;
 };
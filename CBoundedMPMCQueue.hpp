@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+
+// bounded multi producer multi consumer queue based on D. Vyukov's array queue.
+// Push and pop are lock free. Threads only take the mutex to sleep when the queue is
+// full or empty and are woken up by the opposite side.
+template<typename T>
+class CBoundedMPMCQueue
+{
+private:
+    struct alignas(64) SCell
+    {
+        std::atomic<std::size_t> mSequence;
+        T mValue;
+    };
+
+    std::unique_ptr<SCell[]> mCells;
+    const std::size_t mMask;
+
+    alignas(64) std::atomic<std::size_t> mEnqueuePos = 0;
+    alignas(64) std::atomic<std::size_t> mDequeuePos = 0;
+
+    std::mutex mWaitMutex;
+    std::condition_variable mNotFullCondition;
+    std::condition_variable mNotEmptyCondition;
+    std::atomic<std::uint32_t> mNumWaitingProducers = 0;
+    std::atomic<std::uint32_t> mNumWaitingConsumers = 0;
+
+    std::atomic<std::size_t> mHighWaterMark = 0;
+    std::atomic<std::uint64_t> mNumStalls = 0;
+    std::atomic<std::uint64_t> mStallNanoseconds = 0;
+
+    static auto RoundUpToPowerOfTwo(std::size_t value) -> std::size_t
+    {
+        std::size_t result = 2;
+        while(result < value)
+            result <<= 1;
+        return result;
+    }
+
+    void UpdateHighWaterMark()
+    {
+        const std::size_t depth = GetDepth();
+        std::size_t highWaterMark = mHighWaterMark.load(std::memory_order_relaxed);
+        while(depth > highWaterMark && !mHighWaterMark.compare_exchange_weak(highWaterMark, depth, std::memory_order_relaxed));
+    }
+
+    void WakeUp(std::atomic<std::uint32_t>& numWaiting, std::condition_variable& condition)
+    {
+        // pairs with the increment of numWaiting before a waiting thread checks the queue again
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(numWaiting.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mWaitMutex);
+            condition.notify_all();
+        }
+    }
+
+public:
+    CBoundedMPMCQueue(const std::size_t capacity)
+        : mCells(new SCell[RoundUpToPowerOfTwo(capacity)]),
+          mMask(RoundUpToPowerOfTwo(capacity) - 1)
+    {
+        for(std::size_t i = 0; i <= mMask; ++i)
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+    }
+
+    CBoundedMPMCQueue(const CBoundedMPMCQueue&) = delete;
+    CBoundedMPMCQueue& operator=(const CBoundedMPMCQueue&) = delete;
+
+    bool TryPush(T&& value)
+    {
+        std::size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        SCell* cell;
+        while(true)
+        {
+            cell = &(mCells[pos & mMask]);
+            const std::size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false; // full
+            else
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+        }
+        cell->mValue = std::move(value);
+        cell->mSequence.store(pos + 1, std::memory_order_release);
+
+        UpdateHighWaterMark();
+        WakeUp(mNumWaitingConsumers, mNotEmptyCondition);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        std::size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        SCell* cell;
+        while(true)
+        {
+            cell = &(mCells[pos & mMask]);
+            const std::size_t sequence = cell->mSequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+            if(diff == 0)
+            {
+                if(mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false; // empty
+            else
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->mValue);
+        cell->mSequence.store(pos + mMask + 1, std::memory_order_release);
+
+        WakeUp(mNumWaitingProducers, mNotFullCondition);
+        return true;
+    }
+
+    // blocks while the queue is full. The blocked time is accounted as stall time
+    void Push(T&& value)
+    {
+        if(TryPush(std::move(value)))
+            return;
+
+        const auto stallBegin = std::chrono::steady_clock::now();
+        mNumWaitingProducers.fetch_add(1, std::memory_order_seq_cst);
+        while(!TryPush(std::move(value)))
+        {
+            std::unique_lock<std::mutex> lock(mWaitMutex);
+            if(GetDepth() > mMask)
+                mNotFullCondition.wait_for(lock, std::chrono::milliseconds(1));
+        }
+        mNumWaitingProducers.fetch_sub(1, std::memory_order_relaxed);
+
+        mNumStalls.fetch_add(1, std::memory_order_relaxed);
+        const auto stallDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stallBegin);
+        mStallNanoseconds.fetch_add(static_cast<std::uint64_t>(stallDuration.count()), std::memory_order_relaxed);
+    }
+
+    // appends up to maxNumValues values to values. Waits at most maxWaitTime if the queue is empty.
+    // Returns the number of popped values
+    template<typename TDuration>
+    auto PopBatch(std::vector<T>& values, const std::size_t maxNumValues, const TDuration maxWaitTime) -> std::size_t
+    {
+        std::size_t numPopped = 0;
+        T value;
+        while(numPopped < maxNumValues && TryPop(value))
+        {
+            values.emplace_back(std::move(value));
+            ++numPopped;
+        }
+        if(numPopped > 0)
+            return numPopped;
+
+        mNumWaitingConsumers.fetch_add(1, std::memory_order_seq_cst);
+        {
+            std::unique_lock<std::mutex> lock(mWaitMutex);
+            if(IsEmpty())
+                mNotEmptyCondition.wait_for(lock, maxWaitTime);
+        }
+        mNumWaitingConsumers.fetch_sub(1, std::memory_order_relaxed);
+
+        while(numPopped < maxNumValues && TryPop(value))
+        {
+            values.emplace_back(std::move(value));
+            ++numPopped;
+        }
+        return numPopped;
+    }
+
+    // wakes up all waiting consumers, e.g. to let them check for shutdown
+    void NotifyConsumers()
+    {
+        std::lock_guard<std::mutex> lock(mWaitMutex);
+        mNotEmptyCondition.notify_all();
+    }
+
+    inline auto GetCapacity() const -> std::size_t
+    {return mMask + 1;}
+
+    inline auto GetDepth() const -> std::size_t
+    {
+        const std::size_t dequeuePos = mDequeuePos.load(std::memory_order_relaxed);
+        const std::size_t enqueuePos = mEnqueuePos.load(std::memory_order_relaxed);
+        return (enqueuePos > dequeuePos) ? (enqueuePos - dequeuePos) : 0;
+    }
+
+    inline bool IsEmpty() const
+    {return GetDepth() == 0;}
+
+    inline auto GetHighWaterMark() const -> std::size_t
+    {return mHighWaterMark.load(std::memory_order_relaxed);}
+
+    inline auto GetNumStalls() const -> std::uint64_t
+    {return mNumStalls.load(std::memory_order_relaxed);}
+
+    inline auto GetStallDuration() const -> std::chrono::duration<double>
+    {return std::chrono::nanoseconds(mStallNanoseconds.load(std::memory_order_relaxed));}
+};
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <iostream>
+#include <thread>
 
 #include "json.hpp"
 
@@ -19,51 +21,32 @@ namespace gcp
 
     void CBucket::OnIncreaseReplica(std::uint64_t amount, TickType now)
     {
-        if (now > mTimeLastCostUpdate)
-        {
-            mCosts += BYTES_TO_GiB(mUsedStorage) * mRegion->GetStoragePrice() * SECONDS_TO_MONTHS((now - mTimeLastCostUpdate));
-            mTimeLastCostUpdate = now;
-        }
+        assert(now >= mCostPeriodStartTick);
+        mAddedByteSeconds.Add(amount, now - mCostPeriodStartTick);
         CStorageElement::OnIncreaseReplica(amount, now);
     }
 
-    void CBucket::OnRemoveReplica(const SReplica* replica, TickType now)
+    void CBucket::OnRemoveReplica(const SReplica* replica, TickType now, bool needLock)
     {
-        std::unique_lock<std::mutex> lock(mReplicaRemoveMutex);
-        if (now > mTimeLastCostUpdate)
-        {
-            mCosts += BYTES_TO_GiB(mUsedStorage) * mRegion->GetStoragePrice() * SECONDS_TO_MONTHS((now - mTimeLastCostUpdate));
-            mTimeLastCostUpdate = now;
-        }
-        CStorageElement::OnRemoveReplica(replica, now, false);
+        // only the replica list of the storage element has to be locked, the costs are accrued lock free
+        assert(now >= mCostPeriodStartTick);
+        mRemovedByteSeconds.Add(replica->GetCurSize(), now - mCostPeriodStartTick);
+        CStorageElement::OnRemoveReplica(replica, now, needLock);
     }
 
     double CBucket::CalculateStorageCosts(TickType now)
     {
-        if (now > mTimeLastCostUpdate)
-        {
-            mCosts += BYTES_TO_GiB(mUsedStorage) * mRegion->GetStoragePrice() * SECONDS_TO_MONTHS((now - mTimeLastCostUpdate));
-            mTimeLastCostUpdate = now;
-        }
-
-        double costs = mCosts;
-        mCosts = 0;
-        return costs;
+        assert(now >= mCostPeriodStartTick);
+        const UInt128Type usedByteSeconds = static_cast<UInt128Type>(mUsedStorage) * (now - mCostPeriodStartTick);
+        const UInt128Type byteSeconds = (usedByteSeconds + mRemovedByteSeconds.Get()) - mAddedByteSeconds.Get();
+        mAddedByteSeconds.Reset();
+        mRemovedByteSeconds.Reset();
+        mCostPeriodStartTick = now;
+        return BYTES_TO_GiB(static_cast<double>(byteSeconds)) * mRegion->GetStoragePrice() * SECONDS_TO_MONTHS(1.0);
     }
 
 
 
-    static double CalculateNetworkCostsRecursive(std::uint64_t traffic, CLinkSelector::PriceInfoType::const_iterator curLevelIt, const CLinkSelector::PriceInfoType::const_iterator &endIt, std::uint64_t prevThreshold = 0)
-    {
-	    assert(curLevelIt->first >= prevThreshold);
-	    const std::uint64_t threshold = curLevelIt->first - prevThreshold;
-	    CLinkSelector::PriceInfoType::const_iterator nextLevelIt = curLevelIt + 1;
-	    if (traffic <= threshold || nextLevelIt == endIt)
-		    return BYTES_TO_GiB(traffic) * curLevelIt->second;
-	    const double lowerLevelCosts = CalculateNetworkCostsRecursive(traffic - threshold, nextLevelIt, endIt, curLevelIt->first);
-	    return (BYTES_TO_GiB(threshold) * curLevelIt->second) + lowerLevelCosts;
-    }
-
     CRegion::CRegion(const std::uint32_t multiLocationIdx, std::string&& name, std::string&& locationName, const std::uint32_t numJobSlots, const double storagePrice, std::string&& skuId)
 	    : ISite(multiLocationIdx, std::move(name), std::move(locationName)),
 	      mSKUId(std::move(skuId)),
@@ -86,21 +69,21 @@ namespace gcp
 	    return regionStorageCosts;
     }
 
-    double CRegion::CalculateNetworkCosts(double& sumUsedTraffic, std::uint64_t& sumDoneTransfers)
+    auto CRegion::CollectCosts(TickType now) -> SSiteCosts
     {
-	    double regionNetworkCosts = 0;
-	    for (const std::unique_ptr<CLinkSelector>& linkSelector : mLinkSelectors)
+        SSiteCosts costs;
+        costs.mSiteId = GetId();
+        costs.mStorageCosts = CalculateStorageCosts(now);
+	    for (CLinkSelector* const linkSelector : mLinkSelectors)
 	    {
-            double costs = CalculateNetworkCostsRecursive(linkSelector->mUsedTraffic, linkSelector->mNetworkPrice.cbegin(), linkSelector->mNetworkPrice.cend());
-
-            regionNetworkCosts += costs;
-            sumUsedTraffic += BYTES_TO_GiB(linkSelector->mUsedTraffic);
-            sumDoneTransfers += linkSelector->mDoneTransfers;
-		    linkSelector->mUsedTraffic = 0;
+            // the costs are accrued tier by tier while the traffic is added
+            costs.mTraffic += linkSelector->mUsedTraffic;
+            costs.mNetworkCosts += linkSelector->ResetNetworkCosts();
+            costs.mNumDoneTransfers += linkSelector->mDoneTransfers;
             linkSelector->mDoneTransfers = 0;
             linkSelector->mFailedTransfers = 0;
 	    }
-	    return regionNetworkCosts;
+	    return costs;
     }
 
 
@@ -114,161 +97,241 @@ namespace gcp
     {
 	    CRegion* newRegion = new CRegion(multiLocationIdx, std::move(name), std::move(locationName), numJobSlots, storagePrice, std::move(skuId));
 	    mRegions.emplace_back(newRegion);
+	    mGCPRegions.push_back(newRegion);
 	    return newRegion;
     }
 
-    auto CCloud::ProcessBilling(TickType now) -> std::pair<double, std::pair<double, double>>
+    void CCloud::CollectCosts(TickType now, std::vector<SSiteCosts>& siteCosts)
     {
-	    double totalStorageCosts = 0;
-	    double totalNetworkCosts = 0;
-        double sumUsedTraffic = 0;
-        std::uint64_t sumDoneTransfer = 0;
-	    for (const std::unique_ptr<ISite>& site : mRegions)
-	    {
-		    auto region = dynamic_cast<CRegion*>(site.get());
-		    assert(region != nullptr);
-		    const double regionStorageCosts = region->CalculateStorageCosts(now);
-		    const double regionNetworkCosts = region->CalculateNetworkCosts(sumUsedTraffic, sumDoneTransfer);
-		    totalStorageCosts += regionStorageCosts;
-		    totalNetworkCosts += regionNetworkCosts;
-	    }
-        return { totalStorageCosts, {totalNetworkCosts, sumUsedTraffic } };
+        // regions only touch their own buckets and outgoing links, so they are collected in parallel.
+        // The results are stored by region idx, which keeps the order and the sums deterministic
+        const std::size_t firstIdx = siteCosts.size();
+        const std::size_t numRegions = mGCPRegions.size();
+        siteCosts.resize(firstIdx + numRegions);
+
+        auto worker = [this, now, firstIdx, &siteCosts](std::size_t beginIdx, std::size_t endIdx) {
+            for(std::size_t i = beginIdx; i < endIdx; ++i)
+                siteCosts[firstIdx + i] = mGCPRegions[i]->CollectCosts(now);
+        };
+
+        const std::size_t numThreads = std::min<std::size_t>(std::thread::hardware_concurrency(), numRegions / BILLING_MIN_REGIONS_PER_THREAD);
+        if(numThreads < 2)
+        {
+            worker(0, numRegions);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for(std::size_t t = 0; t < numThreads; ++t)
+            threads.emplace_back(worker, (numRegions * t) / numThreads, (numRegions * (t + 1)) / numThreads);
+        for(std::thread& thread : threads)
+            thread.join();
     }
 
-    void CCloud::SetupDefaultCloud()
+    static bool LoadNetworkPriceTable(const nlohmann::json& tiersJson, std::shared_ptr<const CNetworkPriceTable>& networkPrice)
     {
-	    //CreateRegion("us", "northamerica-northeast1", "Montreal", 0.02275045, "E466-8D73-08F4");
-	    //CreateRegion("northamerica-northeast1', 'northamerica-northeast1', 'Montreal', 0.02275045, "E466-8D73-08F4")
-
-	    /*
-	    eu - apac EF0A-B3BA-32CA 0.1121580 0.1121580 0.1028115 0.0747720
-	    na - apac 6B37-399C-BF69 0.0000000 0.1121580 0.1028115 0.0747720
-	    na - eu   C7FF-4F9E-C0DB 0.0000000 0.1121580 0.1028115 0.0747720
-
-	    au - apac CDD1-6B91-FDF8 0.1775835 0.1775835 0.1682370 0.1401975
-	    au - eu   1E7D-CBB0-AF0C 0.1775835 0.1775835 0.1682370 0.1401975
-	    au - na   27F0-D54C-619A 0.1775835 0.1775835 0.1682370 0.1401975
-	    au - sa   7F66-C883-4D7D 0.1121580 0.1121580 0.1028115 0.0747720
-	    apac - sa 1F9A-A9AC-FFC3 0.1121580 0.1121580 0.1028115 0.0747720
-	    eu - sa   96EB-C6ED-FBDE 0.1121580 0.1121580 0.1028115 0.0747720
-	    na - sa   BB86-91E8-5450 0.1121580 0.1121580 0.1028115 0.0747720
-	    */
-
-	    //download apac      1F8B-71B0-3D1B 0.0000000 0.1121580 0.1028115 0.0747720
-	    //download australia 9B2D-2B7D-FA5C 0.1775835 0.1775835 0.1682370 0.1401975
-	    //download china     4980-950B-BDA6 0.2149695 0.2149695 0.2056230 0.1869300
-	    //download us emea   22EB-AAE8-FBCD 0.0000000 0.1121580 0.1028115 0.0747720
-
-
-	    const CLinkSelector::PriceInfoType priceSameRegion = { {0,0} };
-	    const CLinkSelector::PriceInfoType priceSameMulti = { {1,0.0093465} };
+        if(!tiersJson.is_array() || tiersJson.empty())
+        {
+            std::cout << "Expected non empty list of [threshold, price] tiers: " << tiersJson.dump() << std::endl;
+            return false;
+        }
+        CLinkSelector::PriceInfoType tiers;
+        for(const auto& tierJson : tiersJson)
+        {
+            if(!tierJson.is_array() || tierJson.size() != 2)
+            {
+                std::cout << "Expected [threshold, price] tier: " << tierJson.dump() << std::endl;
+                return false;
+            }
+            tiers.emplace_back(tierJson[0].get<std::uint64_t>(), tierJson[1].get<double>());
+            if(tiers.size() > 1 && tiers.back().first < tiers[tiers.size() - 2].first)
+            {
+                std::cout << "Thresholds of network price tiers must not decrease: " << tiersJson.dump() << std::endl;
+                return false;
+            }
+        }
+        networkPrice = std::make_shared<const CNetworkPriceTable>(tiers);
+        return true;
+    }
 
-	    typedef std::unordered_map<std::uint32_t, CLinkSelector::PriceInfoType> InnerMapType;
-	    typedef std::unordered_map<std::uint32_t, InnerMapType> OuterMapType;
+    bool CCloud::LoadNetworkPrices(const nlohmann::json& networkPricesJson)
+    {
+        auto prop = networkPricesJson.find("sameRegion");
+        if(prop != networkPricesJson.end() && !LoadNetworkPriceTable(prop.value(), mSameRegionNetworkPrice))
+            return false;
 
-	    const OuterMapType priceWW
-	    {
-		    { 0, {	{ 0, priceSameMulti },
-                    { 1,{ { 1024, 0.1775835 }, { 10240, 0.1682370 }, { 10240, 0.1401975 } } },
-				    { 2,{ { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } },
-				    { 3,{ { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } },
-				    { 4,{ {1, 0.0}, { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } }
-				 }
-		    },
-		    { 1, {	{ 1, priceSameMulti },
-                    { 2,{ { 1024, 0.1775835 },{ 10240, 0.1682370 },{ 10240, 0.1401975 } } },
-				    { 3,{ { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } },
-				    { 4,{ { 1024, 0.1775835 },{ 10240, 0.1682370 },{ 10240, 0.1401975 } } }
-				 }
-		    },
-		    { 2, {	{ 2, priceSameMulti },
-                    { 3,{ { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } },
-				    { 4,{ { 1, 0.0 },{ 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } }
-				 }
-		    },
-		    { 3, {  { 3, priceSameMulti },
-                    { 4,{ { 1024, 0.1121580 },{ 10240, 0.1028115 },{ 10240, 0.0747720 } } }
-                 }
-            },
-            { 4, {  { 4, priceSameMulti } } }
-	    };
-
-	    for (const std::unique_ptr<ISite>& srcSite : mRegions)
-	    {
-		    auto srcRegion = dynamic_cast<CRegion*>(srcSite.get());
-		    assert(srcRegion != nullptr);
+        prop = networkPricesJson.find("sameMultiLocation");
+        if(prop != networkPricesJson.end() && !LoadNetworkPriceTable(prop.value(), mSameMultiLocationNetworkPrice))
+            return false;
 
-		    const std::uint32_t srcRegionMultiLocationIdx = srcRegion->GetMultiLocationIdx();
+        prop = networkPricesJson.find("default");
+        if(prop != networkPricesJson.end())
+        {
+            if(!LoadNetworkPriceTable(prop.value(), mDefaultNetworkPrice))
+                return false;
+            mHasDefaultNetworkPrice = true;
+        }
 
-            //first set prices for existing links (outgoing links)
-            for(std::unique_ptr<CLinkSelector> &linkSelector : srcRegion->mLinkSelectors)
+        std::vector<std::pair<std::pair<std::uint32_t, std::uint32_t>, std::shared_ptr<const CNetworkPriceTable>>> multiLocationPrices;
+        std::uint32_t numMultiLocations = 0;
+        prop = networkPricesJson.find("multiLocations");
+        if(prop != networkPricesJson.end())
+        {
+            for(const auto& multiLocationPriceJson : prop.value())
             {
-                OuterMapType::const_iterator outerIt = priceWW.find(srcRegionMultiLocationIdx);
-                InnerMapType::const_iterator innerIt;
-                if(outerIt != priceWW.cend())
+                auto idxsProp = multiLocationPriceJson.find("multiLocationIdxs");
+                auto tiersProp = multiLocationPriceJson.find("tiers");
+                if(idxsProp == multiLocationPriceJson.end() || !idxsProp->is_array() || idxsProp->size() != 2 || tiersProp == multiLocationPriceJson.end())
                 {
-                    //found the srcRegion idx in the outer map
-                    //lets see if we find the dstRegion idx in the inner map
-                    innerIt = outerIt->second.find(linkSelector->GetDstSite()->GetMultiLocationIdx());
-                    if(innerIt == outerIt->second.cend())
-                        outerIt = priceWW.cend(); //Nope. Reset outerIt and try with swapped order
+                    std::cout << "Expected multiLocationIdxs pair and tiers in network price: " << multiLocationPriceJson.dump() << std::endl;
+                    return false;
                 }
-                if(outerIt == priceWW.cend())
+                std::shared_ptr<const CNetworkPriceTable> networkPrice;
+                if(!LoadNetworkPriceTable(tiersProp.value(), networkPrice))
+                    return false;
+                const std::uint32_t firstIdx = idxsProp->at(0).get<std::uint32_t>();
+                const std::uint32_t secondIdx = idxsProp->at(1).get<std::uint32_t>();
+                numMultiLocations = std::max({numMultiLocations, firstIdx + 1, secondIdx + 1});
+                multiLocationPrices.push_back({{firstIdx, secondIdx}, std::move(networkPrice)});
+            }
+        }
+
+        // regions that already exist, e.g. of a generated topology, must be priced as well
+        for(const CRegion* region : mGCPRegions)
+            numMultiLocations = std::max(numMultiLocations, region->GetMultiLocationIdx() + 1);
+
+        // the diagonal and all pairs without price are filled first,
+        // so the listed prices only have to contain one order of each pair
+        mNumMultiLocations = std::max(mNumMultiLocations, numMultiLocations);
+        mMultiLocationNetworkPrices.assign(static_cast<std::size_t>(mNumMultiLocations) * mNumMultiLocations, nullptr);
+        for(std::uint32_t idx = 0; idx < mNumMultiLocations; ++idx)
+            mMultiLocationNetworkPrices[(idx * mNumMultiLocations) + idx] = mSameMultiLocationNetworkPrice;
+        for(const auto& [idxs, networkPrice] : multiLocationPrices)
+        {
+            mMultiLocationNetworkPrices[(idxs.first * mNumMultiLocations) + idxs.second] = networkPrice;
+            mMultiLocationNetworkPrices[(idxs.second * mNumMultiLocations) + idxs.first] = networkPrice;
+        }
+
+        bool ok = true;
+        for(std::uint32_t firstIdx = 0; firstIdx < mNumMultiLocations; ++firstIdx)
+        {
+            for(std::uint32_t secondIdx = firstIdx + 1; secondIdx < mNumMultiLocations; ++secondIdx)
+            {
+                std::shared_ptr<const CNetworkPriceTable>& networkPrice = mMultiLocationNetworkPrices[(firstIdx * mNumMultiLocations) + secondIdx];
+                if(networkPrice != nullptr)
+                    continue;
+                if(!mHasDefaultNetworkPrice)
                 {
-                    outerIt = priceWW.find(linkSelector->GetDstSite()->GetMultiLocationIdx());
-                    assert(outerIt != priceWW.cend());
-                    innerIt = outerIt->second.find(srcRegionMultiLocationIdx);
+                    std::cout << "Missing network price between multi locations " << firstIdx << " and " << secondIdx << " without default price" << std::endl;
+                    ok = false;
                 }
+                networkPrice = mDefaultNetworkPrice;
+                mMultiLocationNetworkPrices[(secondIdx * mNumMultiLocations) + firstIdx] = mDefaultNetworkPrice;
+            }
+        }
+        if(!ok)
+        {
+            // CheckNetworkPrices() then rejects the multi locations instead of pricing them as free
+            mNumMultiLocations = 0;
+            mMultiLocationNetworkPrices.clear();
+            return false;
+        }
 
-                assert(innerIt != outerIt->second.cend());
-                linkSelector->mNetworkPrice = innerIt->second;
+        std::cout << "Loaded network prices of " << multiLocationPrices.size() << " pairs of " << mNumMultiLocations << " multi locations" << std::endl;
+        return true;
+    }
+
+    bool CCloud::CheckNetworkPrices(const std::vector<const ISite*>& sites) const
+    {
+        if(mHasDefaultNetworkPrice || mGCPRegions.empty())
+            return true;
+
+        std::vector<std::uint32_t> multiLocationIdxs;
+        for(const CRegion* region : mGCPRegions)
+            multiLocationIdxs.push_back(region->GetMultiLocationIdx());
+        for(const ISite* site : sites)
+            multiLocationIdxs.push_back(site->GetMultiLocationIdx());
+        std::sort(multiLocationIdxs.begin(), multiLocationIdxs.end());
+        multiLocationIdxs.erase(std::unique(multiLocationIdxs.begin(), multiLocationIdxs.end()), multiLocationIdxs.end());
+
+        // all traffic within one multi location uses the sameRegion or sameMultiLocation price
+        if(multiLocationIdxs.size() < 2)
+            return true;
+
+        bool ok = true;
+        for(const std::uint32_t multiLocationIdx : multiLocationIdxs)
+        {
+            if(multiLocationIdx < mNumMultiLocations)
+                continue;
+            std::cout << "No network prices for multi location " << multiLocationIdx << " of " << GetName() << " and no default price configured" << std::endl;
+            ok = false;
+        }
+        return ok;
+    }
+
+    auto CCloud::GetLinkNetworkPrice(const ISite* const srcSite, const ISite* const dstSite, std::uint32_t& bandwidth) const -> const std::shared_ptr<const CNetworkPriceTable>*
+    {
+        auto srcRegion = dynamic_cast<const CRegion*>(srcSite);
+        auto dstRegion = dynamic_cast<const CRegion*>(dstSite);
+        if (srcRegion != nullptr && dstRegion != nullptr)
+        {
+            if ((*srcRegion) == (*dstRegion))
+            {
+                // 1. case: r1 and r2 are the same region
+                bandwidth = ONE_GiB/8;
+                return &mSameRegionNetworkPrice;
             }
+            else if (srcRegion->GetMultiLocationIdx() == dstRegion->GetMultiLocationIdx())
+            {
+                // 2. case: region r1 is inside the multi region r2
+                bandwidth = ONE_GiB/32;
+                return &mSameMultiLocationNetworkPrice;
+            }
+            // 3. case: r1 and r2 are in different multi regions
+            bandwidth = ONE_GiB/64;
+            return &GetMultiLocationNetworkPrice(srcRegion->GetMultiLocationIdx(), dstRegion->GetMultiLocationIdx());
+        }
+        else if (srcRegion != nullptr)
+        {
+            // egress to a site outside of the cloud
+            bandwidth = ONE_GiB/128;
+            return &GetMultiLocationNetworkPrice(srcRegion->GetMultiLocationIdx(), dstSite->GetMultiLocationIdx());
+        }
+        else if (dstRegion != nullptr)
+        {
+            // ingress is free
+            bandwidth = ONE_GiB/32;
+            return &CNetworkPriceTable::GetFreeTable();
+        }
+        return nullptr;
+    }
 
-		    for (const std::unique_ptr<ISite>& dstSite : mRegions)
-		    {
-			    auto dstRegion = dynamic_cast<CRegion*>(dstSite.get());
-			    assert(dstRegion != nullptr);
-			    const std::uint32_t dstRegionMultiLocationIdx = dstRegion->GetMultiLocationIdx();
-			    const bool isSameLocation = (*srcRegion) == (*dstRegion);
-			    if (!isSameLocation && (srcRegionMultiLocationIdx != dstRegionMultiLocationIdx))
-			    {
-				    OuterMapType::const_iterator outerIt = priceWW.find(srcRegionMultiLocationIdx);
-				    InnerMapType::const_iterator innerIt;
-				    if(outerIt != priceWW.cend())
-				    {
-					    //found the srcRegion idx in the outer map
-					    //lets see if we find the dstRegion idx in the inner map
-					    innerIt = outerIt->second.find(dstRegionMultiLocationIdx);
-					    if(innerIt == outerIt->second.cend())
-						    outerIt = priceWW.cend(); //Nope. Reset outerIt and try with swapped order
-				    }
-				    if(outerIt == priceWW.cend())
-				    {
-					    outerIt = priceWW.find(dstRegionMultiLocationIdx);
-					    assert(outerIt != priceWW.cend());
-					    innerIt = outerIt->second.find(srcRegionMultiLocationIdx);
-				    }
-
-				    assert(innerIt != outerIt->second.cend());
-				    CLinkSelector* linkSelector = srcRegion->CreateLinkSelector(dstRegion, ONE_GiB/64);
-				    linkSelector->mNetworkPrice = innerIt->second;
-			    }
-			    else if (isSameLocation)
-			    {
-				    // 2. case: r1 and r2 are the same region
-				    //linkselector.network_price_chf = priceSameRegion
-				    CLinkSelector* linkSelector = srcRegion->CreateLinkSelector(dstRegion, ONE_GiB/8);
-				    linkSelector->mNetworkPrice = priceSameRegion;
-			    }
-			    else
-			    {
-				    // 3. case: region r1 is inside the multi region r2
-				    //linkselector.network_price_chf = priceSameMulti
-				    CLinkSelector* linkSelector = srcRegion->CreateLinkSelector(dstRegion, ONE_GiB/32);
-				    linkSelector->mNetworkPrice = priceSameMulti;
-			    }
-		    }
-	    }
+    auto CCloud::CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector*
+    {
+        std::uint32_t bandwidth;
+        const std::shared_ptr<const CNetworkPriceTable>* const networkPrice = GetLinkNetworkPrice(srcSite, dstSite, bandwidth);
+        if (networkPrice == nullptr)
+            return nullptr;
+        CLinkSelector* const linkSelector = srcSite->CreateLinkSelector(dstSite, bandwidth);
+        linkSelector->SetNetworkPrice(*networkPrice);
+        return linkSelector;
+    }
+
+    bool CCloud::GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const
+    {
+        std::uint32_t bandwidth;
+        const std::shared_ptr<const CNetworkPriceTable>* const networkPrice = GetLinkNetworkPrice(srcSite, dstSite, bandwidth);
+        if (networkPrice == nullptr)
+            return false;
+        weight = (*networkPrice)->GetLastPrice();
+        return true;
+    }
+
+    void CCloud::SetupDefaultCloud()
+    {
+        for (const std::unique_ptr<ISite>& srcSite : mRegions)
+            for (const std::unique_ptr<ISite>& dstSite : mRegions)
+                CreateLinkSelector(srcSite.get(), dstSite.get());
     }
 
     bool CCloud::TryConsumeConfig(const nlohmann::json& json)
@@ -276,86 +339,66 @@ namespace gcp
         nlohmann::json::const_iterator rootIt = json.find("gcp");
         if(rootIt == json.cend())
             return false;
+        bool ok = true;
         for( const auto& [key, value] : rootIt.value().items() )
         {
             if( key == "regions" )
             {
                 for(const auto& regionJson : value)
                 {
-                    std::unique_ptr<std::uint32_t> multiLocationIdx;
-                    std::string regionName, regionLocation, skuId;
-                    double price = 0;
-                    std::uint32_t numJobSlots = 0;
-                    nlohmann::json bucketsJson;
+                    SSiteConfig regionConfig;
                     for(const auto& [regionJsonKey, regionJsonValue] : regionJson.items())
-                    {
-                        if(regionJsonKey == "multiLocationIdx")
-                            multiLocationIdx = std::make_unique<std::uint32_t>(regionJsonValue.get<std::uint32_t>());
-                        else if(regionJsonKey == "name")
-                            regionName = regionJsonValue.get<std::string>();
-                        else if(regionJsonKey == "location")
-                            regionLocation = regionJsonValue.get<std::string>();
-                        else if (regionJsonKey == "numJobSlots")
-                            numJobSlots = regionJsonValue.get<std::uint32_t>();
-                        else if(regionJsonKey == "buckets")
-                            bucketsJson = regionJsonValue;
-                        else if(regionJsonKey == "price")
-                            price = regionJsonValue.get<double>();
-                        else if(regionJsonKey == "skuId")
-                            skuId = regionJsonValue.get<std::string>();
-                        else
-                            std::cout << "Ignoring unknown attribute while loading regions: " << regionJsonKey << std::endl;
-                    }
-
-                    if(multiLocationIdx == nullptr)
-                    {
-                        std::cout << "Couldn't find multiLocationIdx attribute of region" << std::endl;
-                        continue;
-                    }
-
-                    if (regionName.empty())
-                    {
-                        std::cout << "Couldn't find name attribute of region" << std::endl;
-                        continue;
-                    }
-
-                    if (regionLocation.empty())
-                    {
-                        std::cout << "Couldn't find location attribute of region: " << regionName << std::endl;
-                        continue;
-                    }
-
-                    std::cout << "Adding region " << regionName << " in " << regionLocation << std::endl;
-            	    CRegion *region = CreateRegion(*multiLocationIdx, std::move(regionName), std::move(regionLocation), numJobSlots, price, std::move(skuId));
-
-                    if (bucketsJson.empty())
-                    {
-                        std::cout << "No buckets to create for this region" << std::endl;
-                        continue;
-                    }
-
-                    for(const auto& bucketJson : bucketsJson)
-                    {
-                        std::string bucketName;
-                        for(const auto& [bucketJsonKey, bucketJsonValue] : bucketJson.items())
-                        {
-                            if(bucketJsonKey == "name")
-                                bucketName = bucketJsonValue.get<std::string>();
-                            else
-                                std::cout << "Ignoring unknown attribute while loading bucket: " << bucketJsonKey << std::endl;
-                        }
-
-                        if (bucketName.empty())
-                        {
-                            std::cout << "Couldn't find name attribute of bucket" << std::endl;
-                            continue;
-                        }
-
-                        std::cout << "Adding bucket " << bucketName << std::endl;
-                        region->CreateStorageElement(std::move(bucketName));
-                    }
+                        regionConfig.SetAttribute(regionJsonKey, regionJsonValue);
+                    TryConsumeSiteConfig("gcp", regionConfig);
                 }
             }
+            else if( key == "networkPrices" )
+                ok = LoadNetworkPrices(value) && ok;
+        }
+        return ok;
+    }
+
+    bool CCloud::TryConsumeSiteConfig(const std::string& rootKey, SSiteConfig& regionConfig)
+    {
+        if(rootKey != "gcp")
+            return false;
+
+        if(regionConfig.mMultiLocationIdx == nullptr)
+        {
+            std::cout << "Couldn't find multiLocationIdx attribute of region" << std::endl;
+            return true;
+        }
+
+        if (regionConfig.mName.empty())
+        {
+            std::cout << "Couldn't find name attribute of region" << std::endl;
+            return true;
+        }
+
+        if (regionConfig.mLocationName.empty())
+        {
+            std::cout << "Couldn't find location attribute of region: " << regionConfig.mName << std::endl;
+            return true;
+        }
+
+        std::cout << "Adding region " << regionConfig.mName << " in " << regionConfig.mLocationName << std::endl;
+        CRegion *region = CreateRegion(*regionConfig.mMultiLocationIdx,
+                                       std::move(regionConfig.mName),
+                                       std::move(regionConfig.mLocationName),
+                                       regionConfig.mNumJobSlots,
+                                       regionConfig.mStoragePrice,
+                                       std::move(regionConfig.mSKUId));
+
+        if (regionConfig.mStorageElementNames.empty())
+        {
+            std::cout << "No buckets to create for this region" << std::endl;
+            return true;
+        }
+
+        for(std::string& bucketName : regionConfig.mStorageElementNames)
+        {
+            std::cout << "Adding bucket " << bucketName << std::endl;
+            region->CreateStorageElement(std::move(bucketName));
         }
         return true;
     }
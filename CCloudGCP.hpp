@@ -1,26 +1,69 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "IBaseCloud.hpp"
 #include "ISite.hpp"
 
+#include "CLinkSelector.hpp"
 #include "CStorageElement.hpp"
 
+// collecting the costs of a region is cheap, so only large clouds are billed in parallel
+#define BILLING_MIN_REGIONS_PER_THREAD (64)
+
 namespace gcp
 {
+    __extension__ typedef unsigned __int128 UInt128Type;
+
+    // fixed point sum of byte seconds. Adding only takes two relaxed atomic adds and additions
+    // commute, so the sum is exact regardless of the order of concurrent threads.
+    // It must only be read while no thread adds to it
+    class CByteSecondsAccumulator
+    {
+    private:
+        std::atomic<std::uint64_t> mLow {0};
+        std::atomic<std::uint64_t> mHigh {0};
+
+    public:
+        inline void Add(const std::uint64_t bytes, const std::uint64_t seconds)
+        {
+            const UInt128Type byteSeconds = static_cast<UInt128Type>(bytes) * seconds;
+            const std::uint64_t low = static_cast<std::uint64_t>(byteSeconds);
+            const std::uint64_t prevLow = mLow.fetch_add(low, std::memory_order_relaxed);
+            const std::uint64_t carry = ((prevLow + low) < prevLow) ? 1 : 0;
+            mHigh.fetch_add(static_cast<std::uint64_t>(byteSeconds >> 64) + carry, std::memory_order_relaxed);
+        }
+
+        inline auto Get() const -> UInt128Type
+        {return (static_cast<UInt128Type>(mHigh.load(std::memory_order_relaxed)) << 64) | mLow.load(std::memory_order_relaxed);}
+
+        inline void Reset()
+        {
+            mLow.store(0, std::memory_order_relaxed);
+            mHigh.store(0, std::memory_order_relaxed);
+        }
+    };
+
 	class CRegion;
 	class CBucket : public CStorageElement
 	{
 	private:
         CRegion* mRegion;
-        TickType mTimeLastCostUpdate = 0;
-        double mCosts = 0;
+
+        // the byte seconds of the billing period are used storage * period length + removed - added,
+        // with the byte seconds of each change counted from the start of the period
+        TickType mCostPeriodStartTick = 0;
+        CByteSecondsAccumulator mAddedByteSeconds;
+        CByteSecondsAccumulator mRemovedByteSeconds;
 
 	public:
 
 		CBucket(std::string&& name, CRegion* region);
 		CBucket(CBucket&&) = default;
 		virtual void OnIncreaseReplica(std::uint64_t amount, TickType now) final;
-		virtual void OnRemoveReplica(const SReplica* replica, TickType now) final;
+		virtual void OnRemoveReplica(const SReplica* replica, TickType now, bool needLock=true) final;
 
 		double CalculateStorageCosts(TickType now);
 	};
@@ -33,10 +76,12 @@ namespace gcp
 
 		auto CreateStorageElement(std::string&& name) -> CBucket* final;
 		double CalculateStorageCosts(TickType now);
-		double CalculateNetworkCosts(double& sumUsedTraffic, std::uint64_t& sumDoneTransfers);
+		auto CollectCosts(TickType now) -> SSiteCosts;
 
 		inline auto GetStoragePrice() const -> double
 		{return mStoragePrice;}
+		inline auto GetSKUId() const -> const std::string&
+		{return mSKUId;}
 
         std::vector<std::unique_ptr<CBucket>> mStorageElements;
 
@@ -50,6 +95,23 @@ namespace gcp
 
 	class CCloud final : public IBaseCloud
 	{
+	private:
+        // same regions as mRegions, so billing does not have to cast them
+        std::vector<CRegion*> mGCPRegions;
+
+        std::shared_ptr<const CNetworkPriceTable> mSameRegionNetworkPrice = CNetworkPriceTable::GetFreeTable();
+        std::shared_ptr<const CNetworkPriceTable> mSameMultiLocationNetworkPrice = CNetworkPriceTable::GetFreeTable();
+        std::shared_ptr<const CNetworkPriceTable> mDefaultNetworkPrice = CNetworkPriceTable::GetFreeTable();
+        // pairs of multi locations without price are only allowed if the config has a default price
+        bool mHasDefaultNetworkPrice = false;
+
+        // dense symmetric matrix of mNumMultiLocations * mNumMultiLocations prices
+        std::uint32_t mNumMultiLocations = 0;
+        std::vector<std::shared_ptr<const CNetworkPriceTable>> mMultiLocationNetworkPrices;
+
+        // bandwidth and price of the link between the sites. Returns nullptr if none of both sites is a region of the cloud
+        auto GetLinkNetworkPrice(const ISite* const srcSite, const ISite* const dstSite, std::uint32_t& bandwidth) const -> const std::shared_ptr<const CNetworkPriceTable>*;
+
 	public:
 		using IBaseCloud::IBaseCloud;
 
@@ -60,9 +122,31 @@ namespace gcp
                           const double storagePrice,
                           std::string&& skuId) -> CRegion* final;
 
-		auto ProcessBilling(TickType now) -> std::pair<double, std::pair<double, double>> final;
+		auto CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector* final;
+		bool GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const final;
+		void CollectCosts(TickType now, std::vector<SSiteCosts>& siteCosts) final;
 		void SetupDefaultCloud() final;
 
+        // price of the traffic between two multi locations. CheckNetworkPrices() ensures that
+        // multi locations without loaded prices only exist if the config has a default price
+        inline auto GetMultiLocationNetworkPrice(const std::uint32_t srcMultiLocationIdx, const std::uint32_t dstMultiLocationIdx) const -> const std::shared_ptr<const CNetworkPriceTable>&
+        {
+            if(srcMultiLocationIdx >= mNumMultiLocations || dstMultiLocationIdx >= mNumMultiLocations)
+                return (srcMultiLocationIdx == dstMultiLocationIdx) ? mSameMultiLocationNetworkPrice : mDefaultNetworkPrice;
+            return mMultiLocationNetworkPrices[(srcMultiLocationIdx * mNumMultiLocations) + dstMultiLocationIdx];
+        }
+
+        // checks that the links from the regions to all regions and to the given sites have a loaded
+        // price or that the config has a default price. Reports every multi location without price
+        bool CheckNetworkPrices(const std::vector<const ISite*>& sites) const;
+
+        // reads the tiers of sameRegion, sameMultiLocation, default and a list of multiLocations.
+        // Fails if a pair of multi locations has no price and no default price is given, e.g.:
+        // {"sameMultiLocation": [[1, 0.0093465]],
+        //  "multiLocations": [{"multiLocationIdxs": [0, 1], "tiers": [[1024, 0.1775835], [10240, 0.1682370], [10240, 0.1401975]]}]}
+        bool LoadNetworkPrices(const nlohmann::json& networkPricesJson);
+
         bool TryConsumeConfig(const nlohmann::json& json) final;
+        bool TryConsumeSiteConfig(const std::string& rootKey, SSiteConfig& regionConfig) final;
 	};
 }
@@ -0,0 +1,582 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CColumnarOutputBackend.hpp"
+#include "COutput.hpp"
+#include "CSQLiteOutputBackend.hpp"
+
+
+
+static void AppendVarint(std::vector<unsigned char>& buffer, std::uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        buffer.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<unsigned char>(value));
+}
+
+static bool ReadVarint(const unsigned char*& cur, const unsigned char* const end, std::uint64_t& value)
+{
+    value = 0;
+    for(unsigned shift = 0; cur < end && shift < 64; shift += 7)
+    {
+        const unsigned char byte = *(cur++);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+template<typename T>
+static void WriteRaw(std::ofstream& file, const T& value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void WriteString(std::ofstream& file, const std::string& str)
+{
+    WriteRaw(file, static_cast<std::uint32_t>(str.size()));
+    file.write(str.c_str(), str.size());
+}
+
+
+
+auto CColumnarTable::GetColumnType(const std::string& sqlType) -> EColumnType
+{
+    std::string upperType(sqlType);
+    std::transform(upperType.begin(), upperType.end(), upperType.begin(), ::toupper);
+    // same rules as the sqlite type affinity
+    if(upperType.find("INT") != std::string::npos)
+        return eInteger;
+    if(upperType.find("CHAR") != std::string::npos || upperType.find("TEXT") != std::string::npos || upperType.find("CLOB") != std::string::npos)
+        return eText;
+    return eReal;
+}
+
+bool CColumnarTable::Open(const fs::path& filePath, const std::vector<SColumnDefinition>& columns, const std::string& constraints)
+{
+    assert(!mFile.is_open());
+
+    mFile.open(filePath, std::ios::binary | std::ios::trunc);
+    if(!mFile)
+        return false;
+
+    char magic[8] = {0};
+    std::memcpy(magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    mFile.write(magic, sizeof(magic));
+    WriteRaw(mFile, static_cast<std::uint32_t>(COLUMNAR_VERSION));
+    WriteRaw(mFile, static_cast<std::uint32_t>(columns.size()));
+    WriteString(mFile, constraints);
+
+    mColumns.resize(columns.size());
+    for(std::size_t i = 0; i < columns.size(); ++i)
+    {
+        mColumns[i].mType = GetColumnType(columns[i].mSQLType);
+        WriteRaw(mFile, static_cast<std::uint8_t>(mColumns[i].mType));
+        WriteString(mFile, columns[i].mName);
+        WriteString(mFile, columns[i].mSQLType);
+    }
+
+    return static_cast<bool>(mFile);
+}
+
+void CColumnarTable::AppendValue(const char* const value, const std::size_t length)
+{
+    SColumnBuffer& column = NextColumn();
+    assert(column.mType == eText);
+    // empty strings are stored as NULL like in the sqlite output
+    if(length == 0)
+    {
+        column.mTexts.push_back(0);
+        return;
+    }
+    AppendVarint(column.mTexts, length + 1);
+    column.mTexts.insert(column.mTexts.end(), value, value + length);
+}
+
+void CColumnarTable::AppendNull()
+{
+    SColumnBuffer& column = NextColumn();
+    assert(column.mType == eText);
+    column.mTexts.push_back(0);
+}
+
+void CColumnarTable::WriteChunk()
+{
+    if(mNumBufferedRows == 0)
+        return;
+
+    WriteRaw(mFile, static_cast<std::uint32_t>(mNumBufferedRows));
+    for(SColumnBuffer& column : mColumns)
+    {
+        const std::vector<unsigned char>* encoded = &mEncodeBuffer;
+        mEncodeBuffer.clear();
+        switch(column.mType)
+        {
+        case eInteger:
+        {
+            std::uint64_t prevValue = 0;
+            for(const std::int64_t value : column.mIntegers)
+            {
+                const std::uint64_t delta = static_cast<std::uint64_t>(value) - prevValue;
+                const std::uint64_t zigzag = (delta << 1) ^ static_cast<std::uint64_t>(static_cast<std::int64_t>(delta) >> 63);
+                AppendVarint(mEncodeBuffer, zigzag);
+                prevValue = static_cast<std::uint64_t>(value);
+            }
+            column.mIntegers.clear();
+            break;
+        }
+        case eReal:
+        {
+            mEncodeBuffer.resize(column.mReals.size() * sizeof(double));
+            std::memcpy(mEncodeBuffer.data(), column.mReals.data(), mEncodeBuffer.size());
+            column.mReals.clear();
+            break;
+        }
+        case eText:
+            encoded = &column.mTexts;
+            break;
+        }
+        WriteRaw(mFile, static_cast<std::uint32_t>(encoded->size()));
+        mFile.write(reinterpret_cast<const char*>(encoded->data()), encoded->size());
+        column.mTexts.clear();
+    }
+
+    mNumRows += mNumBufferedRows;
+    mNumBufferedRows = 0;
+}
+
+void CColumnarTable::Flush()
+{
+    mFile.flush();
+}
+
+void CColumnarTable::Close()
+{
+    if(!mFile.is_open())
+        return;
+    assert(mNextColumnIdx == 0);
+    WriteChunk();
+    mFile.close();
+}
+
+
+
+CColumnarTableReader::~CColumnarTableReader()
+{
+    Close();
+}
+
+void CColumnarTableReader::Close()
+{
+    if(mData != nullptr)
+        munmap(const_cast<unsigned char*>(mData), mDataSize);
+    if(mFileDescriptor >= 0)
+        close(mFileDescriptor);
+    mData = nullptr;
+    mDataSize = 0;
+    mReadPos = 0;
+    mFileDescriptor = -1;
+}
+
+bool CColumnarTableReader::Read(void* const dst, const std::size_t numBytes)
+{
+    if((mReadPos + numBytes) > mDataSize)
+        return false;
+    std::memcpy(dst, mData + mReadPos, numBytes);
+    mReadPos += numBytes;
+    return true;
+}
+
+bool CColumnarTableReader::ReadString(std::string& str)
+{
+    std::uint32_t length;
+    if(!Read(&length, sizeof(length)) || (mReadPos + length) > mDataSize)
+        return false;
+    str.assign(reinterpret_cast<const char*>(mData + mReadPos), length);
+    mReadPos += length;
+    return true;
+}
+
+bool CColumnarTableReader::Open(const fs::path& filePath)
+{
+    assert(mData == nullptr);
+
+    mFileDescriptor = open(filePath.c_str(), O_RDONLY);
+    if(mFileDescriptor < 0)
+    {
+        std::cout << "Unable to open columnar table: " << filePath << std::endl;
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(mFileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mDataSize = static_cast<std::size_t>(fileStat.st_size);
+    void* const data = mmap(nullptr, mDataSize, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+    if(data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    mData = static_cast<const unsigned char*>(data);
+    madvise(data, mDataSize, MADV_SEQUENTIAL);
+
+    char magic[8];
+    std::uint32_t version, numColumns;
+    if(!Read(magic, sizeof(magic)) || std::strncmp(magic, COLUMNAR_MAGIC, sizeof(magic)) != 0
+       || !Read(&version, sizeof(version)) || version != COLUMNAR_VERSION
+       || !Read(&numColumns, sizeof(numColumns)) || !ReadString(mConstraints))
+    {
+        std::cout << "Invalid columnar table header: " << filePath << std::endl;
+        Close();
+        return false;
+    }
+
+    mColumns.resize(numColumns);
+    for(SColumn& column : mColumns)
+    {
+        std::uint8_t type;
+        if(!Read(&type, sizeof(type)) || type > CColumnarTable::eText || !ReadString(column.mName) || !ReadString(column.mSQLType))
+        {
+            std::cout << "Invalid columnar table header: " << filePath << std::endl;
+            Close();
+            return false;
+        }
+        column.mType = static_cast<CColumnarTable::EColumnType>(type);
+    }
+
+    return true;
+}
+
+auto CColumnarTableReader::ReadChunk() -> std::size_t
+{
+    std::uint32_t numRows;
+    if(!Read(&numRows, sizeof(numRows)))
+        return 0;
+
+    for(SColumn& column : mColumns)
+    {
+        std::uint32_t numBytes;
+        if(!Read(&numBytes, sizeof(numBytes)) || (mReadPos + numBytes) > mDataSize)
+            return 0;
+        const unsigned char* cur = mData + mReadPos;
+        const unsigned char* const end = cur + numBytes;
+        mReadPos += numBytes;
+
+        column.mIntegers.clear();
+        column.mReals.clear();
+        column.mTexts.clear();
+        switch(column.mType)
+        {
+        case CColumnarTable::eInteger:
+        {
+            column.mIntegers.reserve(numRows);
+            std::uint64_t value = 0;
+            for(std::uint32_t i = 0; i < numRows; ++i)
+            {
+                std::uint64_t zigzag;
+                if(!ReadVarint(cur, end, zigzag))
+                    return 0;
+                value += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+                column.mIntegers.push_back(static_cast<std::int64_t>(value));
+            }
+            break;
+        }
+        case CColumnarTable::eReal:
+            if(numBytes != (numRows * sizeof(double)))
+                return 0;
+            column.mReals.resize(numRows);
+            std::memcpy(column.mReals.data(), cur, numBytes);
+            break;
+        case CColumnarTable::eText:
+            column.mTexts.reserve(numRows);
+            for(std::uint32_t i = 0; i < numRows; ++i)
+            {
+                std::uint64_t lengthPlusOne;
+                if(!ReadVarint(cur, end, lengthPlusOne))
+                    return 0;
+                const std::size_t length = (lengthPlusOne > 0) ? static_cast<std::size_t>(lengthPlusOne - 1) : 0;
+                if((cur + length) > end)
+                    return 0;
+                column.mTexts.emplace_back(reinterpret_cast<const char*>(cur), length);
+                cur += length;
+            }
+            break;
+        }
+    }
+
+    return numRows;
+}
+
+
+
+CColumnarOutputBackend::~CColumnarOutputBackend()
+{
+    Close();
+}
+
+bool CColumnarOutputBackend::Open(const fs::path& dirPath)
+{
+    std::error_code error;
+    fs::create_directories(dirPath, error);
+    if(error)
+    {
+        std::cout << "Unable to create columnar output directory " << dirPath << ": " << error.message() << std::endl;
+        return false;
+    }
+    mDirPath = dirPath;
+    return true;
+}
+
+bool CColumnarOutputBackend::CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints)
+{
+    if(mTableNameToIdx.count(tableName) > 0)
+        return false;
+
+    auto table = std::make_unique<CColumnarTable>();
+    if(!table->Open(mDirPath / (tableName + COLUMNAR_FILE_EXTENSION), columns, constraints))
+        return false;
+
+    mTableNameToIdx[tableName] = mTables.size();
+    mTables.emplace_back(std::move(table));
+    return true;
+}
+
+auto CColumnarOutputBackend::AddInsertStatement(const std::string& tableName) -> std::size_t
+{
+    const auto result = mTableNameToIdx.find(tableName);
+    assert(result != mTableNameToIdx.cend());
+    return result->second;
+}
+
+bool CColumnarOutputBackend::InsertRow(const std::string& tableName, const std::string& row)
+{
+    const auto result = mTableNameToIdx.find(tableName);
+    if(result == mTableNameToIdx.cend())
+        return false;
+    CColumnarTable& table = *(mTables[result->second]);
+
+    // splits the row into sql literals: numbers, 'quoted strings' and NULL
+    std::vector<std::pair<std::string, bool>> literals;
+    std::string literal;
+    bool isQuoted = false;
+    for(std::size_t i = 0; i <= row.size(); ++i)
+    {
+        if(i == row.size() || row[i] == ',')
+        {
+            literals.emplace_back(std::move(literal), isQuoted);
+            literal.clear();
+            isQuoted = false;
+        }
+        else if(row[i] == '\'')
+        {
+            isQuoted = true;
+            for(++i; i < row.size(); ++i)
+            {
+                if(row[i] == '\'')
+                {
+                    if((i + 1) < row.size() && row[i + 1] == '\'')
+                        ++i;
+                    else
+                        break;
+                }
+                literal += row[i];
+            }
+        }
+        else if(!std::isspace(static_cast<unsigned char>(row[i])))
+            literal += row[i];
+    }
+
+    if(literals.size() != table.GetNumColumns())
+        return false;
+
+    auto isNull = [](const std::pair<std::string, bool>& literal) -> bool
+    {return !literal.second && (literal.first.empty() || literal.first == "NULL" || literal.first == "null");};
+
+    // check all values before the first one is appended, so a rejected row leaves no partial row behind
+    for(std::size_t i = 0; i < literals.size(); ++i)
+    {
+        if(isNull(literals[i]) && table.GetColumnType(i) != CColumnarTable::eText)
+        {
+            std::cout << "Unable to insert NULL into non text column " << i << " of " << tableName << std::endl;
+            return false;
+        }
+    }
+
+    for(std::size_t i = 0; i < literals.size(); ++i)
+    {
+        const std::string& value = literals[i].first;
+        if(isNull(literals[i]))
+        {
+            table.AppendNull();
+            continue;
+        }
+
+        switch(table.GetColumnType(i))
+        {
+        case CColumnarTable::eInteger:
+            table.AppendValue(static_cast<std::uint64_t>(std::strtoll(value.c_str(), nullptr, 10)));
+            break;
+        case CColumnarTable::eReal:
+            table.AppendValue(std::strtod(value.c_str(), nullptr));
+            break;
+        case CColumnarTable::eText:
+            table.AppendValue(value);
+            break;
+        }
+    }
+    table.EndRow();
+    return true;
+}
+
+auto CColumnarOutputBackend::Insert(const std::size_t insertStatementIdx, IInsertValuesContainer& values) -> std::size_t
+{
+    assert(insertStatementIdx < mTables.size());
+    return values.WriteRows(*(mTables[insertStatementIdx]));
+}
+
+void CColumnarOutputBackend::BeginTransaction()
+{}
+
+void CColumnarOutputBackend::EndTransaction()
+{
+    for(std::unique_ptr<CColumnarTable>& table : mTables)
+        table->Flush();
+}
+
+bool CColumnarOutputBackend::MergeShard(const fs::path& shardFilePath, const std::vector<std::string>& tableNames)
+{
+    for(const std::string& tableName : tableNames)
+    {
+        const auto result = mTableNameToIdx.find(tableName);
+        if(result == mTableNameToIdx.cend())
+            return false;
+        CColumnarTable& table = *(mTables[result->second]);
+
+        CColumnarTableReader reader;
+        if(!reader.Open(shardFilePath / (tableName + COLUMNAR_FILE_EXTENSION)))
+            return false;
+
+        const std::vector<CColumnarTableReader::SColumn>& columns = reader.GetColumns();
+        if(columns.size() != table.GetNumColumns())
+            return false;
+
+        for(std::size_t numRows = reader.ReadChunk(); numRows > 0; numRows = reader.ReadChunk())
+        {
+            for(std::size_t row = 0; row < numRows; ++row)
+            {
+                for(const CColumnarTableReader::SColumn& column : columns)
+                {
+                    switch(column.mType)
+                    {
+                    case CColumnarTable::eInteger:
+                        table.AppendValue(static_cast<std::uint64_t>(column.mIntegers[row]));
+                        break;
+                    case CColumnarTable::eReal:
+                        table.AppendValue(column.mReals[row]);
+                        break;
+                    case CColumnarTable::eText:
+                        table.AppendValue(column.mTexts[row]);
+                        break;
+                    }
+                }
+                table.EndRow();
+            }
+        }
+    }
+    return true;
+}
+
+void CColumnarOutputBackend::Close()
+{
+    for(std::unique_ptr<CColumnarTable>& table : mTables)
+        table->Close();
+    mTables.clear();
+    mTableNameToIdx.clear();
+}
+
+bool CColumnarOutputBackend::ConvertToSQLite(const fs::path& dirPath, const fs::path& dbFilePath)
+{
+    std::vector<fs::path> tableFilePaths;
+    for(const fs::directory_entry& entry : fs::directory_iterator(dirPath))
+        if(entry.path().extension() == COLUMNAR_FILE_EXTENSION)
+            tableFilePaths.push_back(entry.path());
+    std::sort(tableFilePaths.begin(), tableFilePaths.end());
+
+    CSQLiteOutputBackend db;
+    if(!db.Open(dbFilePath, false))
+    {
+        std::cout << "Unable to open db: " << dbFilePath << std::endl;
+        return false;
+    }
+    db.SetPragma("journal_mode", "OFF");
+    db.SetPragma("synchronous", "OFF");
+    db.SetNumRowsPerInsert(64);
+
+    for(const fs::path& tableFilePath : tableFilePaths)
+    {
+        CColumnarTableReader reader;
+        if(!reader.Open(tableFilePath))
+            return false;
+
+        const std::string tableName = tableFilePath.stem().string();
+        const std::vector<CColumnarTableReader::SColumn>& columns = reader.GetColumns();
+        std::vector<SColumnDefinition> columnDefinitions;
+        for(const CColumnarTableReader::SColumn& column : columns)
+            columnDefinitions.push_back({column.mName, column.mSQLType});
+
+        if(!db.CreateTable(tableName, columnDefinitions, reader.GetConstraints()))
+        {
+            std::cout << "Unable to create table " << tableName << std::endl;
+            return false;
+        }
+        const std::size_t insertStatementIdx = db.AddInsertStatement(tableName);
+
+        std::uint64_t numRowsTotal = 0;
+        db.BeginTransaction();
+        for(std::size_t numRows = reader.ReadChunk(); numRows > 0; numRows = reader.ReadChunk())
+        {
+            CInsertStatements inserts(insertStatementIdx, numRows * columns.size());
+            for(std::size_t row = 0; row < numRows; ++row)
+            {
+                for(const CColumnarTableReader::SColumn& column : columns)
+                {
+                    switch(column.mType)
+                    {
+                    case CColumnarTable::eInteger:
+                        inserts.AddValue(static_cast<std::uint64_t>(column.mIntegers[row]));
+                        break;
+                    case CColumnarTable::eReal:
+                        inserts.AddValue(column.mReals[row]);
+                        break;
+                    case CColumnarTable::eText:
+                        inserts.AddValue(column.mTexts[row]);
+                        break;
+                    }
+                }
+            }
+            numRowsTotal += db.Insert(insertStatementIdx, inserts);
+        }
+        db.EndTransaction();
+        std::cout << "Converted " << numRowsTotal << " rows of " << tableName << std::endl;
+    }
+
+    db.Close();
+    return true;
+}
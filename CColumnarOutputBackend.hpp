@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IOutputBackend.hpp"
+
+namespace fs = std::filesystem;
+
+
+
+#define COLUMNAR_MAGIC ("GACSCOL")
+#define COLUMNAR_VERSION (1)
+#define COLUMNAR_FILE_EXTENSION (".gcol")
+#define COLUMNAR_CHUNK_NUM_ROWS (65536)
+
+// one file per table:
+// header: magic[8], uint32 version, uint32 numColumns, string constraints,
+//         numColumns * (uint8 column type, string name, string sql type)
+//         strings are stored as uint32 length followed by the chars
+// followed by chunks until the end of the file:
+//         uint32 numRows, numColumns * (uint32 numBytes, encoded values)
+// encodings: integers are delta to the previous row of the chunk, zigzag and varint encoded.
+//            reals are raw doubles. texts are varint (length + 1) followed by the chars, 0 for NULL or empty.
+// there is no presence information, so integer and real columns cannot store NULL
+class CColumnarTable : public IRowWriter
+{
+public:
+    enum EColumnType : std::uint8_t
+    {
+        eInteger = 0,
+        eReal = 1,
+        eText = 2
+    };
+
+    static auto GetColumnType(const std::string& sqlType) -> EColumnType;
+
+private:
+    struct SColumnBuffer
+    {
+        EColumnType mType;
+        std::vector<std::int64_t> mIntegers;
+        std::vector<double> mReals;
+        std::vector<unsigned char> mTexts;
+    };
+
+    std::ofstream mFile;
+    std::vector<SColumnBuffer> mColumns;
+    std::vector<unsigned char> mEncodeBuffer;
+
+    std::size_t mNextColumnIdx = 0;
+    std::size_t mNumBufferedRows = 0;
+    std::uint64_t mNumRows = 0;
+
+    void WriteChunk();
+
+    inline auto NextColumn() -> SColumnBuffer&
+    {
+        assert(mNextColumnIdx < mColumns.size());
+        return mColumns[mNextColumnIdx++];
+    }
+
+    inline void AppendInteger(const std::int64_t value)
+    {
+        SColumnBuffer& column = NextColumn();
+        assert(column.mType == eInteger);
+        column.mIntegers.push_back(value);
+    }
+
+public:
+    bool Open(const fs::path& filePath, const std::vector<SColumnDefinition>& columns, const std::string& constraints);
+    void Flush();
+    void Close();
+
+    inline auto GetNumColumns() const -> std::size_t final
+    {return mColumns.size();}
+    inline auto GetColumnType(const std::size_t columnIdx) const -> EColumnType
+    {return mColumns[columnIdx].mType;}
+    inline auto GetNumRows() const -> std::uint64_t
+    {return mNumRows + mNumBufferedRows;}
+
+    // values have to be appended in column order followed by EndRow()
+    inline void AppendValue(const int value) final
+    {AppendInteger(value);}
+    inline void AppendValue(const std::uint32_t value) final
+    {AppendInteger(value);}
+    inline void AppendValue(const std::uint64_t value) final
+    {AppendInteger(static_cast<std::int64_t>(value));}
+    inline void AppendValue(const double value) final
+    {
+        SColumnBuffer& column = NextColumn();
+        assert(column.mType == eReal);
+        column.mReals.push_back(value);
+    }
+    void AppendValue(const char* const value, const std::size_t length) final;
+    inline void AppendValue(const std::string& value)
+    {AppendValue(value.c_str(), value.size());}
+    // only valid for text columns
+    void AppendNull() final;
+
+    inline void EndRow() final
+    {
+        assert(mNextColumnIdx == mColumns.size());
+        mNextColumnIdx = 0;
+        if(++mNumBufferedRows == COLUMNAR_CHUNK_NUM_ROWS)
+            WriteChunk();
+    }
+};
+
+
+// memory maps a table file and decodes it chunk by chunk
+class CColumnarTableReader
+{
+public:
+    struct SColumn
+    {
+        CColumnarTable::EColumnType mType;
+        std::string mName;
+        std::string mSQLType;
+
+        // decoded values of the current chunk. NULL texts are empty
+        std::vector<std::int64_t> mIntegers;
+        std::vector<double> mReals;
+        std::vector<std::string> mTexts;
+    };
+
+private:
+    int mFileDescriptor = -1;
+    const unsigned char* mData = nullptr;
+    std::size_t mDataSize = 0;
+    std::size_t mReadPos = 0;
+
+    std::string mConstraints;
+    std::vector<SColumn> mColumns;
+
+    bool Read(void* const dst, const std::size_t numBytes);
+    bool ReadString(std::string& str);
+
+public:
+    CColumnarTableReader() = default;
+    ~CColumnarTableReader();
+
+    CColumnarTableReader(const CColumnarTableReader&) = delete;
+    CColumnarTableReader& operator=(const CColumnarTableReader&) = delete;
+
+    bool Open(const fs::path& filePath);
+    void Close();
+
+    // decodes the next chunk into the columns. Returns 0 at the end of the file
+    auto ReadChunk() -> std::size_t;
+
+    inline auto GetConstraints() const -> const std::string&
+    {return mConstraints;}
+    inline auto GetColumns() const -> const std::vector<SColumn>&
+    {return mColumns;}
+};
+
+
+class CColumnarOutputBackend : public IOutputBackend
+{
+private:
+    fs::path mDirPath;
+    std::vector<std::unique_ptr<CColumnarTable>> mTables;
+    std::unordered_map<std::string, std::size_t> mTableNameToIdx;
+
+public:
+    CColumnarOutputBackend() = default;
+    ~CColumnarOutputBackend();
+
+    bool Open(const fs::path& dirPath);
+
+    bool CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints) final;
+    auto AddInsertStatement(const std::string& tableName) -> std::size_t final;
+    bool InsertRow(const std::string& tableName, const std::string& row) final;
+
+    auto Insert(const std::size_t insertStatementIdx, IInsertValuesContainer& values) -> std::size_t final;
+
+    void BeginTransaction() final;
+    void EndTransaction() final;
+
+    bool MergeShard(const std::filesystem::path& shardFilePath, const std::vector<std::string>& tableNames) final;
+
+    void Close() final;
+
+    // loads all tables of a columnar output directory into a new sqlite db
+    static bool ConvertToSQLite(const fs::path& dirPath, const fs::path& dbFilePath);
+};
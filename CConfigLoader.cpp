@@ -6,6 +6,292 @@
 #include "json.hpp"
 
 
+
+void SSiteConfig::SetAttribute(const std::string& key, const json& value)
+{
+    if(key == "multiLocationIdx")
+        mMultiLocationIdx = std::make_unique<std::uint32_t>(value.get<std::uint32_t>());
+    else if(key == "name")
+        mName = value.get<std::string>();
+    else if(key == "location")
+        mLocationName = value.get<std::string>();
+    else if(key == "numJobSlots")
+        mNumJobSlots = value.get<std::uint32_t>();
+    else if(key == "price")
+        mStoragePrice = value.get<double>();
+    else if(key == "skuId")
+        mSKUId = value.get<std::string>();
+    else if(key == "storageElements" || key == "buckets")
+    {
+        for(const json& storageElementJson : value)
+            AddStorageElement(storageElementJson);
+    }
+    else
+        std::cout << "Ignoring unknown attribute while loading sites: " << key << std::endl;
+}
+
+void SSiteConfig::AddStorageElement(const json& storageElementJson)
+{
+    std::string storageElementName;
+    for(const auto& [storageElementJsonKey, storageElementJsonValue] : storageElementJson.items())
+    {
+        if(storageElementJsonKey == "name")
+            storageElementName = storageElementJsonValue.get<std::string>();
+        else
+            std::cout << "Ignoring unknown attribute while loading storage elements: " << storageElementJsonKey << std::endl;
+    }
+
+    if (storageElementName.empty())
+    {
+        std::cout << "Couldn't find name attribute of storage element" << std::endl;
+        return;
+    }
+
+    mStorageElementNames.emplace_back(std::move(storageElementName));
+}
+
+
+
+// streams a config file. The entries of "sites" and "regions" lists are converted to
+// SSiteConfig one by one and passed to the consumers. All other values are small and
+// are collected into json objects that are passed to TryConsumeConfig as before
+class CConfigSAXHandler : public nlohmann::json_sax<json>
+{
+private:
+    enum EState : std::uint8_t
+    {
+        eBegin,         // before the root object
+        eRoot,          // inside the root object
+        eRootEntry,     // inside the object of a top level key
+        eSiteList,      // inside a site list of a top level object
+        eSite,          // inside an entry of a site list
+        eEnd
+    };
+
+    CConfigLoader& mLoader;
+    fs::path mDirectory;
+
+    EState mState = eBegin;
+    std::string mRootKey;
+    std::string mKey;
+
+    json mRootEntryJson;
+    std::size_t mNumConsumedSites = 0;
+    SSiteConfig mSiteConfig;
+
+    // values below the typed levels are built here. The stack holds the open containers
+    json mValue;
+    std::vector<json*> mValueStack;
+    std::string mValueKey;
+    bool mIsBuildingValue = false;
+
+    auto AddValue(json&& value) -> json*
+    {
+        if(mValueStack.empty())
+        {
+            mValue = std::move(value);
+            return &mValue;
+        }
+        json& parent = *(mValueStack.back());
+        if(parent.is_array())
+        {
+            parent.push_back(std::move(value));
+            return &(parent.back());
+        }
+        json& child = parent[mValueKey];
+        child = std::move(value);
+        return &child;
+    }
+
+    void OnValueComplete()
+    {
+        mIsBuildingValue = false;
+        if(mState == eRoot)
+        {
+            if(!ConsumeJson({ {mRootKey, mValue} }))
+            {
+                std::cout << "Didnt consume json entry:" << std::endl;
+                std::cout << mValue.dump(JSON_DUMP_SPACES) << std::endl;
+            }
+        }
+        else if(mState == eRootEntry)
+            mRootEntryJson[mKey] = std::move(mValue);
+        else if(mState == eSite)
+            mSiteConfig.SetAttribute(mKey, mValue);
+        else
+            std::cout << "Ignoring non object entry in site list of " << mRootKey << std::endl;
+    }
+
+    bool OnScalar(json&& value)
+    {
+        if(!mIsBuildingValue && (mState == eBegin || mState == eEnd))
+            return false;
+        mIsBuildingValue = true;
+        AddValue(std::move(value));
+        if(mValueStack.empty())
+            OnValueComplete();
+        return true;
+    }
+
+    bool OnStartContainer(json&& container)
+    {
+        if(!mIsBuildingValue)
+        {
+            const bool isObject = container.is_object();
+            if(mState == eBegin && isObject)
+            {
+                mState = eRoot;
+                return true;
+            }
+            else if(mState == eRoot && isObject)
+            {
+                mState = eRootEntry;
+                mRootEntryJson = json::object();
+                mNumConsumedSites = 0;
+                return true;
+            }
+            else if(mState == eRootEntry && !isObject && (mKey == "sites" || mKey == "regions"))
+            {
+                mState = eSiteList;
+                return true;
+            }
+            else if(mState == eSiteList && isObject)
+            {
+                mState = eSite;
+                mSiteConfig = SSiteConfig();
+                return true;
+            }
+            else if(mState == eBegin || mState == eEnd)
+                return false;
+            mIsBuildingValue = true;
+        }
+        mValueStack.push_back(AddValue(std::move(container)));
+        return true;
+    }
+
+    bool OnEndContainer()
+    {
+        if(mIsBuildingValue)
+        {
+            mValueStack.pop_back();
+            if(mValueStack.empty())
+                OnValueComplete();
+            return true;
+        }
+
+        if(mState == eSite)
+        {
+            mState = eSiteList;
+            bool wasConsumed = false;
+            for(IConfigConsumer* consumer : mLoader.mConfigConsumer)
+                wasConsumed = wasConsumed || consumer->TryConsumeSiteConfig(mRootKey, mSiteConfig);
+            if(wasConsumed)
+                ++mNumConsumedSites;
+            else
+                std::cout << "Didnt consume site config of " << mRootKey << ": " << mSiteConfig.mName << std::endl;
+        }
+        else if(mState == eSiteList)
+            mState = eRootEntry;
+        else if(mState == eRootEntry)
+        {
+            mState = eRoot;
+            OnRootEntryComplete();
+        }
+        else if(mState == eRoot)
+            mState = eEnd;
+        return true;
+    }
+
+    void OnRootEntryComplete()
+    {
+        auto resultIt = mRootEntryJson.find(JSON_FILE_IMPORT_KEY);
+        if(resultIt != mRootEntryJson.end())
+        {
+            if(!resultIt.value().is_string())
+            {
+                std::cout << "Expected value of _file_ field to be of type string. Ignoring entry:" << std::endl;
+                std::cout << resultIt->dump(JSON_DUMP_SPACES) << std::endl;
+                return;
+            }
+            if(!mLoader.TryLoadConfig(mDirectory / resultIt.value().get<std::string>()))
+            {
+                std::cout << "Didnt consume json entry:" << std::endl;
+                std::cout << mRootEntryJson.dump(JSON_DUMP_SPACES) << std::endl;
+            }
+        }
+        else if(!mRootEntryJson.empty() || mNumConsumedSites == 0)
+        {
+            if(!ConsumeJson({ {mRootKey, std::move(mRootEntryJson)} }) && mNumConsumedSites == 0)
+                std::cout << "Didnt consume json entry: " << mRootKey << std::endl;
+        }
+    }
+
+    bool ConsumeJson(const json& consumableJson)
+    {
+        bool wasConsumed = false;
+        for(IConfigConsumer* consumer : mLoader.mConfigConsumer)
+            wasConsumed = wasConsumed || consumer->TryConsumeConfig(consumableJson);
+        if(wasConsumed)
+            mLoader.mConsumedConfigs.push_back(consumableJson.dump());
+        return wasConsumed;
+    }
+
+public:
+    CConfigSAXHandler(CConfigLoader& loader, const fs::path& directory)
+        : mLoader(loader),
+          mDirectory(directory)
+    {}
+
+    bool null() final
+    {return OnScalar(nullptr);}
+    bool boolean(bool val) final
+    {return OnScalar(val);}
+    bool number_integer(number_integer_t val) final
+    {return OnScalar(val);}
+    bool number_unsigned(number_unsigned_t val) final
+    {return OnScalar(val);}
+    bool number_float(number_float_t val, const string_t& s) final
+    {
+        (void)s;
+        return OnScalar(val);
+    }
+    bool string(string_t& val) final
+    {return OnScalar(std::move(val));}
+
+    bool start_object(std::size_t elements) final
+    {
+        (void)elements;
+        return OnStartContainer(json::object());
+    }
+    bool key(string_t& val) final
+    {
+        if(mIsBuildingValue)
+            mValueKey = std::move(val);
+        else if(mState == eRoot)
+            mRootKey = std::move(val);
+        else
+            mKey = std::move(val);
+        return true;
+    }
+    bool end_object() final
+    {return OnEndContainer();}
+
+    bool start_array(std::size_t elements) final
+    {
+        (void)elements;
+        return OnStartContainer(json::array());
+    }
+    bool end_array() final
+    {return OnEndContainer();}
+
+    bool parse_error(std::size_t position, const std::string& lastToken, const nlohmann::detail::exception& ex) final
+    {
+        std::cout << "Unable to parse config at byte " << position << " (" << lastToken << "): " << ex.what() << std::endl;
+        return false;
+    }
+};
+
+
 auto CConfigLoader::GetRef() -> CConfigLoader&
 {
     static CConfigLoader mInstance;
@@ -59,20 +345,22 @@ bool CConfigLoader::TryLoadConfig(const fs::path& path)
         return false;
     }
 
-    json jsonRoot;
-
+    std::ifstream configFile(path);
+    if(!configFile)
     {
-        std::ifstream configFile(path);
-        if(!configFile)
-        {
-            std::cout << "Unable to load config: " << path << std::endl;
-            return false;
-        }
-        configFile >> jsonRoot;
+        std::cout << "Unable to load config: " << path << std::endl;
+        return false;
     }
 
-    mCurrentDirectory = path;
-    mCurrentDirectory.remove_filename();
+    if(mConfigConsumer.empty())
+        std::cout << "No config consumers registered" << std::endl;
+
+    fs::path directory = path;
+    directory.remove_filename();
 
-    return TryLoadConfig(jsonRoot);
+    // imported files are streamed recursively by the handler, which changes mCurrentDirectory
+    CConfigSAXHandler handler(*this, directory);
+    const bool ok = json::sax_parse(configFile, &handler);
+    mCurrentDirectory = directory;
+    return ok;
 }
@@ -20,6 +20,10 @@ private:
 
 public:
     std::unordered_set<std::string> mLoadedFiles;
+
+    // dumps of the consumed config entries that are not site lists, e.g. prices.
+    // The topology cache stores them to pass them to the consumers again
+    std::vector<std::string> mConsumedConfigs;
     std::vector<IConfigConsumer*> mConfigConsumer;
 
 public:
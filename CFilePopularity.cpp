@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "CFilePopularity.hpp"
+#include "SFile.hpp"
+
+
+
+// see: W. Hormann, G. Derflinger, "Rejection-inversion to generate variates
+// from monotone discrete distributions", ACM TOMACS 6 (1996)
+static double Helper1(const double x)
+{
+    if(std::abs(x) > 1e-8)
+        return std::log1p(x) / x;
+    return 1 - x * (0.5 - x * (1.0/3.0 - 0.25 * x));
+}
+
+static double Helper2(const double x)
+{
+    if(std::abs(x) > 1e-8)
+        return std::expm1(x) / x;
+    return 1 + x * 0.5 * (1 + x * (1.0/3.0) * (1 + 0.25 * x));
+}
+
+CZipfFilePopularity::CZipfFilePopularity(const double exponent)
+    : mExponent(exponent)
+{
+    assert(exponent > 0);
+    mHIntegralX1 = HIntegral(1.5) - 1;
+    mS = 2 - HIntegralInverse(HIntegral(2.5) - H(2));
+    mRankedFiles.reserve(150000);
+}
+
+double CZipfFilePopularity::H(const double x) const
+{
+    return std::exp(-mExponent * std::log(x));
+}
+
+double CZipfFilePopularity::HIntegral(const double x) const
+{
+    const double logX = std::log(x);
+    return Helper2((1 - mExponent) * logX) * logX;
+}
+
+double CZipfFilePopularity::HIntegralInverse(const double x) const
+{
+    double t = x * (1 - mExponent);
+    if(t < -1)
+        t = -1;
+    return std::exp(Helper1(t) * x);
+}
+
+void CZipfFilePopularity::RemoveFreeRank(const std::size_t rank)
+{
+    const std::size_t freeRankIdx = mFreeRankIdxs[rank];
+    assert(freeRankIdx < mFreeRanks.size() && mFreeRanks[freeRankIdx] == rank);
+    const std::size_t lastFreeRank = mFreeRanks.back();
+    mFreeRanks[freeRankIdx] = lastFreeRank;
+    mFreeRankIdxs[lastFreeRank] = freeRankIdx;
+    mFreeRanks.pop_back();
+}
+
+void CZipfFilePopularity::CompactRanks()
+{
+    std::size_t numUsedRanks = 0;
+    for(std::size_t rank = 0; rank < mRankedFiles.size(); ++rank)
+    {
+        SFile* const file = mRankedFiles[rank];
+        if(file == nullptr)
+            continue;
+        file->mPopularityRank = numUsedRanks;
+        mRankedFiles[numUsedRanks++] = file;
+    }
+    assert(numUsedRanks == mNumFiles);
+    mRankedFiles.resize(numUsedRanks);
+    mFreeRanks.clear();
+    mFreeRankIdxs.assign(numUsedRanks, 0);
+}
+
+void CZipfFilePopularity::AddFile(SFile* const file, RNGEngineType& rngEngine)
+{
+    std::size_t rank;
+    if(!mFreeRanks.empty())
+    {
+        std::uniform_int_distribution<std::size_t> freeRankRNG(0, mFreeRanks.size() - 1);
+        rank = mFreeRanks[freeRankRNG(rngEngine)];
+        RemoveFreeRank(rank);
+        mRankedFiles[rank] = file;
+    }
+    else
+    {
+        rank = mRankedFiles.size();
+        mRankedFiles.push_back(file);
+        mFreeRankIdxs.push_back(0);
+    }
+    file->mPopularityRank = rank;
+    mNumFiles += 1;
+}
+
+void CZipfFilePopularity::RemoveFiles(std::vector<std::size_t>& ranks)
+{
+    for(const std::size_t rank : ranks)
+    {
+        assert(rank < mRankedFiles.size() && mRankedFiles[rank] != nullptr);
+        mRankedFiles[rank] = nullptr;
+        mFreeRankIdxs[rank] = mFreeRanks.size();
+        mFreeRanks.push_back(rank);
+    }
+    mNumFiles -= ranks.size();
+    ranks.clear();
+
+    // free slots at the end are dropped, so the sampled range only covers the highest used rank
+    while(!mRankedFiles.empty() && mRankedFiles.back() == nullptr)
+    {
+        RemoveFreeRank(mRankedFiles.size() - 1);
+        mRankedFiles.pop_back();
+        mFreeRankIdxs.pop_back();
+    }
+}
+
+auto CZipfFilePopularity::SampleFile(RNGEngineType& rngEngine) -> SFile*
+{
+    if(mNumFiles == 0)
+        return nullptr;
+
+    // the distribution covers all slots, samples of free slots are rejected
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::size_t numFreeSlotRejections = 0;
+    while(true)
+    {
+        const std::size_t numFiles = mRankedFiles.size();
+        if(numFiles != mNumFilesOfHIntegral)
+        {
+            mHIntegralNumFiles = HIntegral(numFiles + 0.5);
+            mNumFilesOfHIntegral = numFiles;
+        }
+
+        const double u = mHIntegralNumFiles + uniform(rngEngine) * (mHIntegralX1 - mHIntegralNumFiles);
+        const double x = HIntegralInverse(u);
+        const std::size_t k = static_cast<std::size_t>(std::clamp(x + 0.5, 1.0, static_cast<double>(numFiles)));
+        if((k - x) > mS && u < (HIntegral(k + 0.5) - H(k)))
+            continue;
+        if(mRankedFiles[k - 1] != nullptr)
+            return mRankedFiles[k - 1];
+
+        // the free slots hold much of the probability mass. After compacting, there are none left
+        numFreeSlotRejections += 1;
+        if(numFreeSlotRejections >= ZIPF_MAX_FREE_SLOT_REJECTIONS)
+            CompactRanks();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "constants.h"
+
+// number of sampled free rank slots after which the ranks are compacted
+#define ZIPF_MAX_FREE_SLOT_REJECTIONS (16)
+
+struct SFile;
+
+
+
+// Orders files by popularity rank and samples them zipf distributed.
+// Removed files leave free rank slots that are handed to new files, so insertions and
+// removals are O(1) and do not renumber other files. Sampling uses rejection-inversion
+// over all slots and rejects free slots, so no tables have to be rebuilt when the file
+// set changes. If free slots are sampled too often, the used ranks are compacted in
+// their order, which bounds the number of rejections independent of the free slots.
+class CZipfFilePopularity
+{
+private:
+    double mExponent;
+
+    // idx is the popularity rank of the file (0 = most popular). Free slots are nullptr
+    std::vector<SFile*> mRankedFiles;
+    std::size_t mNumFiles = 0;
+
+    // free slots below the highest used rank and the position of each slot in that list
+    std::vector<std::size_t> mFreeRanks;
+    std::vector<std::size_t> mFreeRankIdxs;
+
+    void RemoveFreeRank(const std::size_t rank);
+
+    // moves all files to the lowest ranks without changing their order and drops all free slots
+    void CompactRanks();
+
+    // rejection-inversion parameters; only mHIntegralNumFiles depends on the number of files
+    double mHIntegralX1;
+    double mHIntegralNumFiles = 0;
+    double mS;
+    std::size_t mNumFilesOfHIntegral = 0;
+
+    double H(const double x) const;
+    double HIntegral(const double x) const;
+    double HIntegralInverse(const double x) const;
+
+public:
+    CZipfFilePopularity(const double exponent);
+
+    // assigns a random free rank to the file or appends it after the lowest rank if there is none
+    void AddFile(SFile* const file, RNGEngineType& rngEngine);
+
+    // frees the ranks of removed files. The files are not accessed, the ranks are consumed
+    void RemoveFiles(std::vector<std::size_t>& ranks);
+
+    // may compact the ranks, so collected ranks must be removed before the next sample
+    auto SampleFile(RNGEngineType& rngEngine) -> SFile*;
+
+    inline auto GetNumFiles() const -> std::size_t
+    {return mNumFiles;}
+};
@@ -0,0 +1,38 @@
+#include "IBaseCloud.hpp"
+
+#include "CLazyLinkRules.hpp"
+#include "CLinkSelector.hpp"
+#include "COutput.hpp"
+#include "COutputTables.hpp"
+
+
+
+CLazyLinkRules::CLazyLinkRules(std::vector<IBaseCloud*>&& clouds)
+    : mClouds(std::move(clouds))
+{}
+
+auto CLazyLinkRules::CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector*
+{
+    for(IBaseCloud* cloud : mClouds)
+    {
+        CLinkSelector* linkSelector = cloud->CreateLinkSelector(srcSite, dstSite);
+        if(linkSelector == nullptr)
+            continue;
+
+        auto linkSelectorInserts = CTypedInsertStatements<tables::CLinkSelectorsTable>::Acquire(1);
+        linkSelectorInserts->AddRow(linkSelector->GetId(), linkSelector->GetSrcSiteId(), linkSelector->GetDstSiteId());
+        COutput::GetRef().QueueInserts(std::move(linkSelectorInserts));
+
+        mNumCreatedLinks += 1;
+        return linkSelector;
+    }
+    return nullptr;
+}
+
+bool CLazyLinkRules::GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const
+{
+    for(const IBaseCloud* cloud : mClouds)
+        if(cloud->GetLinkWeight(srcSite, dstSite, weight))
+            return true;
+    return false;
+}
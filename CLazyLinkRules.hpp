@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ISite.hpp"
+
+class IBaseCloud;
+
+
+
+// creates links on their first use with the rules of the clouds and adds them to the output.
+// Memory, setup time and output then only depend on the number of used links
+class CLazyLinkRules : public ILinkRules
+{
+private:
+    std::vector<IBaseCloud*> mClouds;
+
+    std::uint64_t mNumCreatedLinks = 0;
+
+public:
+    CLazyLinkRules(std::vector<IBaseCloud*>&& clouds);
+
+    auto CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector* final;
+    bool GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const final;
+
+    inline auto GetNumCreatedLinks() const -> std::uint64_t
+    {return mNumCreatedLinks;}
+};
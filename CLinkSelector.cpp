@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 
 #include "ISite.hpp"
@@ -5,10 +6,43 @@
 
 
 
-CLinkSelector::CLinkSelector(const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite)
+CNetworkPriceTable::CNetworkPriceTable(const std::vector<std::pair<std::uint64_t, double>>& tiers)
+{
+    assert(!tiers.empty());
+    std::uint64_t lowerThreshold = 0;
+    double baseCosts = 0;
+    for(const auto& [threshold, price] : tiers)
+    {
+        assert(threshold >= lowerThreshold);
+        mThresholds.push_back(threshold);
+        mLowerThresholds.push_back(lowerThreshold);
+        mPrices.push_back(price);
+        mBaseCosts.push_back(baseCosts);
+        baseCosts += BYTES_TO_GiB(threshold - lowerThreshold) * price;
+        lowerThreshold = threshold;
+    }
+}
+
+auto CNetworkPriceTable::GetFreeTable() -> const std::shared_ptr<const CNetworkPriceTable>&
+{
+    static const std::shared_ptr<const CNetworkPriceTable> freeTable = std::make_shared<const CNetworkPriceTable>(std::vector<std::pair<std::uint64_t, double>>{{0, 0}});
+    return freeTable;
+}
+
+auto CNetworkPriceTable::GetTierIdx(const std::uint64_t traffic) const -> std::size_t
+{
+    // the last tier has no upper limit
+    const auto lastTierIt = mThresholds.cend() - 1;
+    return std::lower_bound(mThresholds.cbegin(), lastTierIt, traffic) - mThresholds.cbegin();
+}
+
+
+
+CLinkSelector::CLinkSelector(const std::uint32_t linkIdx, const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite)
 	: mId(GetNewId()),
       mSrcSite(srcSite),
       mDstSite(dstSite),
+      mLinkIdx(linkIdx),
       mBandwidth(bandwidth)
 {}
 
@@ -20,3 +54,39 @@ auto CLinkSelector::GetSrcSiteId() const -> IdType
 {return mSrcSite->GetId();}
 auto CLinkSelector::GetDstSiteId() const -> IdType
 {return mDstSite->GetId();}
+
+void CLinkSelector::SetNetworkPrice(const std::shared_ptr<const CNetworkPriceTable>& networkPrice)
+{
+    if(mIsPriced && networkPrice->GetLastPrice() != GetWeight())
+        ++(mDstSite->mInLinkWeightVersion);
+    mNetworkPrice = networkPrice;
+    mNetworkPriceTierIdx = mNetworkPrice->GetTierIdx(mUsedTraffic);
+    mIsPriced = true;
+    ISite::mLinkTable.SetWeight(mLinkIdx, GetWeight());
+}
+
+auto CLinkSelector::ResetNetworkCosts() -> double
+{
+    const double networkCosts = mNetworkCosts;
+    mNetworkCosts = 0;
+    mNetworkPriceTierIdx = 0;
+    mUsedTraffic = 0;
+    return networkCosts;
+}
+
+
+
+auto CLinkTable::CreateLinkSelector(const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite) -> CLinkSelector*
+{
+    constexpr std::size_t chunkSize = 1 << LINK_TABLE_CHUNK_SIZE_LOG2;
+    assert(mWeights.size() < NO_LINK_IDX);
+    if(mChunks.empty() || mChunks.back().size() == chunkSize)
+    {
+        mChunks.emplace_back();
+        mChunks.back().reserve(chunkSize);
+    }
+    const std::uint32_t linkIdx = static_cast<std::uint32_t>(mWeights.size());
+    mChunks.back().emplace_back(linkIdx, bandwidth, srcSite, dstSite);
+    mWeights.push_back(mChunks.back().back().GetWeight());
+    return &(mChunks.back().back());
+}
@@ -1,12 +1,67 @@
 #pragma once
 
+#include <cassert>
+#include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "constants.h"
 
+// the link table allocates the links in chunks of 2^LINK_TABLE_CHUNK_SIZE_LOG2 links
+#define LINK_TABLE_CHUNK_SIZE_LOG2 (10)
+
 class ISite;
 
+
+
+// immutable tiered network price shared by all links with the same price.
+// The tiers are given as (cumulative traffic threshold in bytes, price per GiB). Traffic up to the threshold
+// of a tier is charged with its price, traffic beyond the last threshold with the price of the last tier
+class CNetworkPriceTable
+{
+private:
+    std::vector<std::uint64_t> mThresholds;
+    std::vector<std::uint64_t> mLowerThresholds;
+    std::vector<double> mPrices;
+
+    // costs of the complete traffic of all lower tiers
+    std::vector<double> mBaseCosts;
+
+public:
+    CNetworkPriceTable(const std::vector<std::pair<std::uint64_t, double>>& tiers);
+
+    // shared table of links without costs
+    static auto GetFreeTable() -> const std::shared_ptr<const CNetworkPriceTable>&;
+
+    auto GetTierIdx(const std::uint64_t traffic) const -> std::size_t;
+
+    inline auto CalculateCosts(const std::uint64_t traffic) const -> double
+    {
+        const std::size_t tierIdx = GetTierIdx(traffic);
+        return mBaseCosts[tierIdx] + (BYTES_TO_GiB(traffic - mLowerThresholds[tierIdx]) * mPrices[tierIdx]);
+    }
+
+    // costs of the traffic between fromTraffic and toTraffic. tierIdx must be the tier of fromTraffic
+    // and is advanced to the tier of toTraffic, so accruing the costs of increasing traffic is amortised O(1)
+    inline auto AccrueCosts(std::uint64_t fromTraffic, const std::uint64_t toTraffic, std::size_t& tierIdx) const -> double
+    {
+        assert(fromTraffic <= toTraffic);
+        double costs = 0;
+        const std::size_t lastTierIdx = mPrices.size() - 1;
+        while(tierIdx < lastTierIdx && toTraffic > mThresholds[tierIdx])
+        {
+            costs += BYTES_TO_GiB(mThresholds[tierIdx] - fromTraffic) * mPrices[tierIdx];
+            fromTraffic = mThresholds[tierIdx];
+            ++tierIdx;
+        }
+        return costs + (BYTES_TO_GiB(toTraffic - fromTraffic) * mPrices[tierIdx]);
+    }
+
+    inline auto GetLastPrice() const -> double
+    {return mPrices.back();}
+};
+
 class CLinkSelector
 {
 private:
@@ -15,6 +70,9 @@ private:
     ISite* mSrcSite;
     ISite* mDstSite;
 
+    // idx of the link in the link table
+    std::uint32_t mLinkIdx;
+
 public:
     std::uint32_t mDoneTransfers = 0;
     std::uint32_t mFailedTransfers = 0;
@@ -22,20 +80,69 @@ public:
 public:
 	typedef std::vector<std::pair<std::uint64_t, double>> PriceInfoType;
 
-	CLinkSelector(const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite);
+	CLinkSelector(const std::uint32_t linkIdx, const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite);
 
     inline auto GetId() const -> IdType
     {return mId;}
+    inline auto GetLinkIdx() const -> std::uint32_t
+    {return mLinkIdx;}
     auto GetSrcSite() const -> ISite*;
     auto GetDstSite() const -> ISite*;
     auto GetSrcSiteId() const -> IdType;
     auto GetDstSiteId() const -> IdType;
 
     inline auto GetWeight() const -> double
-    { return mNetworkPrice.back().second; }
+    { return mNetworkPrice->GetLastPrice(); }
+
+    // the first price is set before the link is handed out, so only later price changes
+    // increment the weight version of the dst site
+    void SetNetworkPrice(const std::shared_ptr<const CNetworkPriceTable>& networkPrice);
+
+    inline void AddTraffic(const std::uint64_t amount)
+    {
+        const std::uint64_t usedTraffic = mUsedTraffic + amount;
+        mNetworkCosts += mNetworkPrice->AccrueCosts(mUsedTraffic, usedTraffic, mNetworkPriceTierIdx);
+        mUsedTraffic = usedTraffic;
+    }
+
+    // returns the costs accrued since the last call and resets the traffic
+    auto ResetNetworkCosts() -> double;
 
-    PriceInfoType mNetworkPrice = {{0,0}};
+    std::shared_ptr<const CNetworkPriceTable> mNetworkPrice = CNetworkPriceTable::GetFreeTable();
+    std::size_t mNetworkPriceTierIdx = 0;
+    bool mIsPriced = false;
+    double mNetworkCosts = 0;
     std::uint64_t mUsedTraffic = 0;
     std::uint32_t mNumActiveTransfers = 0;
     std::uint32_t mBandwidth;
 };
+
+// owns all links of the topology. The links are allocated in chunks, so they keep their address
+// and links that are created one after another are next to each other. The weights that the source
+// selection reads for every candidate replica are kept in one contiguous array indexed by the link idx,
+// so the link rows of the sites only store link idxs and a weight lookup does not touch the link
+class CLinkTable
+{
+private:
+    std::vector<std::vector<CLinkSelector>> mChunks;
+    std::vector<double> mWeights;
+
+public:
+    static constexpr std::uint32_t NO_LINK_IDX = std::numeric_limits<std::uint32_t>::max();
+
+    auto CreateLinkSelector(const std::uint32_t bandwidth, ISite* srcSite, ISite* dstSite) -> CLinkSelector*;
+
+    inline auto GetLinkSelector(const std::uint32_t linkIdx) -> CLinkSelector*
+    {
+        assert(linkIdx < mWeights.size());
+        return &(mChunks[linkIdx >> LINK_TABLE_CHUNK_SIZE_LOG2][linkIdx & ((1 << LINK_TABLE_CHUNK_SIZE_LOG2) - 1)]);
+    }
+
+    inline auto GetWeight(const std::uint32_t linkIdx) const -> double
+    {return mWeights[linkIdx];}
+    inline void SetWeight(const std::uint32_t linkIdx, const double weight)
+    {mWeights[linkIdx] = weight;}
+
+    inline auto GetNumLinks() const -> std::size_t
+    {return mWeights.size();}
+};
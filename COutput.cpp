@@ -1,318 +1,520 @@
 #include <cassert>
 #include <chrono>
-#include <fstream>
-#include <iomanip>
-#include <sstream>
+#include <cstring>
+#include <iostream>
+#include <limits>
 
-#include "constants.h"
 #include "COutput.hpp"
-#include "sqlite3.h"
 
 
 
-class CBindableDoubleValue : public IBindableValue
+CInsertStatements::CInsertStatements(std::size_t preparedStatementIdx, std::size_t numReserve)
+    : mPreparedStatementIdx(preparedStatementIdx)
 {
-private:
-    double mValue;
+    if(numReserve>0)
+        mValues.reserve(numReserve * (1 + sizeof(std::uint64_t)));
+}
 
-public:
-    CBindableDoubleValue(double val)
-        : mValue(val)
-    {}
+template<typename T>
+void CInsertStatements::AppendValue(const EValueType type, const T& value)
+{
+    const std::size_t offset = mValues.size();
+    mValues.resize(offset + 1 + sizeof(T));
+    mValues[offset] = type;
+    std::memcpy(mValues.data() + offset + 1, &value, sizeof(T));
+    mNumValues += 1;
+}
 
-    bool Bind(sqlite3_stmt* const stmt, int idx) final
-    {
-        return sqlite3_bind_double(stmt, idx, mValue) == SQLITE_OK;
-    }
-};
+void CInsertStatements::AddValue(double value)
+{
+    AppendValue(eDouble, value);
+}
 
-class CBindableIntValue : public IBindableValue
+void CInsertStatements::AddValue(int value)
 {
-private:
-    int mValue;
+    AppendValue(eInt, value);
+}
 
-public:
-    CBindableIntValue(int val)
-        : mValue(val)
-    {}
+void CInsertStatements::AddValue(std::uint32_t value)
+{
+    AppendValue(eInt64, static_cast<std::uint64_t>(value));
+}
 
-    bool Bind(sqlite3_stmt* const stmt, int idx) final
-    {
-        return sqlite3_bind_int(stmt, idx, mValue) == SQLITE_OK;
-    }
-};
+void CInsertStatements::AddValue(std::uint64_t value)
+{
+    AppendValue(eInt64, value);
+}
 
-class CBindableInt64Value : public IBindableValue
+void CInsertStatements::AddValue(const std::string& value)
 {
-private:
-    uint64_t mValue;
+    if(value.empty())
+    {
+        mValues.push_back(eNull);
+        mNumValues += 1;
+        return;
+    }
 
-public:
-    CBindableInt64Value(std::uint64_t val)
-        : mValue(val)
-    {}
+    const std::uint32_t length = static_cast<std::uint32_t>(value.size());
+    AppendValue(eString, length);
+    mValues.insert(mValues.end(), value.cbegin(), value.cend());
+}
 
-    bool Bind(sqlite3_stmt* const stmt, int idx) final
+auto CInsertStatements::BindValue(sqlite3_stmt* const stmt, const int idx, const unsigned char* value) -> const unsigned char*
+{
+    const EValueType type = static_cast<EValueType>(*value);
+    value += 1;
+    switch(type)
+    {
+    case eNull:
+        sqlite3_bind_null(stmt, idx);
+        break;
+    case eDouble:
+    {
+        double doubleValue;
+        std::memcpy(&doubleValue, value, sizeof(doubleValue));
+        value += sizeof(doubleValue);
+        sqlite3_bind_double(stmt, idx, doubleValue);
+        break;
+    }
+    case eInt:
+    {
+        int intValue;
+        std::memcpy(&intValue, value, sizeof(intValue));
+        value += sizeof(intValue);
+        sqlite3_bind_int(stmt, idx, intValue);
+        break;
+    }
+    case eInt64:
+    {
+        std::uint64_t int64Value;
+        std::memcpy(&int64Value, value, sizeof(int64Value));
+        value += sizeof(int64Value);
+        sqlite3_bind_int64(stmt, idx, int64Value);
+        break;
+    }
+    case eString:
     {
-        return sqlite3_bind_int64(stmt, idx, mValue) == SQLITE_OK;
+        std::uint32_t length;
+        std::memcpy(&length, value, sizeof(length));
+        value += sizeof(length);
+        // the arena outlives the step, so sqlite does not need a copy
+        sqlite3_bind_text(stmt, idx, reinterpret_cast<const char*>(value), length, SQLITE_STATIC);
+        value += length;
+        break;
+    }
     }
-};
+    return value;
+}
 
-class CBindableStringValue : public IBindableValue
+std::size_t CInsertStatements::BindAndInsert(const SPreparedInsert& preparedInsert)
 {
-private:
-    std::string mValue;
+    if(mValues.empty())
+        return 0;
 
-public:
-    CBindableStringValue(const std::string& val)
-        : mValue(val)
-    {}
+    const std::size_t numToBindPerRow = static_cast<std::size_t>(sqlite3_bind_parameter_count(preparedInsert.mStatement));
+    assert(numToBindPerRow > 0);
+    assert((mNumValues % numToBindPerRow) == 0);
 
-    CBindableStringValue(std::string&& val)
-        : mValue(std::move(val))
-    {}
+    const std::size_t numRows = mNumValues / numToBindPerRow;
+    const unsigned char* curValue = mValues.data();
+    std::size_t numBound = 0;
+    std::size_t numInserted = 0;
 
-    bool Bind(sqlite3_stmt* const stmt, int idx) final
+    sqlite3_stmt* const multiRowStmt = preparedInsert.mMultiRowStatement;
+    const std::size_t numRowsPerMultiRowStmt = preparedInsert.mNumRowsPerMultiRowStatement;
+    if(multiRowStmt != nullptr)
     {
-        if(mValue.empty())
-            return sqlite3_bind_null(stmt, idx) == SQLITE_OK;
-        else
-            return sqlite3_bind_text(stmt, idx, mValue.c_str(), mValue.size(), SQLITE_TRANSIENT) == SQLITE_OK;
+        const int numToBind = static_cast<int>(numRowsPerMultiRowStmt * numToBindPerRow);
+        for(; (numBound + numRowsPerMultiRowStmt) <= numRows; numBound += numRowsPerMultiRowStmt)
+        {
+            for(int numBinded=1; numBinded<=numToBind; ++numBinded)
+                curValue = BindValue(multiRowStmt, numBinded, curValue);
+            if(SPreparedInsert::Step(multiRowStmt, numRowsPerMultiRowStmt))
+                numInserted += numRowsPerMultiRowStmt;
+        }
     }
-};
 
-CInsertStatements::CInsertStatements(std::size_t preparedStatementIdx, std::size_t numReserve)
-    : mPreparedStatementIdx(preparedStatementIdx)
+    sqlite3_stmt* const stmt = preparedInsert.mStatement;
+    for(; numBound < numRows; ++numBound)
+    {
+        for(int numBinded=1; numBinded<=static_cast<int>(numToBindPerRow); ++numBinded)
+            curValue = BindValue(stmt, numBinded, curValue);
+        if(SPreparedInsert::Step(stmt, 1))
+            ++numInserted;
+    }
+    assert(curValue == (mValues.data() + mValues.size()));
+
+    mValues.clear();
+    mNumValues = 0;
+    return numInserted;
+}
+
+auto CInsertStatements::WriteRows(IRowWriter& writer) -> std::size_t
 {
-    if(numReserve>0)
-        mValues.reserve(numReserve);
+    if(mValues.empty())
+        return 0;
+
+    const std::size_t numColumns = writer.GetNumColumns();
+    assert(numColumns > 0);
+    assert((mNumValues % numColumns) == 0);
+
+    const unsigned char* curValue = mValues.data();
+    const unsigned char* const endValue = curValue + mValues.size();
+    std::size_t numAppended = 0;
+    while(curValue < endValue)
+    {
+        const EValueType type = static_cast<EValueType>(*curValue);
+        curValue += 1;
+        switch(type)
+        {
+        case eNull:
+            // only empty strings are stored as NULL
+            writer.AppendNull();
+            break;
+        case eDouble:
+        {
+            double doubleValue;
+            std::memcpy(&doubleValue, curValue, sizeof(doubleValue));
+            curValue += sizeof(doubleValue);
+            writer.AppendValue(doubleValue);
+            break;
+        }
+        case eInt:
+        {
+            int intValue;
+            std::memcpy(&intValue, curValue, sizeof(intValue));
+            curValue += sizeof(intValue);
+            writer.AppendValue(intValue);
+            break;
+        }
+        case eInt64:
+        {
+            std::uint64_t int64Value;
+            std::memcpy(&int64Value, curValue, sizeof(int64Value));
+            curValue += sizeof(int64Value);
+            writer.AppendValue(int64Value);
+            break;
+        }
+        case eString:
+        {
+            std::uint32_t length;
+            std::memcpy(&length, curValue, sizeof(length));
+            curValue += sizeof(length);
+            writer.AppendValue(reinterpret_cast<const char*>(curValue), length);
+            curValue += length;
+            break;
+        }
+        }
+
+        numAppended += 1;
+        if((numAppended % numColumns) == 0)
+            writer.EndRow();
+    }
+    assert(curValue == endValue);
+
+    mValues.clear();
+    mNumValues = 0;
+    return numAppended / numColumns;
 }
 
-void CInsertStatements::AddValue(double value)
+
+COutputShard::COutputShard(const std::string& name, std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath)
+    : mName(name),
+      mBackend(std::move(backend)),
+      mFilePath(filePath)
+{}
+
+COutputShard::~COutputShard()
 {
-    mValues.emplace_back(new CBindableDoubleValue(value));
+    Close();
 }
 
-void CInsertStatements::AddValue(int value)
+bool COutputShard::StartConsumer(const std::size_t transactionSize)
 {
-    mValues.emplace_back(new CBindableIntValue(value));
+    if(mConsumerThread.joinable())
+        return false;
+
+    mTransactionSize = transactionSize;
+    mIsConsumerRunning = true;
+    mConsumerThread = std::thread(&COutputShard::ConsumerThread, this);
+
+    return true;
 }
 
-void CInsertStatements::AddValue(std::uint32_t value)
+void COutputShard::StopConsumer()
 {
-    mValues.emplace_back(new CBindableInt64Value(value));
+    mIsConsumerRunning = false;
+    mInsertQueue.NotifyConsumers();
+    if(mConsumerThread.joinable())
+        mConsumerThread.join();
 }
 
-void CInsertStatements::AddValue(std::uint64_t value)
+void COutputShard::Close()
 {
-    mValues.emplace_back(new CBindableInt64Value(value));
+    StopConsumer();
+    if(mBackend != nullptr)
+    {
+        mBackend->Close();
+        mBackend.reset();
+    }
 }
 
-void CInsertStatements::AddValue(const std::string& value)
+void COutputShard::SetInsertStatementIdx(const std::size_t outputInsertStatementIdx, const std::size_t backendInsertStatementIdx)
 {
-    mValues.emplace_back(new CBindableStringValue(value));
+    if(mInsertStatementIdxs.size() <= outputInsertStatementIdx)
+        mInsertStatementIdxs.resize(outputInsertStatementIdx + 1, std::numeric_limits<std::size_t>::max());
+    mInsertStatementIdxs[outputInsertStatementIdx] = backendInsertStatementIdx;
 }
 
-void CInsertStatements::AddValue(std::string&& value)
+void COutputShard::QueueInserts(std::unique_ptr<IInsertValuesContainer>&& statements)
 {
-    mValues.emplace_back(new CBindableStringValue(std::move(value)));
+    assert(mIsConsumerRunning || mInsertQueue.GetDepth() < mInsertQueue.GetCapacity());
+    mInsertQueue.Push(std::move(statements));
 }
 
-std::size_t CInsertStatements::BindAndInsert(sqlite3_stmt* const stmt)
+void COutputShard::ConsumerThread()
 {
-    if(mValues.empty())
-        return 0;
+    typedef std::chrono::high_resolution_clock ClockType;
 
-    const std::size_t numToBindPerRow = static_cast<std::size_t>(sqlite3_bind_parameter_count(stmt));
-    assert(numToBindPerRow > 0);
-    assert((mValues.size() % numToBindPerRow) == 0);
+    // the tuned transaction size keeps the commit duration between these fractions of the insert duration
+    constexpr double minCommitOverhead = 0.01;
+    constexpr double maxCommitOverhead = 0.05;
+    constexpr std::size_t minTransactionSize = 1000;
+    constexpr std::size_t maxTransactionSize = 1 << 22;
 
-    auto curValsIt = mValues.begin();
-    std::size_t numInserted = 0;
-    while(curValsIt != mValues.end())
+    std::size_t transactionSize = (mTransactionSize > 0) ? mTransactionSize : 25000;
+    mCurTransactionSize = transactionSize;
+
+    std::size_t numInsertedCurTransaction = 0;
+    std::chrono::duration<double> insertDurationCurTransaction(0);
+    auto commit = [&]()
+    {
+        const auto commitBegin = ClockType::now();
+        mBackend->EndTransaction();
+        mBackend->BeginTransaction();
+        const std::chrono::duration<double> commitDuration = ClockType::now() - commitBegin;
+
+        if(mTransactionSize == 0 && numInsertedCurTransaction >= transactionSize)
+        {
+            if(commitDuration > (insertDurationCurTransaction * maxCommitOverhead))
+                transactionSize = std::min(transactionSize * 2, maxTransactionSize);
+            else if(commitDuration < (insertDurationCurTransaction * minCommitOverhead))
+                transactionSize = std::max(transactionSize / 2, minTransactionSize);
+            mCurTransactionSize = transactionSize;
+        }
+        numInsertedCurTransaction = 0;
+        insertDurationCurTransaction = std::chrono::duration<double>::zero();
+    };
+
+    mBackend->BeginTransaction();
+
+    std::vector<std::unique_ptr<IInsertValuesContainer>> batch;
+    batch.reserve(256);
+
+    while(mIsConsumerRunning || !mInsertQueue.IsEmpty())
     {
-        for(std::size_t numBinded=1; numBinded<=numToBindPerRow; ++numBinded)
+        if(mInsertQueue.PopBatch(batch, 256, std::chrono::milliseconds(10)) > 0)
+        {
+            for(std::unique_ptr<IInsertValuesContainer>& statements : batch)
+            {
+                if(numInsertedCurTransaction > transactionSize)
+                    commit();
+
+                const std::size_t insertStatementIdx = mInsertStatementIdxs[statements->GetPreparedStatementIdx()];
+                assert(insertStatementIdx != std::numeric_limits<std::size_t>::max());
+
+                const auto insertBegin = ClockType::now();
+                const std::size_t numInserted = mBackend->Insert(insertStatementIdx, *statements);
+                insertDurationCurTransaction += ClockType::now() - insertBegin;
+
+                numInsertedCurTransaction += numInserted;
+                mNumInsertedRows += numInserted;
+
+                statements->Recycle(std::move(statements), numInserted);
+            }
+            batch.clear();
+        }
+        else if(numInsertedCurTransaction > minTransactionSize)
         {
-            (*curValsIt)->Bind(stmt, numBinded);
-            ++curValsIt;
+            // try to use time while the queue is empty by commiting the transaction
+            commit();
         }
-        sqlite3_step(stmt);
-        sqlite3_clear_bindings(stmt);
-        sqlite3_reset(stmt);
-        numInserted += 1;
     }
 
-    mValues.clear();
-    return numInserted;
+    mBackend->EndTransaction();
 }
 
 
+
 auto COutput::GetRef() -> COutput&
 {
     static COutput mInstance;
     return mInstance;
 }
 
-void COutput::LogCallback(void* dat, int errorCode, const char* errorMessage)
-{
-    (void)dat;
-    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    std::stringstream timeStr;
-    timeStr << std::put_time(std::localtime(&now), "%y%j_%H%M%S");
-#ifdef STATIC_DB_LOG_NAME
-    static std::ofstream sqliteLog(STATIC_DB_LOG_NAME);
-#else
-    static std::ofstream sqliteLog(timeStr.str() + ".log");
-#endif
-    sqliteLog << "[" << timeStr.str() << "] - " << errorCode << ": " << errorMessage << std::endl;
-}
-
 COutput::~COutput()
 {
     Shutdown();
 }
 
-bool COutput::Initialise(const std::filesystem::path& dbFilePath, bool keepInMemory)
+bool COutput::Initialise(std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath)
 {
-    assert(mDB == nullptr);
-
-    if(sqlite3_config(SQLITE_CONFIG_LOG, COutput::LogCallback, nullptr) != SQLITE_OK)
+    assert(mShards.empty());
+    if(backend == nullptr)
         return false;
+    mShards.emplace_back(std::make_unique<COutputShard>("main", std::move(backend), filePath));
+    return true;
+}
 
-    if(keepInMemory)
-    {
-        mDBFilePath = dbFilePath;
-        sqlite3_open_v2(":memory:", &mDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-    }
-    else
-        sqlite3_open_v2(dbFilePath.c_str(), &mDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-
-    if(mDB == nullptr)
+bool COutput::AddShard(const std::string& tableName, std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath)
+{
+    assert(!mShards.empty());
+    if(mIsConsumerRunning || backend == nullptr)
         return false;
 
+    std::vector<std::size_t>& shardIdxs = mTableNameToShardIdxs[tableName];
+    const std::string name = tableName + "." + std::to_string(shardIdxs.size());
+    shardIdxs.push_back(mShards.size());
+    mShards.emplace_back(std::make_unique<COutputShard>(name, std::move(backend), filePath));
     return true;
 }
 
+void COutput::DisableInserts(const std::string& tableName)
+{
+    assert(!mIsConsumerRunning);
+    mDisabledTableNames.insert(tableName);
+}
+
+void COutput::SetFilter(const std::string& tableName, const COutputFilter& filter)
+{
+    assert(!mIsConsumerRunning);
+    mTableNameToFilter[tableName] = filter;
+}
+
+void COutput::SetMergeShards(const bool mergeShards)
+{
+    mMergeShards = mergeShards;
+}
+
 bool COutput::StartConsumer()
 {
-    if(mConsumerThread.joinable())
+    if(mIsConsumerRunning)
         return false;
 
+    for(const auto& [tableName, filter] : mTableNameToFilter)
+    {
+        (void)filter;
+        std::cout << "Ignoring output filter of unknown table " << tableName << std::endl;
+    }
+
     mIsConsumerRunning = true;
-    mConsumerThread = std::thread(&COutput::ConsumerThread, this);
+    for(std::unique_ptr<COutputShard>& shard : mShards)
+        shard->StartConsumer(mTransactionSize);
 
     return true;
 }
 
 void COutput::Shutdown()
 {
+    for(std::unique_ptr<COutputShard>& shard : mShards)
+        shard->StopConsumer();
     mIsConsumerRunning = false;
-    if(mConsumerThread.joinable())
-        mConsumerThread.join();
 
-    while(!mPreparedStatements.empty())
-    {
-        sqlite3_finalize(mPreparedStatements.back());
-        mPreparedStatements.pop_back();
-    }
+    if(mShards.empty())
+        return;
 
-    if(mDB != nullptr)
+    IOutputBackend& mainBackend = mShards[0]->GetBackend();
+    for(const auto& [tableName, shardIdxs] : mTableNameToShardIdxs)
     {
-        if (!mDBFilePath.empty())
+        for(const std::size_t shardIdx : shardIdxs)
         {
-            sqlite3* diskDB;
-            int ok = sqlite3_open(mDBFilePath.c_str(), &diskDB);
-            if (ok == SQLITE_OK)
+            COutputShard& shard = *(mShards[shardIdx]);
+            shard.Close();
+            if(!mMergeShards || shard.GetFilePath().empty())
+                continue;
+
+            if(mainBackend.MergeShard(shard.GetFilePath(), {tableName}))
             {
-                sqlite3_backup* backup = sqlite3_backup_init(diskDB, "main", mDB, "main");
-                if (backup)
-                {
-                    sqlite3_backup_step(backup, -1);
-                    sqlite3_backup_finish(backup);
-                }
-                sqlite3_close(diskDB);
+                std::error_code error;
+                std::filesystem::remove_all(shard.GetFilePath(), error);
             }
+            else
+                std::cout << "Failed merging output shard " << shard.GetName() << ": " << shard.GetFilePath() << std::endl;
         }
-        sqlite3_close(mDB);
-        mDB = nullptr;
     }
-}
 
-auto COutput::AddPreparedSQLStatement(const std::string& statementString) -> std::size_t
-{
-    sqlite3_stmt* preparedStatement;
-    sqlite3_prepare_v3(mDB, statementString.c_str(), statementString.size() + 1, SQLITE_PREPARE_PERSISTENT, &preparedStatement, nullptr);
-    assert(preparedStatement != nullptr);
-    mPreparedStatements.emplace_back(preparedStatement);
-    return (mPreparedStatements.size() - 1);
+    mShards.clear();
+    mTableNameToShardIdxs.clear();
+    mDisabledTableNames.clear();
+    mTableNameToFilter.clear();
+    mInsertRoutes.clear();
 }
 
-bool COutput::CreateTable(const std::string& tableName, const std::string& columns)
+void COutput::SetTransactionSize(const std::size_t transactionSize)
 {
-    if(mIsConsumerRunning)
-        return false;
-    const std::string str = "CREATE TABLE " + tableName + "(" + columns + ");";
-    return sqlite3_exec(mDB, str.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    mTransactionSize = transactionSize;
 }
 
-bool COutput::InsertRow(const std::string& tableName, const std::string& row)
+bool COutput::CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints)
 {
     if(mIsConsumerRunning)
         return false;
-    const std::string str = "INSERT INTO " + tableName + " VALUES (" + row + ");";
-    return sqlite3_exec(mDB, str.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+
+    // the main output always gets the table, so the shards can be merged into it
+    bool ok = mShards[0]->GetBackend().CreateTable(tableName, columns, constraints);
+    const auto result = mTableNameToShardIdxs.find(tableName);
+    if(result != mTableNameToShardIdxs.cend())
+        for(const std::size_t shardIdx : result->second)
+            ok = ok && mShards[shardIdx]->GetBackend().CreateTable(tableName, columns, constraints);
+    return ok;
 }
 
-void COutput::QueueInserts(std::unique_ptr<CInsertStatements>&& statements)
+auto COutput::AddInsertStatement(const std::string& tableName) -> std::size_t
 {
-    assert(statements != nullptr);
+    assert(!mIsConsumerRunning);
 
-    if(statements->IsEmpty())
-        return;
+    const std::size_t insertStatementIdx = mInsertRoutes.size();
+    auto route = std::make_unique<SInsertRoute>();
 
-    std::size_t newProducerIdx = (mProducerIdx + 1) % OUTPUT_BUF_SIZE;
-    while(newProducerIdx == mConsumerIdx)
+    const auto result = mTableNameToShardIdxs.find(tableName);
+    if(mDisabledTableNames.count(tableName) > 0)
+        route->mShardIdxs.clear();
+    else if(result != mTableNameToShardIdxs.cend())
+        route->mShardIdxs = result->second;
+    else
+        route->mShardIdxs.push_back(0);
+
+    for(const std::size_t shardIdx : route->mShardIdxs)
     {
-        assert(mIsConsumerRunning);
-        newProducerIdx = (mProducerIdx + 1) % OUTPUT_BUF_SIZE;
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        COutputShard& shard = *(mShards[shardIdx]);
+        shard.SetInsertStatementIdx(insertStatementIdx, shard.GetBackend().AddInsertStatement(tableName));
     }
-    mStatementsBuffer[mProducerIdx] = std::move(statements);
-    mProducerIdx = newProducerIdx;
+
+    mInsertRoutes.emplace_back(std::move(route));
+    return insertStatementIdx;
 }
 
-void COutput::ConsumerThread()
+bool COutput::InsertRow(const std::string& tableName, const std::string& row)
 {
-    sqlite3_exec(mDB, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
-
-    std::size_t numInsertedCurTransaction = 0;
-    while(mIsConsumerRunning || (mConsumerIdx != mProducerIdx))
-    {
-        while(mConsumerIdx != mProducerIdx)
-        {
-            if(numInsertedCurTransaction > 25000)
-            {
-                sqlite3_exec(mDB, "END TRANSACTION; BEGIN TRANSACTION", nullptr, nullptr, nullptr);
-                numInsertedCurTransaction = 0;
-            }
-
-            const std::size_t sqlStmtIdx = mStatementsBuffer[mConsumerIdx]->GetPreparedStatementIdx();
-            sqlite3_stmt* sqlStmt = mPreparedStatements[sqlStmtIdx];
-            numInsertedCurTransaction += mStatementsBuffer[mConsumerIdx]->BindAndInsert(sqlStmt);
+    if(mIsConsumerRunning)
+        return false;
+    return mShards[0]->GetBackend().InsertRow(tableName, row);
+}
 
-            mStatementsBuffer[mConsumerIdx] = nullptr;
-            mConsumerIdx = (mConsumerIdx + 1) % OUTPUT_BUF_SIZE;
-        }
+void COutput::QueueInserts(std::unique_ptr<IInsertValuesContainer>&& statements)
+{
+    assert(statements != nullptr);
 
-        // try to use time while buf is empty by commiting the transactionn
-        if(numInsertedCurTransaction > 1000)
-        {
-            sqlite3_exec(mDB, "END TRANSACTION; BEGIN TRANSACTION", nullptr, nullptr, nullptr);
-            numInsertedCurTransaction = 0;
-        }
-        else
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(statements->GetPreparedStatementIdx() < mInsertRoutes.size());
+    SInsertRoute& route = *(mInsertRoutes[statements->GetPreparedStatementIdx()]);
+    // empty containers, e.g. if the filter of the table dropped all rows, go straight back to their pool
+    if(statements->IsEmpty() || route.mShardIdxs.empty())
+    {
+        statements->Recycle(std::move(statements), 0);
+        return;
     }
-
-    sqlite3_exec(mDB, "END TRANSACTION", nullptr, nullptr, nullptr);
+    std::size_t shardIdx = route.mShardIdxs[0];
+    if(route.mShardIdxs.size() > 1)
+        shardIdx = route.mShardIdxs[route.mNextShard.fetch_add(1, std::memory_order_relaxed) % route.mShardIdxs.size()];
+    mShards[shardIdx]->QueueInserts(std::move(statements));
 }
@@ -1,38 +1,129 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <atomic>
 #include <filesystem>
 #include <memory>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "sqlite3.h"
+
+#include "CBoundedMPMCQueue.hpp"
+#include "CColumnarOutputBackend.hpp"
+#include "COutputFilter.hpp"
+#include "CSQLiteOutputBackend.hpp"
+
 #define OUTPUT_BUF_SIZE 8192
+#define INSERT_VALUES_POOL_SIZE 1024
 
-struct sqlite3;
-struct sqlite3_stmt;
 
 
-class IBindableValue
+class IInsertValuesContainer
 {
 public:
-    virtual bool Bind(sqlite3_stmt* stmt, int idx) = 0;
+    virtual ~IInsertValuesContainer() = default;
+
+    virtual auto GetPreparedStatementIdx() const -> std::size_t = 0;
+    virtual bool IsEmpty() const = 0;
+    // returns the number of rows that were inserted without error
+    virtual auto BindAndInsert(const SPreparedInsert& preparedInsert) -> std::size_t = 0;
+    // writes the rows to backends that do not use prepared statements
+    virtual auto WriteRows(IRowWriter& writer) -> std::size_t = 0;
+
+    // called by the consumer after the values were inserted. Pooled containers
+    // move themselves back to their pool, all others are destroyed with self
+    virtual void Recycle(std::unique_ptr<IInsertValuesContainer> self, const std::size_t numInsertedRows)
+    {
+        (void)self;
+        (void)numInsertedRows;
+    }
 };
 
 
-class CInsertStatements
+// lock-free free list of empty containers. Recycled containers keep their capacity
+// and the reserve of new ones follows the average number of rows per container
+template<typename TContainer>
+class CInsertValuesPool
 {
+private:
+    CBoundedMPMCQueue<std::unique_ptr<TContainer>> mFreeContainers {INSERT_VALUES_POOL_SIZE};
+
+    // exponentially weighted moving average of the number of rows per container
+    std::atomic<double> mAvgNumRows = 0;
+
+public:
+    auto Acquire(const std::size_t minNumReserve=0) -> std::unique_ptr<TContainer>
+    {
+        std::unique_ptr<TContainer> container;
+        if(!mFreeContainers.TryPop(container))
+            container = std::make_unique<TContainer>();
+
+        // some headroom above the average avoids reallocations for slightly larger ticks
+        const std::size_t numReserve = std::max(minNumReserve, static_cast<std::size_t>(mAvgNumRows.load(std::memory_order_relaxed) * 1.25) + 1);
+        container->Reserve(numReserve);
+        return container;
+    }
+
+    void Release(std::unique_ptr<TContainer>&& container, const std::size_t numRows)
+    {
+        constexpr double weight = 1.0 / 16;
+        double avgNumRows = mAvgNumRows.load(std::memory_order_relaxed);
+        while(!mAvgNumRows.compare_exchange_weak(avgNumRows, avgNumRows + ((numRows - avgNumRows) * weight), std::memory_order_relaxed))
+        {}
+
+        // containers that grew far beyond the average would only waste memory in the pool
+        if(container->GetCapacity() > (4 * (static_cast<std::size_t>(avgNumRows) + 64)))
+            return;
+
+        mFreeContainers.TryPush(std::move(container));
+    }
+
+    inline auto GetAvgNumRows() const -> double
+    {return mAvgNumRows;}
+};
+
+
+class CInsertStatements : public IInsertValuesContainer
+{
+private:
+    enum EValueType : unsigned char
+    {
+        eNull = 0,
+        eDouble,
+        eInt,
+        eInt64,
+        eString
+    };
+
+    template<typename T>
+    void AppendValue(const EValueType type, const T& value);
+
+    // returns the begin of the next value
+    static auto BindValue(sqlite3_stmt* const stmt, const int idx, const unsigned char* value) -> const unsigned char*;
+
 protected:
     std::size_t mPreparedStatementIdx = 0;
-    std::vector<std::unique_ptr<IBindableValue>> mValues;
+    std::size_t mNumValues = 0;
+
+    // packed values: each value is a type tag followed by its raw bytes.
+    // strings are stored as length followed by their chars
+    std::vector<unsigned char> mValues;
 
 public:
     CInsertStatements(std::size_t preparedStatementIdx, std::size_t numReserve=0);
 
-    inline auto GetPreparedStatementIdx() const -> std::size_t
+    inline auto GetPreparedStatementIdx() const -> std::size_t final
     {return mPreparedStatementIdx;}
 
-    bool IsEmpty() const
+    bool IsEmpty() const final
     {return mValues.empty();}
 
     void AddValue(double value);
@@ -40,28 +131,291 @@ public:
     void AddValue(std::uint32_t value);
     void AddValue(std::uint64_t value);
     void AddValue(const std::string& value);
-    void AddValue(std::string&& value);
 
-    auto BindAndInsert(sqlite3_stmt* const stmt) -> std::size_t;
+    auto BindAndInsert(const SPreparedInsert& preparedInsert) -> std::size_t final;
+    auto WriteRows(IRowWriter& writer) -> std::size_t final;
 };
 
 
-class COutput
+
+// maps the c++ type of a column to its sql type and the sqlite bind function
+template<typename T>
+struct SColumnTraits;
+
+template<>
+struct SColumnTraits<double>
+{
+    static constexpr const char* mSQLType = "DOUBLE";
+    static inline bool Bind(sqlite3_stmt* const stmt, const int idx, const double value)
+    {return sqlite3_bind_double(stmt, idx, value) == SQLITE_OK;}
+};
+
+template<>
+struct SColumnTraits<int>
+{
+    static constexpr const char* mSQLType = "INTEGER";
+    static inline bool Bind(sqlite3_stmt* const stmt, const int idx, const int value)
+    {return sqlite3_bind_int(stmt, idx, value) == SQLITE_OK;}
+};
+
+template<>
+struct SColumnTraits<std::uint32_t>
+{
+    static constexpr const char* mSQLType = "INTEGER";
+    static inline bool Bind(sqlite3_stmt* const stmt, const int idx, const std::uint32_t value)
+    {return sqlite3_bind_int64(stmt, idx, value) == SQLITE_OK;}
+};
+
+template<>
+struct SColumnTraits<std::uint64_t>
+{
+    static constexpr const char* mSQLType = "BIGINT";
+    static inline bool Bind(sqlite3_stmt* const stmt, const int idx, const std::uint64_t value)
+    {return sqlite3_bind_int64(stmt, idx, static_cast<sqlite3_int64>(value)) == SQLITE_OK;}
+};
+
+template<>
+struct SColumnTraits<std::string>
+{
+    static constexpr const char* mSQLType = "TEXT";
+    // the row storage outlives the step, so sqlite does not need a copy
+    static inline bool Bind(sqlite3_stmt* const stmt, const int idx, const std::string& value)
+    {
+        if(value.empty())
+            return sqlite3_bind_null(stmt, idx) == SQLITE_OK;
+        return sqlite3_bind_text(stmt, idx, value.c_str(), static_cast<int>(value.size()), SQLITE_STATIC) == SQLITE_OK;
+    }
+};
+
+
+template<const char* name, typename T>
+struct SColumn
+{
+    typedef T ValueType;
+    static constexpr const char* mName = name;
+    static constexpr const char* mSQLType = SColumnTraits<T>::mSQLType;
+};
+
+
+// name and constraints must be constexpr char arrays with external linkage, e.g.:
+// inline constexpr char sFilesName[] = "Files";
+template<const char* name, const char* constraints, typename... TColumns>
+class CTable
+{
+public:
+    typedef std::tuple<typename TColumns::ValueType...> RowType;
+
+    static constexpr std::size_t mNumColumns = sizeof...(TColumns);
+    static constexpr const char* mName = name;
+
+    // set by COutput::CreateTable<CTable>()
+    static inline std::size_t mInsertStatementIdx = 0;
+    static inline COutputFilter mFilter;
+    static inline bool mIsInsertEnabled = true;
+
+    static auto GetColumnDefinitions() -> std::vector<SColumnDefinition>
+    {
+        return {SColumnDefinition{TColumns::mName, TColumns::mSQLType}...};
+    }
+
+    static auto GetConstraints() -> std::string
+    {return constraints;}
+
+    // binds the row to the parameters firstIdx+1 ... firstIdx+mNumColumns
+    template<std::size_t... idxs>
+    static inline void BindRow(sqlite3_stmt* const stmt, const int firstIdx, const RowType& row, std::index_sequence<idxs...>)
+    {
+        (SColumnTraits<typename TColumns::ValueType>::Bind(stmt, firstIdx + static_cast<int>(idxs + 1), std::get<idxs>(row)), ...);
+    }
+
+    template<std::size_t... idxs>
+    static inline void WriteRow(IRowWriter& writer, const RowType& row, std::index_sequence<idxs...>)
+    {
+        (writer.AppendValue(std::get<idxs>(row)), ...);
+        writer.EndRow();
+    }
+};
+
+
+template<typename TTable>
+class CTypedInsertStatements : public IInsertValuesContainer
 {
 private:
-    COutput() = default;
+    std::vector<typename TTable::RowType> mRows;
+
+public:
+    CTypedInsertStatements(std::size_t numReserve=0)
+    {
+        if(numReserve > 0)
+            mRows.reserve(numReserve);
+    }
+
+    static auto GetPool() -> CInsertValuesPool<CTypedInsertStatements>&
+    {
+        static CInsertValuesPool<CTypedInsertStatements> pool;
+        return pool;
+    }
+
+    // returns an empty container from the pool of this table. Containers of disabled
+    // tables stay empty, so they reserve nothing and are recycled when queued
+    static auto Acquire(const std::size_t minNumReserve=0) -> std::unique_ptr<CTypedInsertStatements>
+    {return GetPool().Acquire(TTable::mIsInsertEnabled ? minNumReserve : 0);}
+
+    void Recycle(std::unique_ptr<IInsertValuesContainer> self, const std::size_t numInsertedRows) final
+    {
+        assert(self.get() == this);
+        // rows of disabled tables were never inserted
+        const std::size_t numRows = std::max(numInsertedRows, mRows.size());
+        mRows.clear();
+        GetPool().Release(std::unique_ptr<CTypedInsertStatements>(static_cast<CTypedInsertStatements*>(self.release())), numRows);
+    }
+
+    inline void Reserve(const std::size_t numReserve)
+    {mRows.reserve(numReserve);}
+    inline auto GetCapacity() const -> std::size_t
+    {return mRows.capacity();}
+
+    inline auto GetPreparedStatementIdx() const -> std::size_t final
+    {return TTable::mInsertStatementIdx;}
+
+    bool IsEmpty() const final
+    {return mRows.empty();}
+
+    template<typename... TValues>
+    inline void AddRow(TValues&&... values)
+    {
+        static_assert(sizeof...(TValues) == TTable::mNumColumns, "number of values does not match the number of columns");
+        static_assert(std::is_same_v<std::tuple<std::decay_t<TValues>...>, typename TTable::RowType>, "value types do not match the column types");
+        // the values are still evaluated by the caller, so ids are assigned the same way
+        if(!TTable::mIsInsertEnabled)
+            return;
+        if(!TTable::mFilter.IsPassThrough() && !TTable::mFilter.Accept(std::forward_as_tuple(values...)))
+            return;
+        mRows.emplace_back(std::forward<TValues>(values)...);
+    }
+
+    auto BindAndInsert(const SPreparedInsert& preparedInsert) -> std::size_t final
+    {
+        constexpr auto columnIdxs = std::make_index_sequence<TTable::mNumColumns>();
+        const std::size_t numRows = mRows.size();
+        std::size_t rowIdx = 0;
+        std::size_t numInserted = 0;
+
+        sqlite3_stmt* const multiRowStmt = preparedInsert.mMultiRowStatement;
+        const std::size_t numRowsPerMultiRowStmt = preparedInsert.mNumRowsPerMultiRowStatement;
+        if(multiRowStmt != nullptr)
+        {
+            for(; (rowIdx + numRowsPerMultiRowStmt) <= numRows; rowIdx += numRowsPerMultiRowStmt)
+            {
+                for(std::size_t i = 0; i < numRowsPerMultiRowStmt; ++i)
+                    TTable::BindRow(multiRowStmt, static_cast<int>(i * TTable::mNumColumns), mRows[rowIdx + i], columnIdxs);
+                if(SPreparedInsert::Step(multiRowStmt, numRowsPerMultiRowStmt))
+                    numInserted += numRowsPerMultiRowStmt;
+            }
+        }
+
+        sqlite3_stmt* const stmt = preparedInsert.mStatement;
+        for(; rowIdx < numRows; ++rowIdx)
+        {
+            TTable::BindRow(stmt, 0, mRows[rowIdx], columnIdxs);
+            if(SPreparedInsert::Step(stmt, 1))
+                ++numInserted;
+        }
+
+        mRows.clear();
+        return numInserted;
+    }
+
+    auto WriteRows(IRowWriter& writer) -> std::size_t final
+    {
+        constexpr auto columnIdxs = std::make_index_sequence<TTable::mNumColumns>();
+        const std::size_t numRows = mRows.size();
+        for(const typename TTable::RowType& row : mRows)
+            TTable::WriteRow(writer, row, columnIdxs);
+        mRows.clear();
+        return numRows;
+    }
+};
+
+
+// a backend fed by its own queue and consumer thread
+class COutputShard
+{
+private:
+    std::string mName;
+    std::unique_ptr<IOutputBackend> mBackend;
+
+    // file or directory of the backend, used to merge the shard
+    std::filesystem::path mFilePath;
 
     std::atomic_bool mIsConsumerRunning = false;
     std::thread mConsumerThread;
 
-    std::atomic_size_t mConsumerIdx = 0;
-    std::atomic_size_t mProducerIdx = 0;
-    std::unique_ptr<CInsertStatements> mStatementsBuffer[OUTPUT_BUF_SIZE];
+    CBoundedMPMCQueue<std::unique_ptr<IInsertValuesContainer>> mInsertQueue {OUTPUT_BUF_SIZE};
 
-    sqlite3* mDB = nullptr;
-    std::vector<sqlite3_stmt*> mPreparedStatements;
+    // maps the insert statement idxs of COutput to the ones of the backend
+    std::vector<std::size_t> mInsertStatementIdxs;
 
-    std::filesystem::path mDBFilePath;
+    std::size_t mTransactionSize = 0;
+
+    std::atomic<std::uint64_t> mNumInsertedRows = 0;
+    std::atomic_size_t mCurTransactionSize = 0;
+
+    void ConsumerThread();
+
+public:
+    COutputShard(const std::string& name, std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath);
+    ~COutputShard();
+
+    COutputShard(const COutputShard&) = delete;
+    COutputShard& operator=(const COutputShard&) = delete;
+
+    bool StartConsumer(const std::size_t transactionSize);
+    void StopConsumer();
+    void Close();
+
+    void SetInsertStatementIdx(const std::size_t outputInsertStatementIdx, const std::size_t backendInsertStatementIdx);
+
+    // thread safe. Blocks while the queue is full
+    void QueueInserts(std::unique_ptr<IInsertValuesContainer>&& statements);
+
+    inline auto GetName() const -> const std::string&
+    {return mName;}
+    inline auto GetBackend() -> IOutputBackend&
+    {return *mBackend;}
+    inline auto GetFilePath() const -> const std::filesystem::path&
+    {return mFilePath;}
+    inline auto GetInsertQueue() const -> const CBoundedMPMCQueue<std::unique_ptr<IInsertValuesContainer>>&
+    {return mInsertQueue;}
+    inline auto GetNumInsertedRows() const -> std::uint64_t
+    {return mNumInsertedRows;}
+    inline auto GetCurTransactionSize() const -> std::size_t
+    {return mCurTransactionSize;}
+};
+
+
+class COutput
+{
+private:
+    COutput() = default;
+
+    struct SInsertRoute
+    {
+        std::vector<std::size_t> mShardIdxs;
+        std::atomic_size_t mNextShard = 0;
+    };
+
+    bool mIsConsumerRunning = false;
+
+    // mShards[0] is the main output. Further shards only store the tables they were added for
+    std::vector<std::unique_ptr<COutputShard>> mShards;
+    std::unordered_map<std::string, std::vector<std::size_t>> mTableNameToShardIdxs;
+    std::unordered_set<std::string> mDisabledTableNames;
+    std::unordered_map<std::string, COutputFilter> mTableNameToFilter;
+    std::vector<std::unique_ptr<SInsertRoute>> mInsertRoutes;
+
+    bool mMergeShards = true;
+    std::size_t mTransactionSize = 0;
 
 public:
     COutput(const COutput&) = delete;
@@ -72,17 +426,61 @@ public:
     ~COutput();
 
     static auto GetRef() -> COutput&;
-    static void LogCallback(void* data, int errorCode, const char* errorMessage);
 
-    bool Initialise(const std::filesystem::path& dbFilePath, bool keepInMemory);
+    bool Initialise(std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath);
     bool StartConsumer();
     void Shutdown();
 
-    auto AddPreparedSQLStatement(const std::string& queryString) -> std::size_t;
-    bool CreateTable(const std::string& tableName, const std::string& column);
+    // inserts of the table are distributed over all shards added for it.
+    // Must be called before the table is created
+    bool AddShard(const std::string& tableName, std::unique_ptr<IOutputBackend>&& backend, const std::filesystem::path& filePath);
+
+    // the table is still created but rows queued for it are dropped.
+    // Must be called before the table is created
+    void DisableInserts(const std::string& tableName);
+
+    // applied to the rows of typed tables. Must be called before the table is created.
+    // Filters of tables that were not created are reported when the consumer is started
+    void SetFilter(const std::string& tableName, const COutputFilter& filter);
+
+    // if true the shards are merged into the main output by Shutdown() and deleted afterwards
+    void SetMergeShards(const bool mergeShards);
+
+    // number of rows per transaction. 0 tunes it based on the commit durations
+    void SetTransactionSize(const std::size_t transactionSize);
+
+    // must be called before the consumer is started
+    bool CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints);
+    auto AddInsertStatement(const std::string& tableName) -> std::size_t;
     bool InsertRow(const std::string& tableName, const std::string& row);
 
-    void QueueInserts(std::unique_ptr<CInsertStatements>&& statements);
+    // creates the table and prepares its insert statements
+    template<typename TTable>
+    bool CreateTable()
+    {
+        const auto filter = mTableNameToFilter.find(TTable::mName);
+        if(filter != mTableNameToFilter.cend())
+        {
+            TTable::mFilter = filter->second;
+            if(!TTable::mFilter.Resolve(TTable::mName, TTable::GetColumnDefinitions()))
+                return false;
+            if(!TTable::mFilter.IsEnabled())
+                DisableInserts(TTable::mName);
+            mTableNameToFilter.erase(filter);
+        }
 
-    void ConsumerThread();
+        if(!CreateTable(TTable::mName, TTable::GetColumnDefinitions(), TTable::GetConstraints()))
+            return false;
+        TTable::mInsertStatementIdx = AddInsertStatement(TTable::mName);
+        TTable::mIsInsertEnabled = (mDisabledTableNames.count(TTable::mName) == 0);
+        return true;
+    }
+
+    // thread safe. Blocks while the queue of the shard is full
+    void QueueInserts(std::unique_ptr<IInsertValuesContainer>&& statements);
+
+    inline auto GetNumShards() const -> std::size_t
+    {return mShards.size();}
+    inline auto GetShard(const std::size_t shardIdx) const -> const COutputShard&
+    {return *(mShards[shardIdx]);}
 };
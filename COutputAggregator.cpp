@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cassert>
+
+#include "COutputAggregator.hpp"
+#include "COutput.hpp"
+#include "COutputTables.hpp"
+#include "CStorageElement.hpp"
+#include "SFile.hpp"
+
+
+
+COutputAggregator::COutputAggregator(const TickType tickBucketWidth, const TickType transferDurationBinWidth, const std::uint64_t filesizeBinWidth)
+    : mTickBucketWidth(std::max<TickType>(tickBucketWidth, 1)),
+      mTransferDurationBinWidth(std::max<TickType>(transferDurationBinWidth, 1)),
+      mFilesizeBinWidth(std::max<std::uint64_t>(filesizeBinWidth, 1)),
+      mNextFlushTick(mTickBucketWidth)
+{}
+
+bool COutputAggregator::CreateTables()
+{
+    COutput& output = COutput::GetRef();
+    bool ok = output.CreateTable<tables::CTransferAggregatesTable>();
+    ok = ok && output.CreateTable<tables::CTransferDurationHistoTable>();
+    ok = ok && output.CreateTable<tables::CFilesizeHistoTable>();
+    return ok;
+}
+
+void COutputAggregator::AddFile(const SFile* const file)
+{
+    mFilesizeHisto[file->GetSize() / mFilesizeBinWidth] += 1;
+}
+
+void COutputAggregator::AddPendingTransfer(const TickType startTick)
+{
+    if(startTick >= mNextFlushTick)
+        FlushClosedBuckets(startTick);
+    mNumPendingTransfers[startTick - (startTick % mTickBucketWidth)] += 1;
+}
+
+void COutputAggregator::RemovePendingTransfer(const TickType startTick)
+{
+    auto result = mNumPendingTransfers.find(startTick - (startTick % mTickBucketWidth));
+    assert(result != mNumPendingTransfers.end() && result->second > 0);
+    if(--(result->second) == 0)
+        mNumPendingTransfers.erase(result);
+}
+
+void COutputAggregator::AddTransfer(SReplica* const srcReplica, const TickType startTick, const TickType endTick)
+{
+    RemovePendingTransfer(startTick);
+
+    const IdType storageElementId = srcReplica->GetStorageElement()->GetId();
+    STransferAggregate& aggregate = mTransferAggregates[{startTick - (startTick % mTickBucketWidth), storageElementId}];
+    aggregate.mNumTransfers += 1;
+    aggregate.mTraffic += srcReplica->GetFile()->GetSize();
+    aggregate.mSummedDuration += endTick - startTick;
+
+    mTransferDurationHisto[(endTick - startTick) / mTransferDurationBinWidth] += 1;
+
+    if(endTick >= mNextFlushTick)
+        FlushClosedBuckets(endTick);
+}
+
+void COutputAggregator::FlushClosedBuckets(const TickType now)
+{
+    mNextFlushTick = now - (now % mTickBucketWidth) + mTickBucketWidth;
+
+    auto transferAggregateInserts = CTypedInsertStatements<tables::CTransferAggregatesTable>::Acquire();
+    auto aggregateIt = mTransferAggregates.begin();
+    while(aggregateIt != mTransferAggregates.end())
+    {
+        const TickType bucketStartTick = aggregateIt->first.first;
+        if((bucketStartTick + mTickBucketWidth) > now)
+            break;
+        if(mNumPendingTransfers.count(bucketStartTick) > 0)
+        {
+            // skip the remaining aggregates of this bucket
+            aggregateIt = mTransferAggregates.lower_bound({bucketStartTick + mTickBucketWidth, 0});
+            continue;
+        }
+        const STransferAggregate& aggregate = aggregateIt->second;
+        transferAggregateInserts->AddRow(bucketStartTick, aggregateIt->first.second, aggregate.mNumTransfers, aggregate.mTraffic, aggregate.mSummedDuration);
+        aggregateIt = mTransferAggregates.erase(aggregateIt);
+    }
+    COutput::GetRef().QueueInserts(std::move(transferAggregateInserts));
+}
+
+void COutputAggregator::WriteOutput()
+{
+    COutput& output = COutput::GetRef();
+
+    auto transferAggregateInserts = CTypedInsertStatements<tables::CTransferAggregatesTable>::Acquire(mTransferAggregates.size());
+    for(const auto& [key, aggregate] : mTransferAggregates)
+        transferAggregateInserts->AddRow(key.first, key.second, aggregate.mNumTransfers, aggregate.mTraffic, aggregate.mSummedDuration);
+    output.QueueInserts(std::move(transferAggregateInserts));
+    mTransferAggregates.clear();
+
+    auto transferDurationInserts = CTypedInsertStatements<tables::CTransferDurationHistoTable>::Acquire(mTransferDurationHisto.size());
+    for(const auto& [binIdx, numTransfers] : mTransferDurationHisto)
+        transferDurationInserts->AddRow(binIdx * mTransferDurationBinWidth, numTransfers);
+    output.QueueInserts(std::move(transferDurationInserts));
+
+    auto filesizeInserts = CTypedInsertStatements<tables::CFilesizeHistoTable>::Acquire(mFilesizeHisto.size());
+    for(const auto& [binIdx, numFiles] : mFilesizeHisto)
+        filesizeInserts->AddRow(binIdx * mFilesizeBinWidth, numFiles);
+    output.QueueInserts(std::move(filesizeInserts));
+}
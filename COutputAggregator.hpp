@@ -0,0 +1,59 @@
+#pragma once
+
+#include <map>
+#include <utility>
+
+#include "constants.h"
+
+struct SFile;
+struct SReplica;
+
+
+
+// maintains the aggregates of the usual analysis queries during the simulation,
+// so the raw Files, Replicas and Transfers rows do not have to be written
+class COutputAggregator
+{
+private:
+    struct STransferAggregate
+    {
+        std::uint64_t mNumTransfers = 0;
+        std::uint64_t mTraffic = 0;
+        std::uint64_t mSummedDuration = 0;
+    };
+
+    TickType mTickBucketWidth;
+    TickType mTransferDurationBinWidth;
+    std::uint64_t mFilesizeBinWidth;
+
+    // keyed by the first tick of the start tick bucket and the src storage element id
+    std::map<std::pair<TickType, IdType>, STransferAggregate> mTransferAggregates;
+
+    // number of transfers that were started but not added yet, keyed by the first tick of the
+    // start tick bucket. A bucket is closed once it ended and has no pending transfers
+    std::map<TickType, std::uint64_t> mNumPendingTransfers;
+    TickType mNextFlushTick;
+
+    // keyed by the bin idx
+    std::map<TickType, std::uint64_t> mTransferDurationHisto;
+    std::map<std::uint64_t, std::uint64_t> mFilesizeHisto;
+
+public:
+    COutputAggregator(const TickType tickBucketWidth, const TickType transferDurationBinWidth, const std::uint64_t filesizeBinWidth);
+
+    // must be called before the output consumer is started
+    static bool CreateTables();
+
+    void AddFile(const SFile* const file);
+
+    // every started transfer must either be added or removed after it ended
+    void AddPendingTransfer(const TickType startTick);
+    void RemovePendingTransfer(const TickType startTick);
+    void AddTransfer(SReplica* const srcReplica, const TickType startTick, const TickType endTick);
+
+    // queues the rows of the transfer aggregates of all closed buckets
+    void FlushClosedBuckets(const TickType now);
+
+    // queues the rows of all remaining aggregates
+    void WriteOutput();
+};
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include "json.hpp"
+
+#include "COutputFilter.hpp"
+
+
+
+bool COutputFilter::Load(const nlohmann::json& filterJson)
+{
+    if(!filterJson.is_object())
+    {
+        std::cout << "Output filter must be an object: " << filterJson.dump() << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    for(const auto& [key, value] : filterJson.items())
+    {
+        if(key == "enabled" && value.is_boolean())
+            mIsEnabled = value.get<bool>();
+        else if(key == "sampleRate" && value.is_number() && value.get<double>() >= 0 && value.get<double>() <= 1)
+        {
+            const double sampleRate = value.get<double>();
+            if(sampleRate < 1)
+                mSampleThreshold = static_cast<std::uint64_t>(sampleRate * static_cast<double>(std::numeric_limits<std::uint64_t>::max()));
+        }
+        else if(key == "sampleColumn" && value.is_string())
+            mSampleColumnName = value.get<std::string>();
+        else if(key == "columns" && value.is_object())
+        {
+            for(const auto& [columnName, predicateJson] : value.items())
+            {
+                SColumnPredicate predicate;
+                predicate.mColumnName = columnName;
+                if(!LoadPredicate(predicateJson, predicate))
+                {
+                    std::cout << "Invalid output filter of column " << columnName << ": " << predicateJson.dump() << std::endl;
+                    ok = false;
+                    continue;
+                }
+                if(predicateJson.is_array() && predicate.mValues.empty())
+                    mIsEnabled = false;
+                mPredicates.push_back(std::move(predicate));
+            }
+        }
+        else
+        {
+            std::cout << "Invalid output filter property " << key << ": " << value.dump() << std::endl;
+            ok = false;
+        }
+    }
+
+    mIsPassThrough = mIsEnabled && mPredicates.empty() && (mSampleThreshold == std::numeric_limits<std::uint64_t>::max());
+    return ok;
+}
+
+bool COutputFilter::LoadPredicate(const nlohmann::json& predicateJson, SColumnPredicate& predicate)
+{
+    if(predicateJson.is_array())
+    {
+        for(const nlohmann::json& value : predicateJson)
+        {
+            if(!value.is_number_unsigned())
+                return false;
+            predicate.mValues.push_back(value.get<std::uint64_t>());
+        }
+        std::sort(predicate.mValues.begin(), predicate.mValues.end());
+        return true;
+    }
+
+    if(!predicateJson.is_object())
+        return false;
+
+    for(const auto& [key, value] : predicateJson.items())
+    {
+        if(!value.is_number_unsigned())
+            return false;
+        if(key == "min")
+            predicate.mMin = value.get<std::uint64_t>();
+        else if(key == "max")
+            predicate.mMax = value.get<std::uint64_t>();
+        else
+            return false;
+    }
+    return predicate.mMin <= predicate.mMax;
+}
+
+bool COutputFilter::Resolve(const std::string& tableName, const std::vector<SColumnDefinition>& columns)
+{
+    auto findColumnIdx = [&columns](const std::string& columnName, std::size_t& columnIdx) -> bool
+    {
+        for(columnIdx = 0; columnIdx < columns.size(); ++columnIdx)
+            if(columns[columnIdx].mName == columnName)
+                return true;
+        return false;
+    };
+
+    bool ok = true;
+    if(mSampleThreshold != std::numeric_limits<std::uint64_t>::max() && !findColumnIdx(mSampleColumnName, mSampleColumnIdx))
+    {
+        std::cout << "Output filter of " << tableName << ": unknown sample column " << mSampleColumnName << std::endl;
+        mSampleThreshold = std::numeric_limits<std::uint64_t>::max();
+        ok = false;
+    }
+
+    for(auto it = mPredicates.begin(); it != mPredicates.end();)
+    {
+        if(findColumnIdx(it->mColumnName, it->mColumnIdx))
+            ++it;
+        else
+        {
+            std::cout << "Output filter of " << tableName << ": unknown column " << it->mColumnName << std::endl;
+            it = mPredicates.erase(it);
+            ok = false;
+        }
+    }
+
+    mIsPassThrough = mIsEnabled && mPredicates.empty() && (mSampleThreshold == std::numeric_limits<std::uint64_t>::max());
+    return ok;
+}
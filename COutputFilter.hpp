@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+#include "IOutputBackend.hpp"
+
+
+
+// decides per row whether it is written. Rows are filtered when they are added
+// to an insert container, so dropped rows are never stored or queued
+class COutputFilter
+{
+private:
+    struct SColumnPredicate
+    {
+        std::string mColumnName;
+        std::size_t mColumnIdx = 0;
+
+        // accepted values, sorted. If empty the range is used
+        std::vector<std::uint64_t> mValues;
+        std::uint64_t mMin = 0;
+        std::uint64_t mMax = std::numeric_limits<std::uint64_t>::max();
+    };
+
+    bool mIsEnabled = true;
+
+    // rows are sampled by the hash of the value of the sample column
+    std::uint64_t mSampleThreshold = std::numeric_limits<std::uint64_t>::max();
+    std::string mSampleColumnName = "id";
+    std::size_t mSampleColumnIdx = 0;
+
+    std::vector<SColumnPredicate> mPredicates;
+
+    bool mIsPassThrough = true;
+
+    static bool LoadPredicate(const nlohmann::json& predicateJson, SColumnPredicate& predicate);
+
+    static inline auto HashValue(std::uint64_t value) -> std::uint64_t
+    {
+        // splitmix64 finalizer
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    template<typename T>
+    static inline auto ToInteger(const T& value) -> std::uint64_t
+    {
+        if constexpr(std::is_integral_v<std::decay_t<T>>)
+            return static_cast<std::uint64_t>(value);
+        else if constexpr(std::is_floating_point_v<std::decay_t<T>>)
+            return static_cast<std::uint64_t>(value);
+        else
+            return 0;
+    }
+
+    template<typename TRow, std::size_t... idxs>
+    static inline auto GetIntegerValue(const TRow& row, const std::size_t columnIdx, std::index_sequence<idxs...>) -> std::uint64_t
+    {
+        std::uint64_t value = 0;
+        ((idxs == columnIdx ? (value = ToInteger(std::get<idxs>(row)), true) : false) || ...);
+        return value;
+    }
+
+public:
+    // reads enabled, sampleRate, sampleColumn and columns, e.g.:
+    // {"sampleRate": 0.01, "columns": {"storageElementId": [1, 2], "startTick": {"min": 0, "max": 86400}}}
+    // returns false for unknown properties and malformed values
+    bool Load(const nlohmann::json& filterJson);
+
+    // maps the column names to the column idxs of the table. Returns false for unknown columns
+    bool Resolve(const std::string& tableName, const std::vector<SColumnDefinition>& columns);
+
+    inline bool IsEnabled() const
+    {return mIsEnabled;}
+    inline bool IsPassThrough() const
+    {return mIsPassThrough;}
+
+    template<typename TRow>
+    inline bool Accept(const TRow& row) const
+    {
+        constexpr auto columnIdxs = std::make_index_sequence<std::tuple_size_v<TRow>>();
+        if(!mIsEnabled)
+            return false;
+
+        if(mSampleThreshold != std::numeric_limits<std::uint64_t>::max())
+            if(HashValue(GetIntegerValue(row, mSampleColumnIdx, columnIdxs)) > mSampleThreshold)
+                return false;
+
+        for(const SColumnPredicate& predicate : mPredicates)
+        {
+            const std::uint64_t value = GetIntegerValue(row, predicate.mColumnIdx, columnIdxs);
+            if(!predicate.mValues.empty())
+            {
+                if(!std::binary_search(predicate.mValues.cbegin(), predicate.mValues.cend(), value))
+                    return false;
+            }
+            else if(value < predicate.mMin || value > predicate.mMax)
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+
+#include "constants.h"
+#include "COutput.hpp"
+
+
+
+// schemas of the output db tables. Rows are added with CTypedInsertStatements<table>::AddRow
+// and have to provide exactly the column types listed here
+namespace tables
+{
+    inline constexpr char sId[] = "id";
+    inline constexpr char sName[] = "name";
+    inline constexpr char sLocationName[] = "locationName";
+    inline constexpr char sCloudName[] = "cloudName";
+    inline constexpr char sSiteId[] = "siteId";
+    inline constexpr char sSrcSiteId[] = "srcSiteId";
+    inline constexpr char sDstSiteId[] = "dstSiteId";
+    inline constexpr char sFileId[] = "fileId";
+    inline constexpr char sStorageElementId[] = "storageElementId";
+    inline constexpr char sSrcReplicaId[] = "srcReplicaId";
+    inline constexpr char sDstReplicaId[] = "dstReplicaId";
+    inline constexpr char sCreatedAt[] = "createdAt";
+    inline constexpr char sExpiredAt[] = "expiredAt";
+    inline constexpr char sFilesize[] = "filesize";
+    inline constexpr char sStartTick[] = "startTick";
+    inline constexpr char sEndTick[] = "endTick";
+    inline constexpr char sBinFloor[] = "binFloor";
+    inline constexpr char sNumTransfers[] = "numTransfers";
+    inline constexpr char sNumFiles[] = "numFiles";
+    inline constexpr char sTraffic[] = "traffic";
+    inline constexpr char sSummedDuration[] = "summedDuration";
+    inline constexpr char sTick[] = "tick";
+    inline constexpr char sStorageCosts[] = "storageCosts";
+    inline constexpr char sNetworkCosts[] = "networkCosts";
+
+
+    inline constexpr char sSitesName[] = "Sites";
+    inline constexpr char sSitesConstraints[] = "PRIMARY KEY(id)";
+    typedef CTable<sSitesName, sSitesConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sName, std::string>,
+                   SColumn<sLocationName, std::string>,
+                   SColumn<sCloudName, std::string>> CSitesTable;
+
+    inline constexpr char sStorageElementsName[] = "StorageElements";
+    inline constexpr char sStorageElementsConstraints[] = "PRIMARY KEY(id), FOREIGN KEY(siteId) REFERENCES Sites(id)";
+    typedef CTable<sStorageElementsName, sStorageElementsConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sSiteId, IdType>,
+                   SColumn<sName, std::string>> CStorageElementsTable;
+
+    inline constexpr char sLinkSelectorsName[] = "LinkSelectors";
+    inline constexpr char sLinkSelectorsConstraints[] = "PRIMARY KEY(id), FOREIGN KEY(srcSiteId) REFERENCES Sites(id), FOREIGN KEY(dstSiteId) REFERENCES Sites(id)";
+    typedef CTable<sLinkSelectorsName, sLinkSelectorsConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sSrcSiteId, IdType>,
+                   SColumn<sDstSiteId, IdType>> CLinkSelectorsTable;
+
+    inline constexpr char sFilesName[] = "Files";
+    inline constexpr char sFilesConstraints[] = "PRIMARY KEY(id)";
+    typedef CTable<sFilesName, sFilesConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sCreatedAt, TickType>,
+                   SColumn<sExpiredAt, TickType>,
+                   SColumn<sFilesize, std::uint32_t>> CFilesTable;
+
+    inline constexpr char sReplicasName[] = "Replicas";
+    inline constexpr char sReplicasConstraints[] = "PRIMARY KEY(id), FOREIGN KEY(fileId) REFERENCES Files(id), FOREIGN KEY(storageElementId) REFERENCES StorageElements(id)";
+    typedef CTable<sReplicasName, sReplicasConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sFileId, IdType>,
+                   SColumn<sStorageElementId, IdType>,
+                   SColumn<sCreatedAt, TickType>,
+                   SColumn<sExpiredAt, TickType>> CReplicasTable;
+
+    inline constexpr char sTransfersName[] = "Transfers";
+    inline constexpr char sTransfersConstraints[] = "PRIMARY KEY(id), FOREIGN KEY(srcReplicaId) REFERENCES Replicas(id), FOREIGN KEY(dstReplicaId) REFERENCES Replicas(id)";
+    typedef CTable<sTransfersName, sTransfersConstraints,
+                   SColumn<sId, IdType>,
+                   SColumn<sSrcReplicaId, IdType>,
+                   SColumn<sDstReplicaId, IdType>,
+                   SColumn<sStartTick, TickType>,
+                   SColumn<sEndTick, TickType>> CTransfersTable;
+
+    // costs of each region in CHF accrued in the interval that ends at tick. Written by CBillingGenerator
+    inline constexpr char sCloudCostsName[] = "CloudCosts";
+    inline constexpr char sCloudCostsConstraints[] = "PRIMARY KEY(tick, siteId), FOREIGN KEY(siteId) REFERENCES Sites(id)";
+    typedef CTable<sCloudCostsName, sCloudCostsConstraints,
+                   SColumn<sTick, TickType>,
+                   SColumn<sSiteId, IdType>,
+                   SColumn<sStorageCosts, double>,
+                   SColumn<sNetworkCosts, double>,
+                   SColumn<sTraffic, std::uint64_t>,
+                   SColumn<sNumTransfers, std::uint64_t>> CCloudCostsTable;
+
+
+    // aggregates written by COutputAggregator
+    inline constexpr char sTransferAggregatesName[] = "TransferAggregates";
+    inline constexpr char sTransferAggregatesConstraints[] = "PRIMARY KEY(startTick, storageElementId), FOREIGN KEY(storageElementId) REFERENCES StorageElements(id)";
+    typedef CTable<sTransferAggregatesName, sTransferAggregatesConstraints,
+                   SColumn<sStartTick, TickType>,
+                   SColumn<sStorageElementId, IdType>,
+                   SColumn<sNumTransfers, std::uint64_t>,
+                   SColumn<sTraffic, std::uint64_t>,
+                   SColumn<sSummedDuration, std::uint64_t>> CTransferAggregatesTable;
+
+    inline constexpr char sTransferDurationHistoName[] = "TransferDurationHisto";
+    inline constexpr char sHistoConstraints[] = "PRIMARY KEY(binFloor)";
+    typedef CTable<sTransferDurationHistoName, sHistoConstraints,
+                   SColumn<sBinFloor, TickType>,
+                   SColumn<sNumTransfers, std::uint64_t>> CTransferDurationHistoTable;
+
+    inline constexpr char sFilesizeHistoName[] = "FilesizeHisto";
+    typedef CTable<sFilesizeHistoName, sHistoConstraints,
+                   SColumn<sBinFloor, std::uint64_t>,
+                   SColumn<sNumFiles, std::uint64_t>> CFilesizeHistoTable;
+}
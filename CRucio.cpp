@@ -4,6 +4,7 @@
 
 #include "json.hpp"
 
+#include "CFilePopularity.hpp"
 #include "CLinkSelector.hpp"
 #include "CRucio.hpp"
 #include "CStorageElement.hpp"
@@ -55,8 +56,9 @@ auto CRucio::RunReaper(const TickType now) -> std::size_t
         return 0;
 
     std::unique_ptr<std::thread> threads[numThreads];
+    std::vector<std::size_t> removedPopularityRanks[numThreads];
 
-    auto worker = [now, numThreads](std::size_t tIdx, std::vector<std::unique_ptr<SFile>>* files) {
+    auto worker = [now, numThreads, &removedPopularityRanks](std::size_t tIdx, std::vector<std::unique_ptr<SFile>>* files) {
         const float numElementsPerThread = files->size() / static_cast<float>(numThreads);
         const std::size_t lastIdx = numElementsPerThread * (tIdx + 1);
         for(std::size_t i = numElementsPerThread * tIdx; i < lastIdx; ++i)
@@ -64,6 +66,8 @@ auto CRucio::RunReaper(const TickType now) -> std::size_t
             std::unique_ptr<SFile>& curFile = (*files)[i];
             if(curFile->mExpiresAt <= now)
             {
+                if(curFile->mPopularityRank != std::numeric_limits<std::size_t>::max())
+                    removedPopularityRanks[tIdx].push_back(curFile->mPopularityRank);
                 curFile->Remove(now);
                 curFile.reset(nullptr);
             }
@@ -77,6 +81,13 @@ auto CRucio::RunReaper(const TickType now) -> std::size_t
     for (std::size_t i=0; i<numThreads; ++i)
         threads[i]->join();
 
+    if(mFilePopularity)
+    {
+        for (std::size_t i=1; i<numThreads; ++i)
+            removedPopularityRanks[0].insert(removedPopularityRanks[0].end(), removedPopularityRanks[i].begin(), removedPopularityRanks[i].end());
+        mFilePopularity->RemoveFiles(removedPopularityRanks[0]);
+    }
+
 
     std::size_t frontIdx = 0;
     std::size_t backIdx = numFiles - 1;
@@ -119,72 +130,52 @@ bool CRucio::TryConsumeConfig(const json& json)
         {
             for(const auto& siteJson : value)
             {
-                std::unique_ptr<std::uint32_t> multiLocationIdx;
-                std::string siteName, siteLocation;
-                nlohmann::json storageElementsJson;
+                SSiteConfig siteConfig;
                 for(const auto& [siteJsonKey, siteJsonValue] : siteJson.items())
-                {
-                    if(siteJsonKey == "multiLocationIdx")
-                        multiLocationIdx = std::make_unique<std::uint32_t>(siteJsonValue.get<std::uint32_t>());
-                    else if(siteJsonKey == "name")
-                        siteName = siteJsonValue.get<std::string>();
-                    else if(siteJsonKey == "location")
-                        siteLocation = siteJsonValue.get<std::string>();
-                    else if(siteJsonKey == "storageElements")
-                        storageElementsJson = siteJsonValue;
-                    else
-                        std::cout << "Ignoring unknown attribute while loading sites: " << siteJsonKey << std::endl;
-                }
-
-                if(multiLocationIdx == nullptr)
-                {
-                    std::cout << "Couldn't find multiLocationIdx attribute of site" << std::endl;
-                    continue;
-                }
-
-                if (siteName.empty())
-                {
-                    std::cout << "Couldn't find name attribute of site" << std::endl;
-                    continue;
-                }
-
-                if (siteLocation.empty())
-                {
-                    std::cout << "Couldn't find location attribute of site: " << siteName << std::endl;
-                    continue;
-                }
-
-                std::cout << "Adding site " << siteName << " in " << siteLocation << std::endl;
-                CGridSite *site = CreateGridSite(*multiLocationIdx, std::move(siteName), std::move(siteLocation));
-
-                if (storageElementsJson.empty())
-                {
-                    std::cout << "No storage elements to create for this site" << std::endl;
-                    continue;
-                }
-
-                for(const auto& storageElementJson : storageElementsJson)
-                {
-                    std::string storageElementName;
-                    for(const auto& [storageElementJsonKey, storageElementJsonValue] : storageElementJson.items())
-                    {
-                        if(storageElementJsonKey == "name")
-                            storageElementName = storageElementJsonValue.get<std::string>();
-                        else
-                            std::cout << "Ignoring unknown attribute while loading StorageElements: " << storageElementJsonKey << std::endl;
-                    }
-
-                    if (storageElementName.empty())
-                    {
-                        std::cout << "Couldn't find name attribute of StorageElement" << std::endl;
-                        continue;
-                    }
-
-                    std::cout << "Adding StorageElement " << storageElementName << std::endl;
-                    site->CreateStorageElement(std::move(storageElementName));
-                }
+                    siteConfig.SetAttribute(siteJsonKey, siteJsonValue);
+                TryConsumeSiteConfig("rucio", siteConfig);
             }
         }
     }
     return true;
 }
+
+bool CRucio::TryConsumeSiteConfig(const std::string& rootKey, SSiteConfig& siteConfig)
+{
+    if(rootKey != "rucio")
+        return false;
+
+    if(siteConfig.mMultiLocationIdx == nullptr)
+    {
+        std::cout << "Couldn't find multiLocationIdx attribute of site" << std::endl;
+        return true;
+    }
+
+    if (siteConfig.mName.empty())
+    {
+        std::cout << "Couldn't find name attribute of site" << std::endl;
+        return true;
+    }
+
+    if (siteConfig.mLocationName.empty())
+    {
+        std::cout << "Couldn't find location attribute of site: " << siteConfig.mName << std::endl;
+        return true;
+    }
+
+    std::cout << "Adding site " << siteConfig.mName << " in " << siteConfig.mLocationName << std::endl;
+    CGridSite *site = CreateGridSite(*siteConfig.mMultiLocationIdx, std::move(siteConfig.mName), std::move(siteConfig.mLocationName));
+
+    if (siteConfig.mStorageElementNames.empty())
+    {
+        std::cout << "No storage elements to create for this site" << std::endl;
+        return true;
+    }
+
+    for(std::string& storageElementName : siteConfig.mStorageElementNames)
+    {
+        std::cout << "Adding StorageElement " << storageElementName << std::endl;
+        site->CreateStorageElement(std::move(storageElementName));
+    }
+    return true;
+}
@@ -9,6 +9,7 @@
 #include "IConfigConsumer.hpp"
 #include "ISite.hpp"
 
+class CZipfFilePopularity;
 struct SFile;
 
 
@@ -34,6 +35,9 @@ public:
     std::vector<std::unique_ptr<SFile>> mFiles;
     std::vector<std::unique_ptr<CGridSite>> mGridSites;
 
+    // optional. Files are ranked by the data generator and removed by the reaper
+    std::shared_ptr<CZipfFilePopularity> mFilePopularity;
+
     CRucio();
     ~CRucio();
 
@@ -42,4 +46,5 @@ public:
     auto RunReaper(const TickType now) -> std::size_t;
 
     bool TryConsumeConfig(const nlohmann::json& json) final;
+    bool TryConsumeSiteConfig(const std::string& rootKey, SSiteConfig& siteConfig) final;
 };
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "constants.h"
+#include "COutput.hpp"
+#include "CSQLiteOutputBackend.hpp"
+
+
+
+CSQLiteOutputBackend::~CSQLiteOutputBackend()
+{
+    Close();
+}
+
+void CSQLiteOutputBackend::LogCallback(void* dat, int errorCode, const char* errorMessage)
+{
+    (void)dat;
+    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::stringstream timeStr;
+    timeStr << std::put_time(std::localtime(&now), "%y%j_%H%M%S");
+#ifdef STATIC_DB_LOG_NAME
+    static std::ofstream sqliteLog(STATIC_DB_LOG_NAME);
+#else
+    static std::ofstream sqliteLog(timeStr.str() + ".log");
+#endif
+    sqliteLog << "[" << timeStr.str() << "] - " << errorCode << ": " << errorMessage << std::endl;
+}
+
+void CSQLiteOutputBackend::SetSegmentNumRows(const std::size_t segmentNumRows)
+{
+    assert(mDB == nullptr);
+    mSegmentNumRows = segmentNumRows;
+}
+
+bool CSQLiteOutputBackend::Open(const std::filesystem::path& dbFilePath, bool keepInMemory)
+{
+    assert(mDB == nullptr);
+
+    static const bool isLogConfigured = (sqlite3_config(SQLITE_CONFIG_LOG, CSQLiteOutputBackend::LogCallback, nullptr) == SQLITE_OK);
+    if(!isLogConfigured)
+        return false;
+
+    if(keepInMemory)
+    {
+        mDBFilePath = dbFilePath;
+        sqlite3_open_v2(":memory:", &mDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    }
+    else
+        sqlite3_open_v2(dbFilePath.c_str(), &mDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+
+    if(mDB == nullptr)
+        return false;
+
+    if(!mDBFilePath.empty() && mSegmentNumRows > 0)
+    {
+        // same as the backup, which replaces the content of an existing file
+        std::error_code error;
+        if(std::filesystem::remove(mDBFilePath, error))
+            std::cout << "Replacing existing output file " << mDBFilePath << std::endl;
+
+        mIsDiskDBAttached = Exec("ATTACH DATABASE " + QuoteString(mDBFilePath.string()) + " AS disk;");
+        if(!mIsDiskDBAttached)
+            return false;
+    }
+
+    return true;
+}
+
+bool CSQLiteOutputBackend::SetPragma(const std::string& name, const std::string& value)
+{
+    bool ok = Exec("PRAGMA " + name + " = " + value + ";");
+    if(mIsDiskDBAttached)
+        ok = Exec("PRAGMA disk." + name + " = " + value + ";") && ok;
+    return ok;
+}
+
+void CSQLiteOutputBackend::SetNumRowsPerInsert(const std::size_t numRowsPerInsert)
+{
+    mNumRowsPerInsert = std::max<std::size_t>(numRowsPerInsert, 1);
+}
+
+auto CSQLiteOutputBackend::PrepareStatement(const std::string& statementString) -> sqlite3_stmt*
+{
+    sqlite3_stmt* preparedStatement = nullptr;
+    sqlite3_prepare_v3(mDB, statementString.c_str(), statementString.size() + 1, SQLITE_PREPARE_PERSISTENT, &preparedStatement, nullptr);
+    assert(preparedStatement != nullptr);
+    return preparedStatement;
+}
+
+bool SPreparedInsert::Step(sqlite3_stmt* const statement, const std::size_t numRows)
+{
+    const int errorCode = sqlite3_step(statement);
+    sqlite3_reset(statement);
+    if(errorCode == SQLITE_DONE)
+        return true;
+
+    std::cout << "SQLite error " << errorCode << " (" << sqlite3_errmsg(sqlite3_db_handle(statement)) << ") dropped " << numRows << " rows inserting with: " << std::string(sqlite3_sql(statement)).substr(0, 256) << std::endl;
+    return false;
+}
+
+bool CSQLiteOutputBackend::Exec(const std::string& statements)
+{
+    char* errorMessage = nullptr;
+    const int errorCode = sqlite3_exec(mDB, statements.c_str(), nullptr, nullptr, &errorMessage);
+    if(errorCode == SQLITE_OK)
+        return true;
+
+    std::cout << "SQLite error " << errorCode << " (" << (errorMessage ? errorMessage : sqlite3_errstr(errorCode)) << ") executing: " << statements.substr(0, 256) << std::endl;
+    sqlite3_free(errorMessage);
+    return false;
+}
+
+void CSQLiteOutputBackend::Rollback()
+{
+    if(sqlite3_get_autocommit(mDB) == 0)
+        Exec("ROLLBACK;");
+}
+
+bool CSQLiteOutputBackend::CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints)
+{
+    std::string str = "CREATE TABLE " + tableName + "(";
+    for(const SColumnDefinition& column : columns)
+        str += column.mName + " " + column.mSQLType + ", ";
+    if(constraints.empty())
+        str.resize(str.size() - 2);
+    str += constraints + ");";
+
+    if(!Exec(str))
+        return false;
+    if(mIsDiskDBAttached)
+    {
+        str.insert(std::string("CREATE TABLE ").size(), "disk.");
+        if(!Exec(str))
+            return false;
+    }
+    mTableNameToNumColumns[tableName] = columns.size();
+    return true;
+}
+
+auto CSQLiteOutputBackend::AddInsertStatement(const std::string& tableName) -> std::size_t
+{
+    const auto result = mTableNameToNumColumns.find(tableName);
+    assert(result != mTableNameToNumColumns.cend());
+    const std::size_t numColumns = result->second;
+
+    SPreparedInsert preparedInsert;
+    const std::size_t maxNumRowsPerInsert = static_cast<std::size_t>(sqlite3_limit(mDB, SQLITE_LIMIT_VARIABLE_NUMBER, -1)) / numColumns;
+    preparedInsert.mNumRowsPerMultiRowStatement = std::min(mNumRowsPerInsert, maxNumRowsPerInsert);
+
+    mPreparedStatements.emplace_back(preparedInsert);
+    mPreparedStatementTableNames.push_back(tableName);
+    return (mPreparedStatements.size() - 1);
+}
+
+void CSQLiteOutputBackend::PrepareInsert(const std::size_t insertStatementIdx)
+{
+    SPreparedInsert& preparedInsert = mPreparedStatements[insertStatementIdx];
+    const std::string& tableName = mPreparedStatementTableNames[insertStatementIdx];
+    const std::size_t numColumns = mTableNameToNumColumns[tableName];
+
+    preparedInsert.mStatement = PrepareStatement(GetInsertSQL(tableName, numColumns));
+    if(preparedInsert.mNumRowsPerMultiRowStatement > 1)
+        preparedInsert.mMultiRowStatement = PrepareStatement(GetInsertSQL(tableName, numColumns, preparedInsert.mNumRowsPerMultiRowStatement));
+    else
+        preparedInsert.mNumRowsPerMultiRowStatement = 1;
+}
+
+bool CSQLiteOutputBackend::InsertRow(const std::string& tableName, const std::string& row)
+{
+    return Exec("INSERT INTO main." + tableName + " VALUES (" + row + ");");
+}
+
+auto CSQLiteOutputBackend::Insert(const std::size_t insertStatementIdx, IInsertValuesContainer& values) -> std::size_t
+{
+    assert(insertStatementIdx < mPreparedStatements.size());
+    if(mPreparedStatements[insertStatementIdx].mStatement == nullptr)
+        PrepareInsert(insertStatementIdx);
+    const std::size_t numInserted = values.BindAndInsert(mPreparedStatements[insertStatementIdx]);
+    mNumRowsCurSegment += numInserted;
+    return numInserted;
+}
+
+void CSQLiteOutputBackend::BeginTransaction()
+{
+    Exec("BEGIN TRANSACTION;");
+}
+
+void CSQLiteOutputBackend::EndTransaction()
+{
+    if(!Exec("END TRANSACTION;"))
+        Rollback();
+    if(mIsDiskDBAttached && mNumRowsCurSegment >= mSegmentNumRows)
+        FlushSegment();
+}
+
+bool CSQLiteOutputBackend::FlushSegment()
+{
+    assert(mIsDiskDBAttached);
+
+    std::string str = "BEGIN TRANSACTION;";
+    for(const auto& [tableName, numColumns] : mTableNameToNumColumns)
+    {
+        (void)numColumns;
+        str += "INSERT INTO disk." + tableName + " SELECT * FROM main." + tableName + ";";
+        str += "DELETE FROM main." + tableName + ";";
+    }
+    str += "END TRANSACTION;";
+
+    // on failure the rows stay in the in-memory db and are moved with the next segment
+    if(!Exec(str))
+    {
+        Rollback();
+        return false;
+    }
+    mNumRowsCurSegment = 0;
+    return true;
+}
+
+bool CSQLiteOutputBackend::BackupToDisk()
+{
+    assert(!mDBFilePath.empty());
+
+    sqlite3* diskDB;
+    int ok = sqlite3_open(mDBFilePath.c_str(), &diskDB);
+    if (ok == SQLITE_OK)
+    {
+        sqlite3_backup* backup = sqlite3_backup_init(diskDB, "main", mDB, "main");
+        if (backup)
+        {
+            sqlite3_backup_step(backup, -1);
+            ok = sqlite3_backup_finish(backup);
+        }
+        else
+            ok = sqlite3_errcode(diskDB);
+    }
+    if (ok != SQLITE_OK)
+        std::cout << "SQLite error " << ok << " (" << sqlite3_errstr(ok) << ") copying the db to " << mDBFilePath << std::endl;
+    sqlite3_close(diskDB);
+    return (ok == SQLITE_OK);
+}
+
+bool CSQLiteOutputBackend::MoveToDisk()
+{
+    FinalizeStatements();
+    if(!BackupToDisk())
+        return false;
+
+    sqlite3_close(mDB);
+    mDB = nullptr;
+    sqlite3_open_v2(mDBFilePath.c_str(), &mDB, SQLITE_OPEN_READWRITE, nullptr);
+    mDBFilePath.clear();
+    return (mDB != nullptr);
+}
+
+void CSQLiteOutputBackend::FinalizeStatements()
+{
+    while(!mPreparedStatements.empty())
+    {
+        sqlite3_finalize(mPreparedStatements.back().mStatement);
+        sqlite3_finalize(mPreparedStatements.back().mMultiRowStatement);
+        mPreparedStatements.pop_back();
+    }
+    mPreparedStatementTableNames.clear();
+}
+
+bool CSQLiteOutputBackend::MergeShard(const std::filesystem::path& shardFilePath, const std::vector<std::string>& tableNames)
+{
+    // the shard rows go straight to the disk db, so merging does not load them into memory
+    std::string dstDBName = "main";
+    if(mIsDiskDBAttached)
+        dstDBName = "disk";
+    else if(!mDBFilePath.empty() && !MoveToDisk())
+        return false;
+
+    if(!Exec("ATTACH DATABASE " + QuoteString(shardFilePath.string()) + " AS shard;"))
+        return false;
+
+    std::string str = "BEGIN TRANSACTION;";
+    for(const std::string& tableName : tableNames)
+        str += "INSERT INTO " + dstDBName + "." + tableName + " SELECT * FROM shard." + tableName + ";";
+    str += "END TRANSACTION;";
+    bool ok = Exec(str);
+    if(!ok)
+        Rollback();
+
+    ok = Exec("DETACH DATABASE shard;") && ok;
+    return ok;
+}
+
+void CSQLiteOutputBackend::Close()
+{
+    FinalizeStatements();
+
+    if(mDB != nullptr)
+    {
+        if(mIsDiskDBAttached)
+        {
+            if(!FlushSegment())
+                std::cout << "Failed moving the last segment to " << mDBFilePath << std::endl;
+            Exec("DETACH DATABASE disk;");
+            mIsDiskDBAttached = false;
+        }
+        else if (!mDBFilePath.empty())
+            BackupToDisk();
+        sqlite3_close(mDB);
+        mDB = nullptr;
+    }
+}
+
+auto CSQLiteOutputBackend::QuoteString(const std::string& str) -> std::string
+{
+    std::string quoted = "'";
+    for(const char c : str)
+    {
+        quoted += c;
+        if(c == '\'')
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+auto CSQLiteOutputBackend::GetInsertSQL(const std::string& tableName, const std::size_t numColumns, const std::size_t numRows) -> std::string
+{
+    std::string placeholders = "(?";
+    for(std::size_t i = 1; i < numColumns; ++i)
+        placeholders += ", ?";
+    placeholders += ")";
+
+    std::string sql = "INSERT INTO " + tableName + " VALUES" + placeholders;
+    for(std::size_t i = 1; i < numRows; ++i)
+        sql += "," + placeholders;
+    return sql + ";";
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sqlite3.h"
+
+#include "IOutputBackend.hpp"
+
+
+
+struct SPreparedInsert
+{
+    sqlite3_stmt* mStatement = nullptr;
+
+    // inserts mNumRowsPerMultiRowStatement rows per step, nullptr if not available
+    sqlite3_stmt* mMultiRowStatement = nullptr;
+    std::size_t mNumRowsPerMultiRowStatement = 1;
+
+    // steps and resets a bound insert statement. A failed step is reported with the number of rows it dropped
+    static bool Step(sqlite3_stmt* const statement, const std::size_t numRows);
+};
+
+
+class CSQLiteOutputBackend : public IOutputBackend
+{
+private:
+    sqlite3* mDB = nullptr;
+
+    // the statements are prepared on their first use. Creating a table changes the schema, so
+    // statements prepared before the last table was created would fail once and be re-prepared
+    std::vector<SPreparedInsert> mPreparedStatements;
+    std::vector<std::string> mPreparedStatementTableNames;
+    std::unordered_map<std::string, std::size_t> mTableNameToNumColumns;
+
+    // if not empty the db is kept in memory and persisted to this path
+    std::filesystem::path mDBFilePath;
+
+    // if > 0 the in-memory rows are moved to the attached disk db whenever a
+    // segment of this many rows was inserted. 0 copies the whole db when closing
+    std::size_t mSegmentNumRows = 1 << 18;
+    std::size_t mNumRowsCurSegment = 0;
+    bool mIsDiskDBAttached = false;
+
+    std::size_t mNumRowsPerInsert = 1;
+
+    auto PrepareStatement(const std::string& statementString) -> sqlite3_stmt*;
+    void PrepareInsert(const std::size_t insertStatementIdx);
+
+    // executes the statements and reports a failure with its error code
+    bool Exec(const std::string& statements);
+
+    // rolls back the transaction that is still open after a failed Exec()
+    void Rollback();
+
+    // moves the rows of all tables to the disk db. Must not be called within a transaction
+    bool FlushSegment();
+
+    // copies the whole in-memory db to mDBFilePath
+    bool BackupToDisk();
+
+    // copies the in-memory db to mDBFilePath and continues on that file. Finalizes all prepared statements
+    bool MoveToDisk();
+
+    void FinalizeStatements();
+
+public:
+    CSQLiteOutputBackend() = default;
+    ~CSQLiteOutputBackend();
+
+    CSQLiteOutputBackend(const CSQLiteOutputBackend&) = delete;
+    CSQLiteOutputBackend& operator=(const CSQLiteOutputBackend&) = delete;
+
+    static void LogCallback(void* data, int errorCode, const char* errorMessage);
+
+    // must be called before Open()
+    void SetSegmentNumRows(const std::size_t segmentNumRows);
+
+    bool Open(const std::filesystem::path& dbFilePath, bool keepInMemory);
+
+    bool SetPragma(const std::string& name, const std::string& value);
+
+    // number of rows inserted per step by a multi row statement. Only affects tables created afterwards
+    void SetNumRowsPerInsert(const std::size_t numRowsPerInsert);
+
+    bool CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints) final;
+    auto AddInsertStatement(const std::string& tableName) -> std::size_t final;
+    bool InsertRow(const std::string& tableName, const std::string& row) final;
+
+    auto Insert(const std::size_t insertStatementIdx, IInsertValuesContainer& values) -> std::size_t final;
+
+    void BeginTransaction() final;
+    void EndTransaction() final;
+
+    bool MergeShard(const std::filesystem::path& shardFilePath, const std::vector<std::string>& tableNames) final;
+
+    void Close() final;
+
+    static auto QuoteString(const std::string& str) -> std::string;
+    static auto GetInsertSQL(const std::string& tableName, const std::size_t numColumns, const std::size_t numRows=1) -> std::string;
+};
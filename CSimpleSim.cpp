@@ -1,5 +1,4 @@
 #include <cassert>
-#include <sstream>
 
 #include "sqlite3.h"
 
@@ -9,49 +8,40 @@
 #include "CRucio.hpp"
 #include "CSimpleSim.hpp"
 #include "COutput.hpp"
+#include "COutputTables.hpp"
 #include "CommonScheduleables.hpp"
 
 
 
-void CSimpleSim::SetupDefaults()
+bool CSimpleSim::SetupDefaults(const nlohmann::json& profileJson)
 {
+    (void)profileJson;
+
     COutput& output = COutput::GetRef();
     CConfigLoader& config = CConfigLoader::GetRef();
     ////////////////////////////
     // init output db
     ////////////////////////////
-    std::stringstream columns;
     bool ok = false;
 
-    ok = output.CreateTable("Sites", "id BIGINT PRIMARY KEY, name varchar(64), locationName varchar(64)");
+    ok = output.CreateTable<tables::CSitesTable>();
     assert(ok);
 
-    ok = output.CreateTable("StorageElements", "id BIGINT PRIMARY KEY, siteId BIGINT, name varchar(64), FOREIGN KEY(siteId) REFERENCES Sites(id)");
+    ok = output.CreateTable<tables::CStorageElementsTable>();
     assert(ok);
 
-    ok = output.CreateTable("LinkSelectors", "id BIGINT PRIMARY KEY, srcSiteId BIGINT, dstSiteId BIGINT, FOREIGN KEY(srcSiteId) REFERENCES Sites(id), FOREIGN KEY(dstSiteId) REFERENCES Sites(id)");
+    ok = output.CreateTable<tables::CLinkSelectorsTable>();
     assert(ok);
 
-    ok = output.CreateTable("Files", "id BIGINT PRIMARY KEY, createdAt BIGINT, lifetime BIGINT, filesize INTEGER");
+    ok = output.CreateTable<tables::CFilesTable>();
     assert(ok);
 
-    ok = output.CreateTable("Replicas", "fileId BIGINT, storageElementId BIGINT, PRIMARY KEY(fileId, storageElementId)");
+    ok = output.CreateTable<tables::CReplicasTable>();
     assert(ok);
 
-    columns << "id BIGINT PRIMARY KEY,"
-            << "fileId BIGINT,"
-            << "srcStorageElementId BIGINT,"
-            << "dstStorageElementId BIGINT,"
-            << "startTick BIGINT,"
-            << "endTick BIGINT,"
-            << "FOREIGN KEY(fileId) REFERENCES Files(id),"
-            << "FOREIGN KEY(srcStorageElementId) REFERENCES StorageElements(id),"
-            << "FOREIGN KEY(dstStorageElementId) REFERENCES StorageElements(id)";
-    ok = output.CreateTable("Transfers", columns.str());
+    ok = output.CreateTable<tables::CTransfersTable>();
     assert(ok);
 
-    CStorageElement::mOutputQueryIdx = output.AddPreparedSQLStatement("INSERT INTO Replicas VALUES(?, ?);");
-
 
     ////////////////////////////
     // setup grid and clouds
@@ -106,12 +96,12 @@ void CSimpleSim::SetupDefaults()
 
     //auto heartbeat = std::make_shared<CHeartbeat>(this, g2cTransferMgr, c2cTransferMgr, static_cast<std::uint32_t>(SECONDS_PER_DAY), static_cast<TickType>(SECONDS_PER_DAY));
     auto heartbeat = std::make_shared<CHeartbeat>(this, nullptr, c2cTransferMgr, static_cast<std::uint32_t>(SECONDS_PER_DAY), static_cast<TickType>(SECONDS_PER_DAY));
-    heartbeat->mProccessDurations["DataGen"] = &(dataGen->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["G2CTransferUpdate"] = &(g2cTransferMgr->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["G2CTransferGen"] = &(g2cTransferGen->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["C2CTransferUpdate"] = &(c2cTransferMgr->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["C2CTransferGen"] = &(c2cTransferGen->mUpdateDurationSummed);
-    heartbeat->mProccessDurations["Reaper"] = &(reaper->mUpdateDurationSummed);
+    heartbeat->mProccessDurations["DataGen"] = dataGen;
+    heartbeat->mProccessDurations["G2CTransferUpdate"] = g2cTransferMgr;
+    heartbeat->mProccessDurations["G2CTransferGen"] = g2cTransferGen;
+    heartbeat->mProccessDurations["C2CTransferUpdate"] = c2cTransferMgr;
+    heartbeat->mProccessDurations["C2CTransferGen"] = c2cTransferGen;
+    heartbeat->mProccessDurations["Reaper"] = reaper;
 
     for(const std::unique_ptr<ISite>& cloudSite : mClouds[0]->mRegions)
     {
@@ -133,4 +123,5 @@ void CSimpleSim::SetupDefaults()
     mSchedule.push(c2cTransferMgr);
     mSchedule.push(c2cTransferGen);
     mSchedule.push(heartbeat);
+    return true;
 }
@@ -5,5 +5,5 @@
 class CSimpleSim : public IBaseSim
 {
 public:
-    void SetupDefaults() override;
+    bool SetupDefaults(const nlohmann::json& profileJson) override;
 };
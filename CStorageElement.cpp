@@ -2,15 +2,11 @@
 
 #include "ISite.hpp"
 
-#include "COutput.hpp"
 #include "CStorageElement.hpp"
 #include "SFile.hpp"
 
 
 
-std::size_t CStorageElement::mOutputQueryIdx = 0;
-
-
 CStorageElement::CStorageElement(std::string&& name, ISite* const site)
 	: mId(GetNewId()),
       mName(std::move(name)),
@@ -27,6 +23,8 @@ auto CStorageElement::CreateReplica(SFile* const file) -> std::shared_ptr<SRepli
     auto newReplica = std::make_shared<SReplica>(file, this, mReplicas.size());
     file->mReplicas.emplace_back(newReplica);
     mReplicas.emplace_back(newReplica);
+    if(newReplica->IsComplete())
+        newReplica->mCompletionIdx = ++(file->mNumReplicaCompletions);
 
     return newReplica;
 }
@@ -17,8 +17,6 @@ struct SReplica;
 class CStorageElement
 {
 public:
-    static std::size_t mOutputQueryIdx;
-
 	CStorageElement(std::string&& name, ISite* const site);
     CStorageElement(CStorageElement&&) = default;
     CStorageElement& operator=(CStorageElement&&) = default;
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json.hpp"
+
+#include "IBaseCloud.hpp"
+#include "ISite.hpp"
+
+#include "CCloudGCP.hpp"
+#include "CRucio.hpp"
+#include "CStorageElement.hpp"
+#include "CTopologyCache.hpp"
+
+
+
+CTopologyCache::~CTopologyCache()
+{
+    Close();
+}
+
+void CTopologyCache::Close()
+{
+    if(mData != nullptr)
+        munmap(const_cast<unsigned char*>(mData), mDataSize);
+    if(mFileDescriptor >= 0)
+        close(mFileDescriptor);
+    mFileDescriptor = -1;
+    mData = nullptr;
+    mDataSize = 0;
+    mHeader = nullptr;
+}
+
+auto CTopologyCache::GetString(const std::uint32_t offset) const -> std::string
+{
+    const unsigned char* const str = mData + mHeader->mStringTableOffset + offset;
+    std::uint32_t length;
+    std::memcpy(&length, str, sizeof(length));
+    return std::string(reinterpret_cast<const char*>(str + sizeof(length)), length);
+}
+
+bool CTopologyCache::IsValid() const
+{
+    const STopologyCacheHeader& header = *mHeader;
+    if(std::strncmp(header.mMagic, TOPOLOGY_CACHE_MAGIC, sizeof(header.mMagic)) != 0 || header.mVersion != TOPOLOGY_CACHE_VERSION)
+        return false;
+
+    const std::uint64_t stringTableOffset = sizeof(STopologyCacheHeader)
+                                          + (header.mNumSourceFiles * sizeof(STopologySourceFile))
+                                          + (header.mNumSites * sizeof(STopologySiteRecord))
+                                          + (header.mNumStorageElements * sizeof(std::uint32_t))
+                                          + (header.mNumConfigs * sizeof(std::uint32_t));
+    if(header.mStringTableOffset != stringTableOffset || (header.mStringTableOffset + header.mStringTableSize) != mDataSize)
+        return false;
+
+    auto IsValidString = [&header, this](const std::uint32_t offset) -> bool
+    {
+        if((static_cast<std::uint64_t>(offset) + sizeof(std::uint32_t)) > header.mStringTableSize)
+            return false;
+        std::uint32_t length;
+        std::memcpy(&length, mData + header.mStringTableOffset + offset, sizeof(length));
+        return (offset + sizeof(length) + length) <= header.mStringTableSize;
+    };
+
+    const auto* const sourceFiles = reinterpret_cast<const STopologySourceFile*>(mData + sizeof(STopologyCacheHeader));
+    for(std::uint32_t i = 0; i < header.mNumSourceFiles; ++i)
+    {
+        if(!IsValidString(sourceFiles[i].mPathOffset))
+            return false;
+        std::uint64_t contentHash;
+        const std::string sourceFilePath = GetString(sourceFiles[i].mPathOffset);
+        if(!HashFile(sourceFilePath, contentHash) || contentHash != sourceFiles[i].mContentHash)
+        {
+            std::cout << "Topology source file changed: " << sourceFilePath << std::endl;
+            return false;
+        }
+    }
+
+    const auto* const sites = reinterpret_cast<const STopologySiteRecord*>(sourceFiles + header.mNumSourceFiles);
+    std::uint64_t numStorageElements = 0;
+    for(std::uint32_t i = 0; i < header.mNumSites; ++i)
+    {
+        const STopologySiteRecord& site = sites[i];
+        if(site.mType > STopologySiteRecord::eCloudRegion || !IsValidString(site.mNameOffset)
+           || !IsValidString(site.mLocationNameOffset) || !IsValidString(site.mSKUIdOffset))
+            return false;
+        numStorageElements += site.mNumStorageElements;
+    }
+    if(numStorageElements != header.mNumStorageElements)
+        return false;
+
+    const auto* const storageElementNameOffsets = reinterpret_cast<const std::uint32_t*>(sites + header.mNumSites);
+    for(std::uint32_t i = 0; i < header.mNumStorageElements; ++i)
+        if(!IsValidString(storageElementNameOffsets[i]))
+            return false;
+
+    const std::uint32_t* const configOffsets = storageElementNameOffsets + header.mNumStorageElements;
+    for(std::uint32_t i = 0; i < header.mNumConfigs; ++i)
+        if(!IsValidString(configOffsets[i]))
+            return false;
+
+    return true;
+}
+
+bool CTopologyCache::TryLoad(const fs::path& cachePath, CRucio* rucio, std::vector<std::unique_ptr<IBaseCloud>>& clouds)
+{
+    Close();
+
+    mFileDescriptor = open(cachePath.c_str(), O_RDONLY);
+    if(mFileDescriptor < 0)
+        return false;
+
+    struct stat fileStat;
+    if(fstat(mFileDescriptor, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) < sizeof(STopologyCacheHeader))
+    {
+        Close();
+        return false;
+    }
+
+    mDataSize = static_cast<std::size_t>(fileStat.st_size);
+    void* const data = mmap(nullptr, mDataSize, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+    if(data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    mData = static_cast<const unsigned char*>(data);
+    mHeader = reinterpret_cast<const STopologyCacheHeader*>(mData);
+
+    if(!IsValid())
+    {
+        std::cout << "Ignoring outdated or invalid topology cache: " << cachePath << std::endl;
+        Close();
+        return false;
+    }
+
+    const auto* const sites = reinterpret_cast<const STopologySiteRecord*>(mData + sizeof(STopologyCacheHeader) + (mHeader->mNumSourceFiles * sizeof(STopologySourceFile)));
+    for(std::uint32_t i = 0; i < mHeader->mNumSites; ++i)
+    {
+        if(sites[i].mType == STopologySiteRecord::eCloudRegion && sites[i].mCloudIdx >= clouds.size())
+        {
+            std::cout << "Topology cache references unknown cloud: " << sites[i].mCloudIdx << std::endl;
+            Close();
+            return false;
+        }
+    }
+
+    const std::uint32_t* storageElementNameOffset = reinterpret_cast<const std::uint32_t*>(sites + mHeader->mNumSites);
+    for(std::uint32_t i = 0; i < mHeader->mNumSites; ++i)
+    {
+        const STopologySiteRecord& siteRecord = sites[i];
+        ISite* site;
+        if(siteRecord.mType == STopologySiteRecord::eGridSite)
+            site = rucio->CreateGridSite(siteRecord.mMultiLocationIdx, GetString(siteRecord.mNameOffset), GetString(siteRecord.mLocationNameOffset));
+        else
+            site = clouds[siteRecord.mCloudIdx]->CreateRegion(siteRecord.mMultiLocationIdx,
+                                                              GetString(siteRecord.mNameOffset),
+                                                              GetString(siteRecord.mLocationNameOffset),
+                                                              siteRecord.mNumJobSlots,
+                                                              siteRecord.mStoragePrice,
+                                                              GetString(siteRecord.mSKUIdOffset));
+
+        for(std::uint32_t j = 0; j < siteRecord.mNumStorageElements; ++j)
+            site->CreateStorageElement(GetString(*(storageElementNameOffset++)));
+    }
+
+    // storageElementNameOffset points to the config offsets now
+    for(std::uint32_t i = 0; i < mHeader->mNumConfigs; ++i)
+    {
+        const nlohmann::json configJson = nlohmann::json::parse(GetString(storageElementNameOffset[i]), nullptr, false);
+        bool wasConsumed = false;
+        if(!configJson.is_discarded())
+        {
+            wasConsumed = rucio->TryConsumeConfig(configJson);
+            for(const std::unique_ptr<IBaseCloud>& cloud : clouds)
+                wasConsumed = wasConsumed || cloud->TryConsumeConfig(configJson);
+        }
+        if(!wasConsumed)
+            std::cout << "Didnt consume config from topology cache: " << GetString(storageElementNameOffset[i]) << std::endl;
+    }
+
+    std::cout << "Loaded " << mHeader->mNumSites << " sites and " << mHeader->mNumStorageElements << " storage elements from topology cache: " << cachePath << std::endl;
+
+    Close();
+    return true;
+}
+
+bool CTopologyCache::Write(const fs::path& cachePath,
+                           const CRucio* rucio,
+                           const std::vector<std::unique_ptr<IBaseCloud>>& clouds,
+                           const std::unordered_set<std::string>& sourceFilePaths,
+                           const std::vector<std::string>& configs)
+{
+    std::vector<unsigned char> stringTable;
+    auto AddString = [&stringTable](const std::string& str) -> std::uint32_t
+    {
+        const std::uint32_t offset = static_cast<std::uint32_t>(stringTable.size());
+        const std::uint32_t length = static_cast<std::uint32_t>(str.size());
+        stringTable.insert(stringTable.end(), reinterpret_cast<const unsigned char*>(&length), reinterpret_cast<const unsigned char*>(&length) + sizeof(length));
+        stringTable.insert(stringTable.end(), str.cbegin(), str.cend());
+        return offset;
+    };
+
+    std::vector<STopologySourceFile> sourceFiles;
+    for(const std::string& sourceFilePath : sourceFilePaths)
+    {
+        STopologySourceFile sourceFile = {};
+        if(!HashFile(sourceFilePath, sourceFile.mContentHash))
+            return false;
+        sourceFile.mPathOffset = AddString(sourceFilePath);
+        sourceFiles.push_back(sourceFile);
+    }
+
+    // the json consumers create each site directly followed by its storage elements.
+    // Ordering the sites by id therefore reproduces the original id assignment
+    std::vector<std::pair<const ISite*, STopologySiteRecord>> sites;
+    std::vector<std::uint32_t> storageElementNameOffsets;
+
+    for(const std::unique_ptr<CGridSite>& gridSite : rucio->mGridSites)
+    {
+        STopologySiteRecord siteRecord = {};
+        siteRecord.mType = STopologySiteRecord::eGridSite;
+        sites.emplace_back(gridSite.get(), siteRecord);
+    }
+
+    for(std::size_t cloudIdx = 0; cloudIdx < clouds.size(); ++cloudIdx)
+    {
+        for(const std::unique_ptr<ISite>& cloudSite : clouds[cloudIdx]->mRegions)
+        {
+            auto region = dynamic_cast<const gcp::CRegion*>(cloudSite.get());
+            if(region == nullptr)
+            {
+                std::cout << "Unable to compile topology cache: unsupported cloud region " << cloudSite->GetName() << std::endl;
+                return false;
+            }
+
+            STopologySiteRecord siteRecord = {};
+            siteRecord.mType = STopologySiteRecord::eCloudRegion;
+            siteRecord.mCloudIdx = static_cast<std::uint32_t>(cloudIdx);
+            siteRecord.mNumJobSlots = region->mNumJobSlots;
+            siteRecord.mStoragePrice = region->GetStoragePrice();
+            siteRecord.mSKUIdOffset = AddString(region->GetSKUId());
+            sites.emplace_back(region, siteRecord);
+        }
+    }
+
+    std::sort(sites.begin(), sites.end(), [](const auto& a, const auto& b) {return a.first->GetId() < b.first->GetId();});
+
+    for(auto& [site, siteRecord] : sites)
+    {
+        siteRecord.mMultiLocationIdx = site->GetMultiLocationIdx();
+        siteRecord.mNameOffset = AddString(site->GetName());
+        siteRecord.mLocationNameOffset = AddString(site->GetLocationName());
+        if(siteRecord.mType == STopologySiteRecord::eGridSite)
+        {
+            for(const std::unique_ptr<CStorageElement>& storageElement : static_cast<const CGridSite*>(site)->mStorageElements)
+                storageElementNameOffsets.push_back(AddString(storageElement->GetName()));
+            siteRecord.mNumStorageElements = static_cast<std::uint32_t>(static_cast<const CGridSite*>(site)->mStorageElements.size());
+        }
+        else
+        {
+            for(const std::unique_ptr<gcp::CBucket>& bucket : static_cast<const gcp::CRegion*>(site)->mStorageElements)
+                storageElementNameOffsets.push_back(AddString(bucket->GetName()));
+            siteRecord.mNumStorageElements = static_cast<std::uint32_t>(static_cast<const gcp::CRegion*>(site)->mStorageElements.size());
+        }
+    }
+
+    std::vector<std::uint32_t> configOffsets;
+    for(const std::string& config : configs)
+        configOffsets.push_back(AddString(config));
+
+    STopologyCacheHeader header = {};
+    std::memcpy(header.mMagic, TOPOLOGY_CACHE_MAGIC, sizeof(TOPOLOGY_CACHE_MAGIC));
+    header.mVersion = TOPOLOGY_CACHE_VERSION;
+    header.mNumSourceFiles = static_cast<std::uint32_t>(sourceFiles.size());
+    header.mNumSites = static_cast<std::uint32_t>(sites.size());
+    header.mNumStorageElements = static_cast<std::uint32_t>(storageElementNameOffsets.size());
+    header.mNumConfigs = static_cast<std::uint32_t>(configOffsets.size());
+    header.mStringTableOffset = sizeof(STopologyCacheHeader)
+                              + (sourceFiles.size() * sizeof(STopologySourceFile))
+                              + (sites.size() * sizeof(STopologySiteRecord))
+                              + (storageElementNameOffsets.size() * sizeof(std::uint32_t))
+                              + (configOffsets.size() * sizeof(std::uint32_t));
+    header.mStringTableSize = stringTable.size();
+
+    // write to a temporary file first so concurrent runs never map a partially written cache
+    fs::path tmpCachePath = cachePath;
+    tmpCachePath += ".tmp";
+    {
+        std::ofstream file(tmpCachePath, std::ios::binary | std::ios::trunc);
+        if(!file)
+        {
+            std::cout << "Unable to write topology cache: " << tmpCachePath << std::endl;
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(sourceFiles.data()), sourceFiles.size() * sizeof(STopologySourceFile));
+        for(const auto& [site, siteRecord] : sites)
+            file.write(reinterpret_cast<const char*>(&siteRecord), sizeof(siteRecord));
+        file.write(reinterpret_cast<const char*>(storageElementNameOffsets.data()), storageElementNameOffsets.size() * sizeof(std::uint32_t));
+        file.write(reinterpret_cast<const char*>(configOffsets.data()), configOffsets.size() * sizeof(std::uint32_t));
+        file.write(reinterpret_cast<const char*>(stringTable.data()), stringTable.size());
+        if(!file)
+            return false;
+    }
+
+    std::error_code error;
+    fs::rename(tmpCachePath, cachePath, error);
+    if(error)
+    {
+        std::cout << "Unable to write topology cache: " << cachePath << std::endl;
+        return false;
+    }
+
+    std::cout << "Compiled " << sites.size() << " sites and " << storageElementNameOffsets.size() << " storage elements into topology cache: " << cachePath << std::endl;
+    return true;
+}
+
+bool CTopologyCache::HashFile(const fs::path& filePath, std::uint64_t& hash)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    if(!file)
+        return false;
+
+    hash = 14695981039346656037ULL;
+    char buffer[1 << 16];
+    do
+    {
+        file.read(buffer, sizeof(buffer));
+        const std::streamsize numBytes = file.gcount();
+        for(std::streamsize i = 0; i < numBytes; ++i)
+        {
+            hash ^= static_cast<unsigned char>(buffer[i]);
+            hash *= 1099511628211ULL;
+        }
+    } while(file);
+
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+class CRucio;
+class IBaseCloud;
+
+namespace fs = std::filesystem;
+
+
+
+#define TOPOLOGY_CACHE_MAGIC ("GACSTOP")
+#define TOPOLOGY_CACHE_VERSION (2)
+
+// binary topology layout:
+// [STopologyCacheHeader][STopologySourceFile * mNumSourceFiles][STopologySiteRecord * mNumSites]
+// [uint32 name offset * mNumStorageElements][uint32 config offset * mNumConfigs][string table]
+// the storage elements are stored in site order. Strings are referenced by their offset
+// in the string table and stored as (uint32 length, chars). Configs are json dumps of the
+// config entries that are no site lists and are passed to the consumers again on load
+struct STopologyCacheHeader
+{
+    char mMagic[8];
+    std::uint32_t mVersion;
+    std::uint32_t mNumSourceFiles;
+    std::uint32_t mNumSites;
+    std::uint32_t mNumStorageElements;
+    std::uint32_t mNumConfigs;
+    std::uint32_t mPadding;
+    std::uint64_t mStringTableOffset;
+    std::uint64_t mStringTableSize;
+};
+
+// the cache is only valid as long as all json files it was compiled from are unchanged
+struct STopologySourceFile
+{
+    std::uint64_t mContentHash;
+    std::uint32_t mPathOffset;
+    std::uint32_t mPadding;
+};
+
+// sites are stored in creation order, so they get the same ids as if they were loaded from json
+struct STopologySiteRecord
+{
+    enum EType : std::uint8_t
+    {
+        eGridSite = 0,
+        eCloudRegion = 1
+    };
+
+    double mStoragePrice;
+    std::uint32_t mCloudIdx;
+    std::uint32_t mMultiLocationIdx;
+    std::uint32_t mNumJobSlots;
+    std::uint32_t mNameOffset;
+    std::uint32_t mLocationNameOffset;
+    std::uint32_t mSKUIdOffset;
+    std::uint32_t mNumStorageElements;
+    std::uint8_t mType;
+    std::uint8_t mPadding[3];
+};
+
+static_assert(sizeof(STopologyCacheHeader) == 48, "unexpected topology cache header size");
+static_assert(sizeof(STopologySourceFile) == 16, "unexpected topology source file size");
+static_assert(sizeof(STopologySiteRecord) == 40, "unexpected topology site record size");
+
+
+
+class CTopologyCache
+{
+private:
+    int mFileDescriptor = -1;
+    const unsigned char* mData = nullptr;
+    std::size_t mDataSize = 0;
+
+    const STopologyCacheHeader* mHeader = nullptr;
+
+    auto GetString(const std::uint32_t offset) const -> std::string;
+    bool IsValid() const;
+    void Close();
+
+public:
+    CTopologyCache() = default;
+    ~CTopologyCache();
+
+    CTopologyCache(const CTopologyCache&) = delete;
+    CTopologyCache& operator=(const CTopologyCache&) = delete;
+
+    // returns false if the cache does not exist, is corrupt or one of its source files changed.
+    // nothing is instantiated in that case
+    bool TryLoad(const fs::path& cachePath, CRucio* rucio, std::vector<std::unique_ptr<IBaseCloud>>& clouds);
+
+    // compiles the sites and storage elements that were created from the given json files
+    static bool Write(const fs::path& cachePath,
+                      const CRucio* rucio,
+                      const std::vector<std::unique_ptr<IBaseCloud>>& clouds,
+                      const std::unordered_set<std::string>& sourceFilePaths,
+                      const std::vector<std::string>& configs);
+
+    // FNV-1a of the file content
+    static bool HashFile(const fs::path& filePath, std::uint64_t& hash);
+};
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "json.hpp"
+
+#include "IBaseCloud.hpp"
+#include "ISite.hpp"
+
+#include "CRucio.hpp"
+#include "CTopologyGenerator.hpp"
+
+
+
+bool CTopologyGenerator::SBandwidthDistribution::Load(const nlohmann::json& bandwidthJson)
+{
+    if(bandwidthJson.is_number())
+    {
+        mType = eFixed;
+        mMin = mMax = mMedian = bandwidthJson.get<double>();
+        return true;
+    }
+
+    if(!bandwidthJson.is_object())
+        return false;
+
+    auto prop = bandwidthJson.find("distribution");
+    if(prop != bandwidthJson.end())
+    {
+        const std::string distribution = prop->get<std::string>();
+        if(distribution == "fixed")
+            mType = eFixed;
+        else if(distribution == "uniform")
+            mType = eUniform;
+        else if(distribution == "lognormal")
+            mType = eLogNormal;
+        else
+        {
+            std::cout << "Unknown bandwidth distribution: " << distribution << std::endl;
+            return false;
+        }
+    }
+
+    prop = bandwidthJson.find("min");
+    if(prop != bandwidthJson.end())
+        mMin = prop->get<double>();
+
+    prop = bandwidthJson.find("max");
+    if(prop != bandwidthJson.end())
+        mMax = prop->get<double>();
+
+    prop = bandwidthJson.find("median");
+    if(prop != bandwidthJson.end())
+        mMedian = prop->get<double>();
+
+    prop = bandwidthJson.find("sigma");
+    if(prop != bandwidthJson.end())
+        mSigma = prop->get<double>();
+
+    if(mType == eFixed)
+        mMin = mMax = mMedian;
+
+    if(mMin <= 0 || mMax < mMin)
+    {
+        std::cout << "Invalid bandwidth range: " << mMin << " - " << mMax << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+
+bool CTopologyGenerator::Load(const nlohmann::json& generatorJson)
+{
+    auto prop = generatorJson.find("seed");
+    if(prop != generatorJson.end())
+        mRNGEngine.seed(prop->get<RNGEngineType::result_type>());
+
+    prop = generatorJson.find("numGridSites");
+    if(prop != generatorJson.end())
+        mNumGridSites = prop->get<std::uint32_t>();
+
+    prop = generatorJson.find("numStorageElementsPerSite");
+    if(prop != generatorJson.end())
+        mNumStorageElementsPerSite = prop->get<std::uint32_t>();
+
+    prop = generatorJson.find("numRegions");
+    if(prop != generatorJson.end())
+        mNumRegions = prop->get<std::uint32_t>();
+
+    prop = generatorJson.find("numBucketsPerRegion");
+    if(prop != generatorJson.end())
+        mNumBucketsPerRegion = prop->get<std::uint32_t>();
+
+    prop = generatorJson.find("numMultiLocations");
+    if(prop != generatorJson.end())
+        mNumMultiLocations = std::max<std::uint32_t>(prop->get<std::uint32_t>(), 1);
+
+    prop = generatorJson.find("numJobSlotsPerRegion");
+    if(prop != generatorJson.end())
+        mNumJobSlotsPerRegion = prop->get<std::uint32_t>();
+
+    prop = generatorJson.find("storagePrice");
+    if(prop != generatorJson.end())
+    {
+        if(prop->is_number())
+            mMinStoragePrice = mMaxStoragePrice = prop->get<double>();
+        else
+        {
+            auto rangeProp = prop->find("min");
+            if(rangeProp != prop->end())
+                mMinStoragePrice = rangeProp->get<double>();
+            rangeProp = prop->find("max");
+            if(rangeProp != prop->end())
+                mMaxStoragePrice = rangeProp->get<double>();
+            mMaxStoragePrice = std::max(mMinStoragePrice, mMaxStoragePrice);
+        }
+    }
+
+    prop = generatorJson.find("gridLinkDensity");
+    if(prop != generatorJson.end())
+        mGridLinkDensity = std::clamp(prop->get<double>(), 0.0, 1.0);
+
+    prop = generatorJson.find("bandwidth");
+    if(prop != generatorJson.end() && !mBandwidth.Load(prop.value()))
+        return false;
+
+    return true;
+}
+
+void CTopologyGenerator::Generate(CRucio* rucio, IBaseCloud* cloud)
+{
+    std::uint64_t numStorageElements = 0;
+    for(std::uint32_t siteIdx = 0; siteIdx < mNumGridSites; ++siteIdx)
+    {
+        const std::uint32_t multiLocationIdx = siteIdx % mNumMultiLocations;
+        const std::string siteName = "GRID_" + std::to_string(siteIdx);
+        CGridSite* site = rucio->CreateGridSite(multiLocationIdx, std::string(siteName), "location_" + std::to_string(multiLocationIdx));
+        for(std::uint32_t storageElementIdx = 0; storageElementIdx < mNumStorageElementsPerSite; ++storageElementIdx)
+            site->CreateStorageElement(siteName + "_DATADISK_" + std::to_string(storageElementIdx));
+        numStorageElements += mNumStorageElementsPerSite;
+    }
+
+    if(mNumRegions > 0 && cloud != nullptr)
+    {
+        std::uniform_real_distribution<double> storagePriceDist(mMinStoragePrice, mMaxStoragePrice);
+        for(std::uint32_t regionIdx = 0; regionIdx < mNumRegions; ++regionIdx)
+        {
+            const std::uint32_t multiLocationIdx = regionIdx % mNumMultiLocations;
+            const std::string regionName = "region-" + std::to_string(regionIdx);
+            ISite* region = cloud->CreateRegion(multiLocationIdx,
+                                                std::string(regionName),
+                                                "location_" + std::to_string(multiLocationIdx),
+                                                mNumJobSlotsPerRegion,
+                                                storagePriceDist(mRNGEngine),
+                                                "GEN-" + std::to_string(regionIdx));
+            for(std::uint32_t bucketIdx = 0; bucketIdx < mNumBucketsPerRegion; ++bucketIdx)
+                region->CreateStorageElement(regionName + "_bucket_" + std::to_string(bucketIdx));
+            numStorageElements += mNumBucketsPerRegion;
+        }
+    }
+
+    CreateGridLinks(rucio);
+
+    std::cout << "Generated " << mNumGridSites << " grid sites, " << mNumRegions << " regions and "
+              << numStorageElements << " storage elements" << std::endl;
+}
+
+void CTopologyGenerator::CreateGridLinks(CRucio* rucio)
+{
+    const std::uint64_t numSites = rucio->mGridSites.size();
+    if(numSites < 2 || mGridLinkDensity <= 0)
+        return;
+
+    // the ordered site pairs are enumerated as one index space. With a density below one,
+    // the distance to the next created link is sampled geometrically, so the costs only
+    // depend on the number of created links and not on the number of possible pairs
+    const std::uint64_t numPairs = numSites * (numSites - 1);
+    std::geometric_distribution<std::uint64_t> skipDist(mGridLinkDensity);
+    std::uint64_t numLinks = 0;
+    for(std::uint64_t pairIdx = 0; pairIdx < numPairs; ++pairIdx)
+    {
+        if(mGridLinkDensity < 1)
+        {
+            pairIdx += skipDist(mRNGEngine);
+            if(pairIdx >= numPairs)
+                break;
+        }
+
+        const std::uint64_t srcIdx = pairIdx / (numSites - 1);
+        std::uint64_t dstIdx = pairIdx % (numSites - 1);
+        if(dstIdx >= srcIdx)
+            dstIdx += 1;
+
+        rucio->mGridSites[srcIdx]->CreateLinkSelector(rucio->mGridSites[dstIdx].get(), SampleBandwidth());
+        numLinks += 1;
+    }
+
+    std::cout << "Generated " << numLinks << " links between grid sites" << std::endl;
+}
+
+auto CTopologyGenerator::SampleBandwidth() -> std::uint32_t
+{
+    double bandwidth = mBandwidth.mMin;
+    if(mBandwidth.mType == SBandwidthDistribution::eUniform)
+        bandwidth = std::uniform_real_distribution<double>(mBandwidth.mMin, mBandwidth.mMax)(mRNGEngine);
+    else if(mBandwidth.mType == SBandwidthDistribution::eLogNormal)
+    {
+        std::lognormal_distribution<double> bandwidthDist(std::log(mBandwidth.mMedian), mBandwidth.mSigma);
+        bandwidth = std::clamp(bandwidthDist(mRNGEngine), mBandwidth.mMin, mBandwidth.mMax);
+    }
+    return static_cast<std::uint32_t>(std::min<double>(bandwidth, std::numeric_limits<std::uint32_t>::max()));
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "json_fwd.hpp"
+
+#include "constants.h"
+
+class CRucio;
+class IBaseCloud;
+
+
+
+// creates parameterised grid and cloud topologies for scale tests without any json topology file.
+// Grid sites, storage elements, regions and buckets are created directly. Links between grid sites
+// are created with the given density, the grid-cloud and cloud-cloud links are created by the sim as usual.
+// Their prices are taken from the optional "networkPrices" object of the generator config
+class CTopologyGenerator
+{
+public:
+    struct SBandwidthDistribution
+    {
+        enum EType : std::uint8_t
+        {
+            eFixed = 0,
+            eUniform = 1,
+            eLogNormal = 2
+        };
+
+        EType mType = eFixed;
+        double mMin = ONE_GiB / 64;
+        double mMax = ONE_GiB / 64;
+
+        // only used by the log normal distribution. Samples are clamped to [mMin, mMax]
+        double mMedian = ONE_GiB / 64;
+        double mSigma = 1;
+
+        bool Load(const nlohmann::json& bandwidthJson);
+    };
+
+private:
+    RNGEngineType mRNGEngine {42};
+
+    std::uint32_t mNumGridSites = 0;
+    std::uint32_t mNumStorageElementsPerSite = 1;
+    std::uint32_t mNumRegions = 0;
+    std::uint32_t mNumBucketsPerRegion = 1;
+    std::uint32_t mNumMultiLocations = 1;
+    std::uint32_t mNumJobSlotsPerRegion = 0;
+
+    double mMinStoragePrice = 0.02;
+    double mMaxStoragePrice = 0.02;
+
+    // probability that a link exists from one grid site to another
+    double mGridLinkDensity = 0;
+    SBandwidthDistribution mBandwidth;
+
+    void CreateGridLinks(CRucio* rucio);
+
+public:
+    // reads seed, numGridSites, numStorageElementsPerSite, numRegions, numBucketsPerRegion, numMultiLocations,
+    // numJobSlotsPerRegion, storagePrice {min, max}, gridLinkDensity and bandwidth, e.g.:
+    // {"numGridSites": 1000, "numStorageElementsPerSite": 10, "gridLinkDensity": 0.05,
+    //  "bandwidth": {"distribution": "lognormal", "median": 16777216, "sigma": 0.5, "min": 1048576, "max": 134217728}}
+    bool Load(const nlohmann::json& generatorJson);
+
+    void Generate(CRucio* rucio, IBaseCloud* cloud);
+
+    auto SampleBandwidth() -> std::uint32_t;
+};
@@ -0,0 +1,505 @@
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IBaseSim.hpp"
+#include "ISite.hpp"
+
+#include "COutput.hpp"
+#include "COutputAggregator.hpp"
+#include "COutputTables.hpp"
+#include "CRucio.hpp"
+#include "CStorageElement.hpp"
+#include "CTraceReplay.hpp"
+#include "CommonScheduleables.hpp"
+#include "SFile.hpp"
+
+
+// consumed parts of the mapping are given back to the os in chunks of this size
+#define TRACE_RELEASE_CHUNK_SIZE (64 * 1024 * 1024)
+
+
+
+CTraceWriter::~CTraceWriter()
+{
+    Close();
+}
+
+bool CTraceWriter::Open(const fs::path& tracePath)
+{
+    assert(!mFile.is_open());
+
+    mFile.open(tracePath, std::ios::binary | std::ios::trunc);
+    if(!mFile)
+    {
+        std::cout << "Unable to create trace file: " << tracePath << std::endl;
+        return false;
+    }
+
+    std::memset(&mHeader, 0, sizeof(STraceHeader));
+    std::strncpy(mHeader.mMagic, TRACE_MAGIC, sizeof(mHeader.mMagic));
+    mHeader.mVersion = TRACE_VERSION;
+    mLastTick = 0;
+    mStorageElementNameToIdx.clear();
+    mStorageElementToIdx.clear();
+    mStorageElementNames.clear();
+
+    // header is rewritten on close
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(STraceHeader));
+    return static_cast<bool>(mFile);
+}
+
+bool CTraceWriter::Close()
+{
+    if(!mFile.is_open())
+        return false;
+
+    mHeader.mNumStorageElements = static_cast<std::uint32_t>(mStorageElementNames.size());
+    mHeader.mStorageElementTableOffset = sizeof(STraceHeader) + (mHeader.mNumRecords * sizeof(STraceRecord));
+    for(const std::string& name : mStorageElementNames)
+    {
+        const std::uint32_t len = static_cast<std::uint32_t>(name.size());
+        mFile.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        mFile.write(name.data(), len);
+    }
+
+    mFile.seekp(0);
+    mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(STraceHeader));
+
+    const bool ok = static_cast<bool>(mFile);
+    mFile.close();
+    return ok;
+}
+
+auto CTraceWriter::GetStorageElementIdx(const std::string& name) -> std::uint32_t
+{
+    auto result = mStorageElementNameToIdx.insert({name, static_cast<std::uint32_t>(mStorageElementNames.size())});
+    if(result.second)
+        mStorageElementNames.push_back(name);
+    return result.first->second;
+}
+
+auto CTraceWriter::GetStorageElementIdx(const CStorageElement* storageElement) -> std::uint32_t
+{
+    auto result = mStorageElementToIdx.find(storageElement);
+    if(result != mStorageElementToIdx.end())
+        return result->second;
+    const std::uint32_t idx = GetStorageElementIdx(storageElement->GetName());
+    mStorageElementToIdx.insert({storageElement, idx});
+    return idx;
+}
+
+void CTraceWriter::AddRecord(const STraceRecord& record)
+{
+    assert(mFile.is_open());
+    assert(record.mTick >= mLastTick);
+    mLastTick = record.mTick;
+    mFile.write(reinterpret_cast<const char*>(&record), sizeof(STraceRecord));
+    mHeader.mNumRecords += 1;
+}
+
+void CTraceWriter::AddFileCreation(const TickType tick, const std::uint64_t fileId, const std::uint32_t fileSize, const std::uint32_t lifetime, const std::uint32_t dstStorageElementIdx)
+{
+    STraceRecord record = {tick, fileId, fileSize, lifetime, TRACE_INVALID_IDX, dstStorageElementIdx, 0, STraceRecord::eFileCreation, {0, 0, 0}};
+    AddRecord(record);
+}
+
+void CTraceWriter::AddReplicaCreation(const TickType tick, const std::uint64_t fileId, const std::uint32_t dstStorageElementIdx, const std::uint32_t lifetime)
+{
+    STraceRecord record = {tick, fileId, 0, lifetime, TRACE_INVALID_IDX, dstStorageElementIdx, 0, STraceRecord::eReplicaCreation, {0, 0, 0}};
+    AddRecord(record);
+}
+
+void CTraceWriter::AddTransfer(const TickType tick, const std::uint64_t fileId, const std::uint32_t srcStorageElementIdx, const std::uint32_t dstStorageElementIdx, const std::uint32_t lifetime, const std::uint32_t duration)
+{
+    STraceRecord record = {tick, fileId, 0, lifetime, srcStorageElementIdx, dstStorageElementIdx, duration, STraceRecord::eTransfer, {0, 0, 0}};
+    AddRecord(record);
+}
+
+void CTraceWriter::AddTransfer(const TickType tick, const std::uint64_t fileId, const CStorageElement* srcStorageElement, const CStorageElement* dstStorageElement, const TickType lifetime, const TickType duration)
+{
+    AddTransfer(tick, fileId, GetStorageElementIdx(srcStorageElement), GetStorageElementIdx(dstStorageElement), static_cast<std::uint32_t>(lifetime), static_cast<std::uint32_t>(duration));
+}
+
+bool CTraceWriter::ConvertCSV(const fs::path& csvPath, const fs::path& tracePath)
+{
+    std::ifstream csvFile(csvPath);
+    if(!csvFile)
+    {
+        std::cout << "Unable to open trace csv: " << csvPath << std::endl;
+        return false;
+    }
+
+    CTraceWriter writer;
+    if(!writer.Open(tracePath))
+        return false;
+
+    std::string line;
+    std::vector<std::string> fields;
+    std::size_t lineNum = 0;
+    TickType lastTick = 0;
+    while(std::getline(csvFile, line))
+    {
+        ++lineNum;
+        if(line.empty() || line[0] == '#' || !std::isdigit(static_cast<unsigned char>(line[0])))
+            continue; // comment or column names
+
+        fields.clear();
+        std::stringstream lineStream(line);
+        std::string field;
+        while(std::getline(lineStream, field, ','))
+            fields.push_back(field);
+
+        if(fields.size() < 7)
+        {
+            std::cout << "Ignoring malformed trace line " << lineNum << ": " << line << std::endl;
+            continue;
+        }
+
+        TickType tick;
+        std::uint64_t fileId;
+        std::uint32_t fileSize, lifetime, duration;
+        try
+        {
+            tick = std::stoull(fields[0]);
+            fileId = std::stoull(fields[2]);
+            fileSize = fields[3].empty() ? 0 : static_cast<std::uint32_t>(std::stoul(fields[3]));
+            lifetime = fields[4].empty() ? 0 : static_cast<std::uint32_t>(std::stoul(fields[4]));
+            duration = (fields.size() > 7 && !fields[7].empty()) ? static_cast<std::uint32_t>(std::stoul(fields[7])) : 0;
+        }
+        catch(const std::exception&)
+        {
+            std::cout << "Ignoring malformed trace line " << lineNum << ": " << line << std::endl;
+            continue;
+        }
+
+        if(tick < lastTick)
+        {
+            std::cout << "Trace csv is not sorted by tick (line " << lineNum << ")" << std::endl;
+            writer.Close();
+            fs::remove(tracePath);
+            return false;
+        }
+        lastTick = tick;
+
+        const std::string& type = fields[1];
+        const std::uint32_t srcIdx = fields[5].empty() ? TRACE_INVALID_IDX : writer.GetStorageElementIdx(fields[5]);
+        const std::uint32_t dstIdx = fields[6].empty() ? TRACE_INVALID_IDX : writer.GetStorageElementIdx(fields[6]);
+
+        if(type == "file")
+            writer.AddFileCreation(tick, fileId, fileSize, lifetime, dstIdx);
+        else if(type == "replica")
+            writer.AddReplicaCreation(tick, fileId, dstIdx, lifetime);
+        else if(type == "transfer")
+            writer.AddTransfer(tick, fileId, srcIdx, dstIdx, lifetime, duration);
+        else
+            std::cout << "Ignoring unknown trace record type in line " << lineNum << ": " << type << std::endl;
+    }
+
+    std::cout << "Converted " << writer.GetNumRecords() << " trace records to " << tracePath << std::endl;
+    return writer.Close();
+}
+
+
+
+CTraceReplay::CTraceReplay(IBaseSim* sim, const TickType startTick)
+    : CScheduleable(startTick),
+      mSim(sim)
+{}
+
+CTraceReplay::~CTraceReplay()
+{
+    Close();
+}
+
+void CTraceReplay::Close()
+{
+    if(mData != nullptr)
+        munmap(const_cast<unsigned char*>(mData), mDataSize);
+    if(mFileDescriptor >= 0)
+        close(mFileDescriptor);
+    mData = nullptr;
+    mDataSize = 0;
+    mFileDescriptor = -1;
+}
+
+bool CTraceReplay::Open(const fs::path& tracePath, const std::vector<CStorageElement*>& storageElements)
+{
+    assert(mData == nullptr);
+
+    mFileDescriptor = open(tracePath.c_str(), O_RDONLY);
+    if(mFileDescriptor < 0)
+    {
+        std::cout << "Unable to open trace: " << tracePath << std::endl;
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(mFileDescriptor, &fileStat) != 0 || static_cast<std::size_t>(fileStat.st_size) < sizeof(STraceHeader))
+    {
+        std::cout << "Invalid trace file: " << tracePath << std::endl;
+        Close();
+        return false;
+    }
+
+    mDataSize = static_cast<std::size_t>(fileStat.st_size);
+    void* mapping = mmap(nullptr, mDataSize, PROT_READ, MAP_PRIVATE, mFileDescriptor, 0);
+    if(mapping == MAP_FAILED)
+    {
+        std::cout << "Unable to map trace: " << tracePath << std::endl;
+        mDataSize = 0;
+        Close();
+        return false;
+    }
+    mData = static_cast<const unsigned char*>(mapping);
+    madvise(mapping, mDataSize, MADV_SEQUENTIAL);
+
+    STraceHeader header;
+    std::memcpy(&header, mData, sizeof(STraceHeader));
+    const std::size_t recordsEnd = sizeof(STraceHeader) + (header.mNumRecords * sizeof(STraceRecord));
+    if(std::strncmp(header.mMagic, TRACE_MAGIC, sizeof(header.mMagic)) != 0 || header.mVersion != TRACE_VERSION
+        || recordsEnd > header.mStorageElementTableOffset || header.mStorageElementTableOffset > mDataSize)
+    {
+        std::cout << "Invalid or incompatible trace header: " << tracePath << std::endl;
+        Close();
+        return false;
+    }
+
+    std::unordered_map<std::string, CStorageElement*> nameToStorageElement;
+    for(CStorageElement* storageElement : storageElements)
+        nameToStorageElement[storageElement->GetName()] = storageElement;
+
+    mStorageElements.clear();
+    std::size_t offset = header.mStorageElementTableOffset;
+    for(std::uint32_t i = 0; i < header.mNumStorageElements; ++i)
+    {
+        std::uint32_t len;
+        if(offset + sizeof(len) > mDataSize)
+            break;
+        std::memcpy(&len, mData + offset, sizeof(len));
+        offset += sizeof(len);
+        if(offset + len > mDataSize)
+            break;
+        const std::string name(reinterpret_cast<const char*>(mData + offset), len);
+        offset += len;
+
+        auto result = nameToStorageElement.find(name);
+        if(result == nameToStorageElement.end())
+        {
+            std::cout << "Trace references unknown storage element: " << name << std::endl;
+            mStorageElements.push_back(nullptr);
+        }
+        else
+            mStorageElements.push_back(result->second);
+    }
+
+    if(mStorageElements.size() != header.mNumStorageElements)
+    {
+        std::cout << "Truncated storage element table in trace: " << tracePath << std::endl;
+        Close();
+        return false;
+    }
+
+    mRecordsBegin = mData + sizeof(STraceHeader);
+    mNumRecords = header.mNumRecords;
+    mNextRecordIdx = 0;
+    mNumReleasedBytes = 0;
+
+    if(mNumRecords > 0)
+    {
+        STraceRecord firstRecord;
+        std::memcpy(&firstRecord, mRecordsBegin, sizeof(STraceRecord));
+        mNextCallTick = std::max(mNextCallTick, firstRecord.mTick);
+    }
+
+    std::cout << "Replaying " << mNumRecords << " records from trace " << tracePath << std::endl;
+    return true;
+}
+
+auto CTraceReplay::FindFile(const std::uint64_t traceFileId, const TickType now) -> SFile*
+{
+    auto result = mTraceFileIdToFile.find(traceFileId);
+    if(result == mTraceFileIdToFile.end())
+        return nullptr;
+
+    // the reaper may already have deleted expired files, so the pointer must not be touched
+    if(result->second.second <= now)
+    {
+        mTraceFileIdToFile.erase(result);
+        return nullptr;
+    }
+    return result->second.first;
+}
+
+void CTraceReplay::PurgeExpiredFiles(const TickType now)
+{
+    for(auto it = mTraceFileIdToFile.begin(); it != mTraceFileIdToFile.end();)
+    {
+        if(it->second.second <= now)
+            it = mTraceFileIdToFile.erase(it);
+        else
+            ++it;
+    }
+    mNumFilesAfterLastPurge = mTraceFileIdToFile.size();
+}
+
+void CTraceReplay::ReleaseConsumedPages()
+{
+    const std::size_t consumedBytes = sizeof(STraceHeader) + (mNextRecordIdx * sizeof(STraceRecord));
+    if((consumedBytes - mNumReleasedBytes) < TRACE_RELEASE_CHUNK_SIZE)
+        return;
+
+    const std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t releaseEnd = (consumedBytes / pageSize) * pageSize;
+    if(releaseEnd > mNumReleasedBytes)
+    {
+        madvise(const_cast<unsigned char*>(mData) + mNumReleasedBytes, releaseEnd - mNumReleasedBytes, MADV_DONTNEED);
+        mNumReleasedBytes = releaseEnd;
+    }
+}
+
+void CTraceReplay::OnUpdate(const TickType now)
+{
+    auto curRealtime = std::chrono::high_resolution_clock::now();
+
+    CRucio* const rucio = mSim->mRucio.get();
+    auto fileInsertStmts = CTypedInsertStatements<tables::CFilesTable>::Acquire();
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire();
+
+    auto createReplica = [&](SFile* const file, CStorageElement* const storageElement, const TickType expiresAt) -> std::shared_ptr<SReplica>
+    {
+        std::shared_ptr<SReplica> replica = storageElement->CreateReplica(file);
+        if(replica == nullptr)
+            return nullptr;
+        replica->mExpiresAt = std::min(expiresAt, file->mExpiresAt);
+        replicaInsertStmts->AddRow(replica->GetId(), file->GetId(), storageElement->GetId(), now, replica->mExpiresAt);
+        return replica;
+    };
+
+    auto getStorageElement = [this](const std::uint32_t idx) -> CStorageElement*
+    {
+        return (idx < mStorageElements.size()) ? mStorageElements[idx] : nullptr;
+    };
+
+    STraceRecord record;
+    while(mNextRecordIdx < mNumRecords)
+    {
+        std::memcpy(&record, mRecordsBegin + (mNextRecordIdx * sizeof(STraceRecord)), sizeof(STraceRecord));
+        if(record.mTick > now)
+            break;
+        ++mNextRecordIdx;
+
+        bool wasReplayed = false;
+        switch(record.mType)
+        {
+        case STraceRecord::eFileCreation:
+        {
+            if(record.mFileSize == 0 || record.mLifetime == 0)
+                break;
+            SFile* const file = rucio->CreateFile(record.mFileSize, now + record.mLifetime);
+            mTraceFileIdToFile[record.mFileId] = {file, file->mExpiresAt};
+            fileInsertStmts->AddRow(file->GetId(), now, file->mExpiresAt, file->GetSize());
+            if(mAggregator)
+                mAggregator->AddFile(file);
+            wasReplayed = true;
+
+            CStorageElement* const dstStorageElement = getStorageElement(record.mDstStorageElementIdx);
+            if(dstStorageElement != nullptr)
+            {
+                std::shared_ptr<SReplica> replica = createReplica(file, dstStorageElement, file->mExpiresAt);
+                if(replica != nullptr)
+                    replica->Increase(file->GetSize(), now);
+            }
+            break;
+        }
+
+        case STraceRecord::eReplicaCreation:
+        {
+            SFile* const file = FindFile(record.mFileId, now);
+            CStorageElement* const dstStorageElement = getStorageElement(record.mDstStorageElementIdx);
+            if(file == nullptr || dstStorageElement == nullptr)
+                break;
+            const TickType lifetime = (record.mLifetime > 0) ? record.mLifetime : file->mExpiresAt - now;
+            std::shared_ptr<SReplica> replica = createReplica(file, dstStorageElement, now + lifetime);
+            if(replica != nullptr)
+            {
+                replica->Increase(file->GetSize(), now);
+                wasReplayed = true;
+            }
+            break;
+        }
+
+        case STraceRecord::eTransfer:
+        {
+            SFile* const file = FindFile(record.mFileId, now);
+            CStorageElement* const srcStorageElement = getStorageElement(record.mSrcStorageElementIdx);
+            CStorageElement* const dstStorageElement = getStorageElement(record.mDstStorageElementIdx);
+            if(file == nullptr || srcStorageElement == nullptr || dstStorageElement == nullptr)
+                break;
+            if(srcStorageElement->GetSite()->GetOrCreateLinkSelector(dstStorageElement->GetSite()) == nullptr)
+                break;
+
+            std::shared_ptr<SReplica> srcReplica;
+            for(const std::shared_ptr<SReplica>& replica : file->mReplicas)
+            {
+                if(replica->GetStorageElement() == srcStorageElement)
+                {
+                    srcReplica = replica;
+                    break;
+                }
+            }
+            if(srcReplica == nullptr)
+                break;
+
+            const TickType lifetime = (record.mLifetime > 0) ? record.mLifetime : mDefaultReplicaLifetime;
+            std::shared_ptr<SReplica> dstReplica = createReplica(file, dstStorageElement, now + lifetime);
+            if(dstReplica == nullptr)
+                break;
+
+            if(mFixedTimeTransferMgr)
+            {
+                const TickType duration = (record.mDuration > 0) ? record.mDuration : mDefaultTransferDuration;
+                mFixedTimeTransferMgr->CreateTransfer(srcReplica, dstReplica, now, duration);
+            }
+            else
+            {
+                assert(mTransferMgr);
+                mTransferMgr->CreateTransfer(srcReplica, dstReplica, now);
+            }
+            wasReplayed = true;
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        if(wasReplayed)
+            ++mNumReplayedRecords;
+        else
+            ++mNumSkippedRecords;
+    }
+
+    COutput::GetRef().QueueInserts(std::move(fileInsertStmts));
+    COutput::GetRef().QueueInserts(std::move(replicaInsertStmts));
+
+    if(mTraceFileIdToFile.size() > (2 * mNumFilesAfterLastPurge) + 1024)
+        PurgeExpiredFiles(now);
+    ReleaseConsumedPages();
+
+    if(mNextRecordIdx < mNumRecords)
+        mNextCallTick = record.mTick;
+    else
+        std::cout << "Trace replay finished: " << mNumReplayedRecords << " replayed, " << mNumSkippedRecords << " skipped" << std::endl;
+
+    mUpdateDurationSummed += std::chrono::high_resolution_clock::now() - curRealtime;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.h"
+#include "CScheduleable.hpp"
+
+class IBaseSim;
+class COutputAggregator;
+class CStorageElement;
+class CTransferManager;
+class CFixedTimeTransferManager;
+struct SFile;
+
+namespace fs = std::filesystem;
+
+
+
+#define TRACE_MAGIC ("GACSTRC")
+#define TRACE_VERSION (1)
+#define TRACE_INVALID_IDX (0xFFFFFFFF)
+
+// binary trace layout:
+// [STraceHeader][STraceRecord * mNumRecords][storage element name table]
+// the name table consists of mNumStorageElements entries of (uint32 length, chars)
+struct STraceHeader
+{
+    char mMagic[8];
+    std::uint32_t mVersion;
+    std::uint32_t mNumStorageElements;
+    std::uint64_t mNumRecords;
+    std::uint64_t mStorageElementTableOffset;
+};
+
+struct STraceRecord
+{
+    enum EType : std::uint8_t
+    {
+        eFileCreation = 0,      // creates a file and, if mDstStorageElementIdx is valid, a complete replica
+        eReplicaCreation = 1,   // creates a complete replica of an existing file
+        eTransfer = 2           // creates a replica at dst and a transfer from src to it
+    };
+
+    TickType mTick;
+    std::uint64_t mFileId;
+    std::uint32_t mFileSize;
+    std::uint32_t mLifetime;
+    std::uint32_t mSrcStorageElementIdx;
+    std::uint32_t mDstStorageElementIdx;
+    std::uint32_t mDuration;
+    std::uint8_t mType;
+    std::uint8_t mPadding[3];
+};
+
+static_assert(sizeof(STraceHeader) == 32, "unexpected trace header size");
+static_assert(sizeof(STraceRecord) == 40, "unexpected trace record size");
+
+
+
+class CTraceWriter
+{
+private:
+    std::ofstream mFile;
+    STraceHeader mHeader;
+    TickType mLastTick = 0;
+
+    std::unordered_map<std::string, std::uint32_t> mStorageElementNameToIdx;
+    std::unordered_map<const CStorageElement*, std::uint32_t> mStorageElementToIdx;
+    std::vector<std::string> mStorageElementNames;
+
+    void AddRecord(const STraceRecord& record);
+
+public:
+    CTraceWriter() = default;
+    ~CTraceWriter();
+
+    bool Open(const fs::path& tracePath);
+    bool Close();
+
+    auto GetStorageElementIdx(const std::string& name) -> std::uint32_t;
+    auto GetStorageElementIdx(const CStorageElement* storageElement) -> std::uint32_t;
+
+    void AddFileCreation(const TickType tick, const std::uint64_t fileId, const std::uint32_t fileSize, const std::uint32_t lifetime, const std::uint32_t dstStorageElementIdx=TRACE_INVALID_IDX);
+    void AddReplicaCreation(const TickType tick, const std::uint64_t fileId, const std::uint32_t dstStorageElementIdx, const std::uint32_t lifetime);
+    void AddTransfer(const TickType tick, const std::uint64_t fileId, const std::uint32_t srcStorageElementIdx, const std::uint32_t dstStorageElementIdx, const std::uint32_t lifetime=0, const std::uint32_t duration=0);
+    void AddTransfer(const TickType tick, const std::uint64_t fileId, const CStorageElement* srcStorageElement, const CStorageElement* dstStorageElement, const TickType lifetime, const TickType duration=0);
+
+    inline auto GetNumRecords() const -> std::uint64_t
+    {return mHeader.mNumRecords;}
+
+    // csv columns: tick,type,fileId,fileSize,lifetime,srcStorageElement,dstStorageElement[,duration]
+    // type is one of: file, replica, transfer. Rows must be sorted by tick.
+    static bool ConvertCSV(const fs::path& csvPath, const fs::path& tracePath);
+};
+
+
+
+class CTraceReplay : public CScheduleable
+{
+private:
+    IBaseSim* mSim;
+
+    int mFileDescriptor = -1;
+    const unsigned char* mData = nullptr;
+    std::size_t mDataSize = 0;
+    std::size_t mNumReleasedBytes = 0;
+
+    const unsigned char* mRecordsBegin = nullptr;
+    std::uint64_t mNumRecords = 0;
+    std::uint64_t mNextRecordIdx = 0;
+
+    // trace storage element idx -> storage element of the sim (nullptr if unknown)
+    std::vector<CStorageElement*> mStorageElements;
+
+    // only contains files that were not expired at the last purge
+    std::unordered_map<std::uint64_t, std::pair<SFile*, TickType>> mTraceFileIdToFile;
+    std::size_t mNumFilesAfterLastPurge = 0;
+
+    auto FindFile(const std::uint64_t traceFileId, const TickType now) -> SFile*;
+    void PurgeExpiredFiles(const TickType now);
+    void ReleaseConsumedPages();
+    void Close();
+
+public:
+    std::shared_ptr<CTransferManager> mTransferMgr;
+    std::shared_ptr<CFixedTimeTransferManager> mFixedTimeTransferMgr;
+    std::shared_ptr<COutputAggregator> mAggregator;
+
+    TickType mDefaultTransferDuration = 60;
+    TickType mDefaultReplicaLifetime = SECONDS_PER_DAY;
+
+    std::uint64_t mNumReplayedRecords = 0;
+    std::uint64_t mNumSkippedRecords = 0;
+
+public:
+    CTraceReplay(IBaseSim* sim, const TickType startTick=0);
+    ~CTraceReplay();
+
+    bool Open(const fs::path& tracePath, const std::vector<CStorageElement*>& storageElements);
+
+    void OnUpdate(const TickType now) final;
+};
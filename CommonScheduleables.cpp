@@ -8,10 +8,14 @@
 #include "IBaseCloud.hpp"
 #include "IBaseSim.hpp"
 
+#include "CFilePopularity.hpp"
 #include "CLinkSelector.hpp"
 #include "CRucio.hpp"
 #include "COutput.hpp"
+#include "COutputAggregator.hpp"
+#include "COutputTables.hpp"
 #include "CStorageElement.hpp"
+#include "CTraceReplay.hpp"
 #include "CommonScheduleables.hpp"
 #include "SFile.hpp"
 
@@ -20,9 +24,7 @@ CDataGenerator::CDataGenerator(IBaseSim* sim, const std::uint32_t tickFreq, cons
     : CScheduleable(startTick),
       mSim(sim),
       mTickFreq(tickFreq)
-{
-    mOutputQueryIdx = COutput::GetRef().AddPreparedSQLStatement("INSERT INTO Files VALUES(?, ?, ?, ?);");
-}
+{}
 
 void CDataGenerator::OnUpdate(const TickType now)
 {
@@ -67,9 +69,10 @@ auto CDataGenerator::CreateFilesAndReplicas(const std::uint32_t numFiles, const
 
     assert(numReplicasPerFile <= numStorageElements);
 
-    auto fileInsertStmts = std::make_unique<CInsertStatements>(mOutputQueryIdx, numFiles * 4);
-    auto replicaInsertStmts = std::make_unique<CInsertStatements>(CStorageElement::mOutputQueryIdx, numFiles * numReplicasPerFile * 2);
+    auto fileInsertStmts = CTypedInsertStatements<tables::CFilesTable>::Acquire(numFiles);
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire(numFiles * numReplicasPerFile);
     std::uniform_int_distribution<std::uint32_t> rngSampler(0, numStorageElements);
+    CZipfFilePopularity* const filePopularity = mSim->mRucio->mFilePopularity.get();
     std::uint64_t bytesOfFilesGen = 0;
     for(std::uint32_t i = 0; i < numFiles; ++i)
     {
@@ -78,10 +81,15 @@ auto CDataGenerator::CreateFilesAndReplicas(const std::uint32_t numFiles, const
 
         SFile* const file = mSim->mRucio->CreateFile(fileSize, now + lifetime);
 
-        fileInsertStmts->AddValue(file->GetId());
-        fileInsertStmts->AddValue(now);
-        fileInsertStmts->AddValue(now + lifetime);
-        fileInsertStmts->AddValue(fileSize);
+        if(filePopularity != nullptr)
+            filePopularity->AddFile(file, mSim->mRNGEngine);
+
+        fileInsertStmts->AddRow(file->GetId(), now, now + lifetime, fileSize);
+        if(mAggregator)
+            mAggregator->AddFile(file);
+
+        if(mDecisionRecorder)
+            mDecisionRecorder->AddFileCreation(now, file->GetId(), fileSize, static_cast<std::uint32_t>(lifetime));
 
         bytesOfFilesGen += fileSize;
 
@@ -93,11 +101,9 @@ auto CDataGenerator::CreateFilesAndReplicas(const std::uint32_t numFiles, const
             auto r = (*selectedElementIt)->CreateReplica(file);
             r->Increase(fileSize, now);
             r->mExpiresAt = now + (lifetime / numReplicasPerFile);
-            replicaInsertStmts->AddValue(r->GetId());
-            replicaInsertStmts->AddValue(file->GetId());
-            replicaInsertStmts->AddValue((*selectedElementIt)->GetId());
-            replicaInsertStmts->AddValue(now);
-            replicaInsertStmts->AddValue(r->mExpiresAt);
+            replicaInsertStmts->AddRow(r->GetId(), file->GetId(), (*selectedElementIt)->GetId(), now, r->mExpiresAt);
+            if(mDecisionRecorder)
+                mDecisionRecorder->AddReplicaCreation(now, file->GetId(), mDecisionRecorder->GetStorageElementIdx(*selectedElementIt), static_cast<std::uint32_t>(r->mExpiresAt - now));
             std::iter_swap(selectedElementIt, reverseRSEIt);
 			++reverseRSEIt;
         }
@@ -126,13 +132,59 @@ void CReaper::OnUpdate(const TickType now)
 
 
 
-CBillingGenerator::CBillingGenerator(IBaseSim* sim, const std::uint32_t tickFreq, const TickType startTick)
-    : CScheduleable(startTick),
+CBillingGenerator::CBillingGenerator(IBaseSim* sim, const std::uint32_t tickFreq, const TickType startTick, const std::uint32_t costSeriesTickFreq)
+    : CScheduleable((costSeriesTickFreq > 0) ? std::min<TickType>(costSeriesTickFreq, startTick) : startTick),
       mSim(sim),
-      mTickFreq(tickFreq)
+      mTickFreq(tickFreq),
+      mNextBillingTick(startTick),
+      mCostSeriesTickFreq(costSeriesTickFreq)
 {}
 
 void CBillingGenerator::OnUpdate(const TickType now)
+{
+    auto curRealtime = std::chrono::high_resolution_clock::now();
+
+    // the costs are accrued continuously by the buckets and links, so collecting them
+    // only has to sum up the regions. The sums are kept until the next billing
+    std::unique_ptr<CTypedInsertStatements<tables::CCloudCostsTable>> costInserts;
+    if(mCostSeriesTickFreq > 0)
+        costInserts = CTypedInsertStatements<tables::CCloudCostsTable>::Acquire();
+
+    mBillingCosts.resize(mSim->mClouds.size());
+    for(std::size_t cloudIdx = 0; cloudIdx < mSim->mClouds.size(); ++cloudIdx)
+    {
+        mSiteCosts.clear();
+        mSim->mClouds[cloudIdx]->CollectCosts(now, mSiteCosts);
+
+        SSiteCosts& billingCosts = mBillingCosts[cloudIdx];
+        for(const SSiteCosts& siteCosts : mSiteCosts)
+        {
+            billingCosts.mStorageCosts += siteCosts.mStorageCosts;
+            billingCosts.mNetworkCosts += siteCosts.mNetworkCosts;
+            billingCosts.mTraffic += siteCosts.mTraffic;
+            billingCosts.mNumDoneTransfers += siteCosts.mNumDoneTransfers;
+            if(costInserts)
+                costInserts->AddRow(now, siteCosts.mSiteId, siteCosts.mStorageCosts, siteCosts.mNetworkCosts, siteCosts.mTraffic, siteCosts.mNumDoneTransfers);
+        }
+    }
+
+    if(costInserts)
+        COutput::GetRef().QueueInserts(std::move(costInserts));
+
+    if(now >= mNextBillingTick)
+    {
+        PrintBilling(now);
+        mNextBillingTick = now + mTickFreq;
+    }
+
+    mUpdateDurationSummed += std::chrono::high_resolution_clock::now() - curRealtime;
+    if(mCostSeriesTickFreq > 0)
+        mNextCallTick = std::min<TickType>(now + mCostSeriesTickFreq, mNextBillingTick);
+    else
+        mNextCallTick = mNextBillingTick;
+}
+
+void CBillingGenerator::PrintBilling(const TickType now)
 {
     std::stringstream summary;
     const std::string caption = std::string(10, '=') + " Monthly Summary " + std::string(10, '=');
@@ -157,20 +209,19 @@ void CBillingGenerator::OnUpdate(const TickType now)
             link->mDoneTransfers = 0;
         }
     }
-    for(auto& cloud : mSim->mClouds)
+    for(std::size_t cloudIdx = 0; cloudIdx < mSim->mClouds.size(); ++cloudIdx)
     {
+        SSiteCosts& billingCosts = mBillingCosts[cloudIdx];
         summary << std::endl;
-        summary<<cloud->GetName()<<" - Billing for Month "<<SECONDS_TO_MONTHS(now)<<":\n";
-        auto res = cloud->ProcessBilling(now);
-        summary << "\tStorage: " << res.first << " CHF" << std::endl;
-        summary << "\tNetwork: " << res.second.first << " CHF" << std::endl;
-        summary << "\tNetwork: " << res.second.second << " GiB" << std::endl;
+        summary<<mSim->mClouds[cloudIdx]->GetName()<<" - Billing for Month "<<SECONDS_TO_MONTHS(now)<<":\n";
+        summary << "\tStorage: " << billingCosts.mStorageCosts << " CHF" << std::endl;
+        summary << "\tNetwork: " << billingCosts.mNetworkCosts << " CHF" << std::endl;
+        summary << "\tNetwork: " << BYTES_TO_GiB(billingCosts.mTraffic) << " GiB" << std::endl;
+        billingCosts = SSiteCosts();
     }
 
     summary << std::string(caption.length(), '=') << std::endl;
     std::cout << summary.str() << std::endl;
-
-    mNextCallTick = now + mTickFreq;
 }
 
 
@@ -190,7 +241,6 @@ CTransferManager::CTransferManager(const std::uint32_t tickFreq, const TickType
       mTickFreq(tickFreq)
 {
     mActiveTransfers.reserve(1024*1024);
-    mOutputQueryIdx = COutput::GetRef().AddPreparedSQLStatement("INSERT INTO Transfers VALUES(?, ?, ?, ?, ?);");
 }
 
 void CTransferManager::CreateTransfer(std::shared_ptr<SReplica> srcReplica, std::shared_ptr<SReplica> dstReplica, const TickType now)
@@ -199,10 +249,13 @@ void CTransferManager::CreateTransfer(std::shared_ptr<SReplica> srcReplica, std:
 
     ISite* const srcSite = srcReplica->GetStorageElement()->GetSite();
     ISite* const dstSite = dstReplica->GetStorageElement()->GetSite();
-    CLinkSelector* const linkSelector = srcSite->GetLinkSelector(dstSite);
+    CLinkSelector* const linkSelector = srcSite->GetOrCreateLinkSelector(dstSite);
+    assert(linkSelector != nullptr);
 
     linkSelector->mNumActiveTransfers += 1;
     mActiveTransfers.emplace_back(srcReplica, dstReplica, linkSelector, now);
+    if(mAggregator)
+        mAggregator->AddPendingTransfer(now);
 }
 
 void CTransferManager::OnUpdate(const TickType now)
@@ -213,7 +266,7 @@ void CTransferManager::OnUpdate(const TickType now)
 
     std::size_t idx = 0;
     std::uint64_t summedTraffic = 0;
-    auto outputs = std::make_unique<CInsertStatements>(mOutputQueryIdx, 6 + mActiveTransfers.size());
+    auto outputs = CTypedInsertStatements<tables::CTransfersTable>::Acquire();
 
     while (idx < mActiveTransfers.size())
     {
@@ -224,6 +277,8 @@ void CTransferManager::OnUpdate(const TickType now)
 
         if(!srcReplica || !dstReplica)
         {
+            if(mAggregator)
+                mAggregator->RemovePendingTransfer(transfer.mStartTick);
             linkSelector->mFailedTransfers += 1;
             linkSelector->mNumActiveTransfers -= 1;
             transfer = std::move(mActiveTransfers.back());
@@ -235,15 +290,13 @@ void CTransferManager::OnUpdate(const TickType now)
         std::uint32_t amount = static_cast<std::uint32_t>(sharedBandwidth * timeDiff);
         amount = dstReplica->Increase(amount, now);
         summedTraffic += amount;
-        linkSelector->mUsedTraffic += amount;
+        linkSelector->AddTraffic(amount);
 
         if(dstReplica->IsComplete())
         {
-            outputs->AddValue(GetNewId());
-            outputs->AddValue(srcReplica->GetId());
-            outputs->AddValue(dstReplica->GetId());
-            outputs->AddValue(transfer.mStartTick);
-            outputs->AddValue(now);
+            outputs->AddRow(GetNewId(), srcReplica->GetId(), dstReplica->GetId(), transfer.mStartTick, now);
+            if(mAggregator)
+                mAggregator->AddTransfer(srcReplica.get(), transfer.mStartTick, now);
 
             ++mNumCompletedTransfers;
             mSummedTransferDuration += now - transfer.mStartTick;
@@ -282,7 +335,6 @@ CFixedTimeTransferManager::CFixedTimeTransferManager(const std::uint32_t tickFre
       mTickFreq(tickFreq)
 {
     mActiveTransfers.reserve(1024*1024);
-    mOutputQueryIdx = COutput::GetRef().AddPreparedSQLStatement("INSERT INTO Transfers VALUES(?, ?, ?, ?, ?);");
 }
 
 void CFixedTimeTransferManager::CreateTransfer(std::shared_ptr<SReplica> srcReplica, std::shared_ptr<SReplica> dstReplica, const TickType now, const TickType duration)
@@ -291,12 +343,15 @@ void CFixedTimeTransferManager::CreateTransfer(std::shared_ptr<SReplica> srcRepl
 
     ISite* const srcSite = srcReplica->GetStorageElement()->GetSite();
     ISite* const dstSite = dstReplica->GetStorageElement()->GetSite();
-    CLinkSelector* const linkSelector = srcSite->GetLinkSelector(dstSite);
+    CLinkSelector* const linkSelector = srcSite->GetOrCreateLinkSelector(dstSite);
+    assert(linkSelector != nullptr);
 
     std::uint32_t increasePerTick = static_cast<std::uint32_t>(static_cast<double>(srcReplica->GetFile()->GetSize()) / duration);
 
     linkSelector->mNumActiveTransfers += 1;
     mActiveTransfers.emplace_back(srcReplica, dstReplica, linkSelector, now, std::max(1U, increasePerTick));
+    if(mAggregator)
+        mAggregator->AddPendingTransfer(now);
 }
 
 void CFixedTimeTransferManager::OnUpdate(const TickType now)
@@ -307,7 +362,7 @@ void CFixedTimeTransferManager::OnUpdate(const TickType now)
 
     std::size_t idx = 0;
     std::uint64_t summedTraffic = 0;
-    auto outputs = std::make_unique<CInsertStatements>(mOutputQueryIdx, 6 + mActiveTransfers.size());
+    auto outputs = CTypedInsertStatements<tables::CTransfersTable>::Acquire();
 
     while (idx < mActiveTransfers.size())
     {
@@ -318,6 +373,8 @@ void CFixedTimeTransferManager::OnUpdate(const TickType now)
 
         if(!srcReplica || !dstReplica)
         {
+            if(mAggregator)
+                mAggregator->RemovePendingTransfer(transfer.mStartTick);
             linkSelector->mFailedTransfers += 1;
             linkSelector->mNumActiveTransfers -= 1;
             transfer = std::move(mActiveTransfers.back());
@@ -327,15 +384,13 @@ void CFixedTimeTransferManager::OnUpdate(const TickType now)
 
         std::uint32_t amount = dstReplica->Increase(transfer.mIncreasePerTick * timeDiff, now);
         summedTraffic += amount;
-        linkSelector->mUsedTraffic += amount;
+        linkSelector->AddTraffic(amount);
 
         if(dstReplica->IsComplete())
         {
-            outputs->AddValue(GetNewId());
-            outputs->AddValue(srcReplica->GetId());
-            outputs->AddValue(dstReplica->GetId());
-            outputs->AddValue(transfer.mStartTick);
-            outputs->AddValue(now);
+            outputs->AddRow(GetNewId(), srcReplica->GetId(), dstReplica->GetId(), transfer.mStartTick, now);
+            if(mAggregator)
+                mAggregator->AddTransfer(srcReplica.get(), transfer.mStartTick, now);
 
             ++mNumCompletedTransfers;
             mSummedTransferDuration += now - transfer.mStartTick;
@@ -399,7 +454,7 @@ void CUniformTransferGen::OnUpdate(const TickType now)
     const std::uint32_t numToCreate = mTransferNumGen->GetNumToCreate(rngEngine, numActive, now);
     const std::uint32_t numToCreatePerRSE = static_cast<std::uint32_t>( numToCreate/static_cast<double>(mSrcStorageElements.size()) );
 
-    auto replicaInsertStmts = std::make_unique<CInsertStatements>(CStorageElement::mOutputQueryIdx, numToCreate * 2);
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire();
 
     std::uint32_t totalTransfersCreated = 0;
     for(CStorageElement* srcStorageElement : mSrcStorageElements)
@@ -420,11 +475,9 @@ void CUniformTransferGen::OnUpdate(const TickType now)
                 std::shared_ptr<SReplica> newReplica = dstStorageElement->CreateReplica(file);
                 if(newReplica != nullptr)
                 {
-                    replicaInsertStmts->AddValue(newReplica->GetId());
-                    replicaInsertStmts->AddValue(file->GetId());
-                    replicaInsertStmts->AddValue(dstStorageElement->GetId());
-                    replicaInsertStmts->AddValue(now);
-                    replicaInsertStmts->AddValue(newReplica->mExpiresAt);
+                    replicaInsertStmts->AddRow(newReplica->GetId(), file->GetId(), dstStorageElement->GetId(), now, newReplica->mExpiresAt);
+                    if(mDecisionRecorder)
+                        mDecisionRecorder->AddTransfer(now, file->GetId(), srcStorageElement, dstStorageElement, newReplica->mExpiresAt - now);
                     mTransferMgr->CreateTransfer(curReplica, newReplica, now);
                     ++numCreated;
                 }
@@ -471,7 +524,7 @@ void CExponentialTransferGen::OnUpdate(const TickType now)
     const std::uint32_t numActive = static_cast<std::uint32_t>(mTransferMgr->GetNumActiveTransfers());
     const std::uint32_t numToCreate = mTransferNumGen->GetNumToCreate(rngEngine, numActive, now);
 
-    auto replicaInsertStmts = std::make_unique<CInsertStatements>(CStorageElement::mOutputQueryIdx, numToCreate * 2);
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire();
 
     for(std::uint32_t totalTransfersCreated=0; totalTransfersCreated<numToCreate; ++totalTransfersCreated)
     {
@@ -492,11 +545,9 @@ void CExponentialTransferGen::OnUpdate(const TickType now)
                     std::shared_ptr<SReplica> newReplica = dstStorageElement->CreateReplica(file);
                     if(newReplica != nullptr)
                     {
-                        replicaInsertStmts->AddValue(newReplica->GetId());
-                        replicaInsertStmts->AddValue(file->GetId());
-                        replicaInsertStmts->AddValue(dstStorageElement->GetId());
-                        replicaInsertStmts->AddValue(now);
-                        replicaInsertStmts->AddValue(newReplica->mExpiresAt);
+                        replicaInsertStmts->AddRow(newReplica->GetId(), file->GetId(), dstStorageElement->GetId(), now, newReplica->mExpiresAt);
+                        if(mDecisionRecorder)
+                            mDecisionRecorder->AddTransfer(now, file->GetId(), srcStorageElement, dstStorageElement, newReplica->mExpiresAt - now);
                         mTransferMgr->CreateTransfer(curReplica, newReplica, now);
                         wasTransferCreated = true;
                         break;
@@ -521,6 +572,119 @@ void CExponentialTransferGen::OnUpdate(const TickType now)
 
 
 
+// returns the complete replica with the lowest source priority. If the lowest priority is
+// greater than 0, the replica with the cheapest link to dstSite is chosen among them.
+// Remaining ties are won by the replica stored first in file->mReplicas.
+// The selection is cached at the file. Replicas completed since the selection are only compared
+// against it, so completions of worse replicas keep it valid. Removals of replicas and weight
+// changes of links to dstSite require a full reevaluation. Links are never created for the weights.
+// Returns nullptr if there is no valid source
+static auto SelectSrcReplica(const void* const selector,
+                             const std::unordered_map<IdType, int>& srcStorageElementIdToPrio,
+                             SFile* const file,
+                             ISite* const dstSite,
+                             SCacheStats& cacheStats) -> const std::shared_ptr<SReplica>*
+{
+    constexpr std::uint32_t noReplicaIdx = std::numeric_limits<std::uint32_t>::max();
+    const std::vector<std::shared_ptr<SReplica>>& replicas = file->mReplicas;
+
+    // a selection of priority 0 does not depend on link weights and is valid for any dst site
+    SFile::SSrcSelection* selection = nullptr;
+    for(SFile::SSrcSelection& cachedSelection : file->mSrcSelectionCache)
+    {
+        if(cachedSelection.mSelector != selector)
+            continue;
+        if(cachedSelection.mDstSite == dstSite)
+        {
+            selection = &cachedSelection;
+            break;
+        }
+        if(cachedSelection.mPrio == 0)
+            selection = &cachedSelection;
+    }
+
+    bool isFullReevaluation = true;
+    if(selection == nullptr)
+    {
+        std::vector<SFile::SSrcSelection>& cache = file->mSrcSelectionCache;
+        if(cache.size() < SRC_SELECTION_CACHE_SIZE)
+        {
+            cache.push_back({selector, dstSite, 0, 0, 0, noReplicaIdx, 0, 0});
+            selection = &(cache.back());
+        }
+        else
+        {
+            selection = &(cache[file->mNextSrcSelectionToReplace]);
+            *selection = {selector, dstSite, 0, 0, 0, noReplicaIdx, 0, 0};
+            file->mNextSrcSelectionToReplace = (file->mNextSrcSelectionToReplace + 1) % SRC_SELECTION_CACHE_SIZE;
+        }
+    }
+    else if(selection->mReplicaRemovalVersion == file->mReplicaRemovalVersion
+            && (selection->mPrio == 0 || selection->mLinkWeightVersion == dstSite->mInLinkWeightVersion))
+        isFullReevaluation = false;
+
+    // replaces the selection if replicas[i] is a better source
+    bool wasReplaced = false;
+    auto considerReplica = [&](const std::size_t i)
+    {
+        SReplica* const replica = replicas[i].get();
+        const auto result = srcStorageElementIdToPrio.find(replica->GetStorageElement()->GetId());
+        if(result == srcStorageElementIdToPrio.cend() || result->second > selection->mPrio)
+            return;
+
+        double weight = 0;
+        if(result->second > 0)
+            weight = replica->GetStorageElement()->GetSite()->GetLinkWeight(dstSite);
+
+        if(result->second == selection->mPrio)
+        {
+            if(weight > selection->mWeight || (weight == selection->mWeight && i > selection->mReplicaIdx))
+                return;
+        }
+        selection->mReplicaIdx = static_cast<std::uint32_t>(i);
+        selection->mPrio = result->second;
+        selection->mWeight = weight;
+        wasReplaced = true;
+    };
+
+    if(isFullReevaluation)
+    {
+        cacheStats.mNumMisses += 1;
+        selection->mReplicaIdx = noReplicaIdx;
+        selection->mPrio = std::numeric_limits<int>::max();
+        for(std::size_t i = 0; i < replicas.size(); ++i)
+            if(replicas[i]->mCompletionIdx > 0)
+                considerReplica(i);
+    }
+    else
+    {
+        // without removals, exactly these replicas have a completion index above the known one.
+        // New replicas are appended, so they are searched from the back
+        const std::uint32_t numKnownCompletions = selection->mNumReplicaCompletions;
+        std::uint32_t numNewCompletions = file->mNumReplicaCompletions - numKnownCompletions;
+        for(std::size_t i = replicas.size(); i > 0 && numNewCompletions > 0; --i)
+        {
+            if(replicas[i - 1]->mCompletionIdx <= numKnownCompletions)
+                continue;
+            numNewCompletions -= 1;
+            considerReplica(i - 1);
+        }
+        if(wasReplaced)
+            cacheStats.mNumUpdates += 1;
+        else
+            cacheStats.mNumHits += 1;
+    }
+
+    selection->mDstSite = dstSite;
+    selection->mNumReplicaCompletions = file->mNumReplicaCompletions;
+    selection->mReplicaRemovalVersion = file->mReplicaRemovalVersion;
+    selection->mLinkWeightVersion = dstSite->mInLinkWeightVersion;
+
+    if(selection->mReplicaIdx == noReplicaIdx)
+        return nullptr;
+    return &(replicas[selection->mReplicaIdx]);
+}
+
 CSrcPrioTransferGen::CSrcPrioTransferGen(IBaseSim* sim,
                                          std::shared_ptr<CTransferManager> transferMgr,
                                          std::shared_ptr<CBaseTransferNumGen> transferNumGen,
@@ -544,19 +708,26 @@ void CSrcPrioTransferGen::OnUpdate(const TickType now)
     RNGEngineType& rngEngine = mSim->mRNGEngine;
     std::exponential_distribution<double> dstStorageElementRndSelecter(0.25);
     std::uniform_int_distribution<std::size_t> fileRndSelector(0, allFiles.size() - 1);
+    CZipfFilePopularity* const filePopularity = mSim->mRucio->mFilePopularity.get();
+    auto sampleFile = [&]() -> SFile*
+    {
+        if(filePopularity != nullptr && filePopularity->GetNumFiles() > 0)
+            return filePopularity->SampleFile(rngEngine);
+        return allFiles[fileRndSelector(rngEngine)].get();
+    };
 
     const std::uint32_t numActive = static_cast<std::uint32_t>(mTransferMgr->GetNumActiveTransfers());
     const std::uint32_t numToCreate = mTransferNumGen->GetNumToCreate(rngEngine, numActive, now);
 
-    auto replicaInsertStmts = std::make_unique<CInsertStatements>(CStorageElement::mOutputQueryIdx, numToCreate * 2);
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire();
     std::uint32_t flexCreationLimit = numToCreate;
     for(std::uint32_t totalTransfersCreated=0; totalTransfersCreated< flexCreationLimit; ++totalTransfersCreated)
     {
         CStorageElement* const dstStorageElement = mDstStorageElements[static_cast<std::size_t>(dstStorageElementRndSelecter(rngEngine) * 2) % numDstStorageElements];
-        SFile* fileToTransfer = allFiles[fileRndSelector(rngEngine)].get();
+        SFile* fileToTransfer = sampleFile();
 
         for(std::uint32_t i = 0; i < 5 && fileToTransfer->mReplicas.empty() && fileToTransfer->mExpiresAt < (now + 100); ++i)
-            fileToTransfer = allFiles[fileRndSelector(rngEngine)].get();
+            fileToTransfer = sampleFile();
 
         const std::vector<std::shared_ptr<SReplica>>& replicas = fileToTransfer->mReplicas;
         if(replicas.empty())
@@ -569,54 +740,18 @@ void CSrcPrioTransferGen::OnUpdate(const TickType now)
         if(newReplica != nullptr)
         {
             newReplica->mExpiresAt = now + SECONDS_PER_DAY;
-            int minPrio = std::numeric_limits<int>::max();
-            std::vector<std::shared_ptr<SReplica>> bestSrcReplicas;
-            for(const std::shared_ptr<SReplica>& replica : replicas)
-            {
-                if(!replica->IsComplete())
-                    continue; // at least the newly created one will be skipped
-
-                const auto result = mSrcStorageElementIdToPrio.find(replica->GetStorageElement()->GetId());
-                if(result != mSrcStorageElementIdToPrio.cend())
-                {
-                    if(result->second < minPrio)
-                    {
-                        minPrio = result->second;
-                        bestSrcReplicas.clear();
-                        bestSrcReplicas.emplace_back(replica);
-                    }
-                    else if(result->second == minPrio)
-                        bestSrcReplicas.emplace_back(replica);
-                }
-            }
-
-            if(bestSrcReplicas.empty())
+            const std::shared_ptr<SReplica>* const bestSrcReplicaPtr = SelectSrcReplica(this, mSrcStorageElementIdToPrio, fileToTransfer, dstStorageElement->GetSite(), *mSrcSelectionCacheStats);
+            if(bestSrcReplicaPtr == nullptr)
             {
                 flexCreationLimit += 1;
                 continue;
             }
 
-            std::shared_ptr<SReplica> bestSrcReplica = bestSrcReplicas[0];
-            if (minPrio > 0)
-            {
-                const ISite* const dstSite = dstStorageElement->GetSite();
-                double minWeight = std::numeric_limits<double>::max();
-                for (std::shared_ptr<SReplica>& replica : bestSrcReplicas)
-                {
-                    double w = replica->GetStorageElement()->GetSite()->GetLinkSelector(dstSite)->GetWeight();
-                    if (w < minWeight)
-                    {
-                        minWeight = w;
-                        bestSrcReplica = replica;
-                    }
-                }
-            }
-            replicaInsertStmts->AddValue(newReplica->GetId());
-            replicaInsertStmts->AddValue(fileToTransfer->GetId());
-            replicaInsertStmts->AddValue(dstStorageElement->GetId());
-            replicaInsertStmts->AddValue(now);
-            replicaInsertStmts->AddValue(newReplica->mExpiresAt);
+            const std::shared_ptr<SReplica> bestSrcReplica = *bestSrcReplicaPtr;
+            replicaInsertStmts->AddRow(newReplica->GetId(), fileToTransfer->GetId(), dstStorageElement->GetId(), now, newReplica->mExpiresAt);
 
+            if(mDecisionRecorder)
+                mDecisionRecorder->AddTransfer(now, fileToTransfer->GetId(), bestSrcReplica->GetStorageElement(), dstStorageElement, newReplica->mExpiresAt - now);
             mTransferMgr->CreateTransfer(bestSrcReplica, newReplica, now);
         }
         else
@@ -634,14 +769,39 @@ void CSrcPrioTransferGen::OnUpdate(const TickType now)
 
 
 
+CJobSlotTransferGen::CJobSlotInfo::CJobSlotInfo(const std::uint32_t numMaxSlots)
+    : mNumMaxSlots(numMaxSlots)
+{}
+
+void CJobSlotTransferGen::CJobSlotInfo::ReleaseFinishedJobs(const TickType now)
+{
+    while(!mSchedule.empty() && mSchedule.top().first <= now)
+    {
+        assert(mNumUsedSlots >= mSchedule.top().second);
+        mNumUsedSlots -= mSchedule.top().second;
+        mSchedule.pop();
+    }
+}
+
+void CJobSlotTransferGen::CJobSlotInfo::AddJobs(const TickType finishTick, const std::uint32_t numSlots)
+{
+    assert((mNumUsedSlots + numSlots) <= mNumMaxSlots);
+    mNumUsedSlots += numSlots;
+    mSchedule.emplace(finishTick, numSlots);
+}
+
 CJobSlotTransferGen::CJobSlotTransferGen(IBaseSim* sim,
                                          std::shared_ptr<CFixedTimeTransferManager> transferMgr,
                                          const std::uint32_t tickFreq,
+                                         const TickType jobDuration,
+                                         const TickType transferDuration,
                                          const TickType startTick )
     : CScheduleable(startTick),
       mSim(sim),
       mTransferMgr(transferMgr),
-      mTickFreq(tickFreq)
+      mTickFreq(tickFreq),
+      mJobDuration(jobDuration),
+      mTransferDuration(transferDuration)
 {}
 
 void CJobSlotTransferGen::OnUpdate(const TickType now)
@@ -653,40 +813,33 @@ void CJobSlotTransferGen::OnUpdate(const TickType now)
 
     RNGEngineType& rngEngine = mSim->mRNGEngine;
     std::uniform_int_distribution<std::size_t> fileRndSelector(0, allFiles.size() - 1);
+    CZipfFilePopularity* const filePopularity = mSim->mRucio->mFilePopularity.get();
+    auto sampleFile = [&]() -> SFile*
+    {
+        if(filePopularity != nullptr && filePopularity->GetNumFiles() > 0)
+            return filePopularity->SampleFile(rngEngine);
+        return allFiles[fileRndSelector(rngEngine)].get();
+    };
 
 
-    auto replicaInsertStmts = std::make_unique<CInsertStatements>(CStorageElement::mOutputQueryIdx, 512);
+    auto replicaInsertStmts = CTypedInsertStatements<tables::CReplicasTable>::Acquire();
     for(auto& dstInfo : mDstInfo)
     {
         CStorageElement* const dstStorageElement = dstInfo.first;
-        SJobSlotInfo& jobSlotInfo = dstInfo.second;
+        CJobSlotInfo& jobSlotInfo = dstInfo.second;
 
-        auto& schedule = jobSlotInfo.mSchedule;
-        const std::uint32_t numMaxSlots = jobSlotInfo.mNumMaxSlots;
-        std::uint32_t usedSlots = 0;
-        for(std::size_t idx=0; idx<schedule.size();)
-        {
-            if(schedule[idx].first <= now)
-            {
-                schedule[idx] = std::move(schedule.back());
-                schedule.pop_back();
-                continue;
-            }
-            usedSlots += schedule[idx].second;
-            idx += 1;
-        }
- 
-        assert(numMaxSlots >= usedSlots);
+        jobSlotInfo.ReleaseFinishedJobs(now);
 
         // todo: consider mTickFreq
-        std::uint32_t flexCreationLimit = std::min(numMaxSlots - usedSlots, std::uint32_t(1 + (0.01 * numMaxSlots)));
-        std::pair<TickType, std::uint32_t> newJobs = std::make_pair(now+900, 0);
+        const std::uint32_t numMaxSlots = jobSlotInfo.GetNumMaxSlots();
+        std::uint32_t flexCreationLimit = std::min(jobSlotInfo.GetNumFreeSlots(), std::uint32_t(1 + (0.01 * numMaxSlots)));
+        std::uint32_t numNewJobs = 0;
         for(std::uint32_t totalTransfersCreated=0; totalTransfersCreated<flexCreationLimit; ++totalTransfersCreated)
         {
-            SFile* fileToTransfer = allFiles[fileRndSelector(rngEngine)].get();
+            SFile* fileToTransfer = sampleFile();
 
             for(std::uint32_t i = 0; i < 10 && fileToTransfer->mReplicas.empty() && fileToTransfer->mExpiresAt < (now + 100); ++i)
-                fileToTransfer = allFiles[fileRndSelector(rngEngine)].get();
+                fileToTransfer = sampleFile();
 
             const std::vector<std::shared_ptr<SReplica>>& replicas = fileToTransfer->mReplicas;
             if(replicas.empty())
@@ -699,64 +852,28 @@ void CJobSlotTransferGen::OnUpdate(const TickType now)
             if(newReplica != nullptr)
             {
                 newReplica->mExpiresAt = now + SECONDS_PER_DAY;
-                int minPrio = std::numeric_limits<int>::max();
-                std::vector<std::shared_ptr<SReplica>> bestSrcReplicas;
-                for(const std::shared_ptr<SReplica>& replica : replicas)
-                {
-                    if(!replica->IsComplete())
-                        continue; // at least the newly created one will be skipped
-
-                    const auto result = mSrcStorageElementIdToPrio.find(replica->GetStorageElement()->GetId());
-                    if(result != mSrcStorageElementIdToPrio.cend())
-                    {
-                        if(result->second < minPrio)
-                        {
-                            minPrio = result->second;
-                            bestSrcReplicas.clear();
-                            bestSrcReplicas.emplace_back(replica);
-                        }
-                        else if(result->second == minPrio)
-                            bestSrcReplicas.emplace_back(replica);
-                    }
-                }
-
-                if(bestSrcReplicas.empty())
+                const std::shared_ptr<SReplica>* const bestSrcReplicaPtr = SelectSrcReplica(this, mSrcStorageElementIdToPrio, fileToTransfer, dstStorageElement->GetSite(), *mSrcSelectionCacheStats);
+                if(bestSrcReplicaPtr == nullptr)
                 {
                     flexCreationLimit += 1;
                     continue;
                 }
 
-                std::shared_ptr<SReplica> bestSrcReplica = bestSrcReplicas[0];
-                if (minPrio > 0)
-                {
-                    const ISite* const dstSite = dstStorageElement->GetSite();
-                    double minWeight = std::numeric_limits<double>::max();
-                    for (std::shared_ptr<SReplica>& replica : bestSrcReplicas)
-                    {
-                        double w = replica->GetStorageElement()->GetSite()->GetLinkSelector(dstSite)->GetWeight();
-                        if (w < minWeight)
-                        {
-                            minWeight = w;
-                            bestSrcReplica = replica;
-                        }
-                    }
-                }
-                replicaInsertStmts->AddValue(newReplica->GetId());
-                replicaInsertStmts->AddValue(fileToTransfer->GetId());
-                replicaInsertStmts->AddValue(dstStorageElement->GetId());
-                replicaInsertStmts->AddValue(now);
-                replicaInsertStmts->AddValue(newReplica->mExpiresAt);
-
-                mTransferMgr->CreateTransfer(bestSrcReplica, newReplica, now, 60);
-                newJobs.second += 1;
+                const std::shared_ptr<SReplica> bestSrcReplica = *bestSrcReplicaPtr;
+                replicaInsertStmts->AddRow(newReplica->GetId(), fileToTransfer->GetId(), dstStorageElement->GetId(), now, newReplica->mExpiresAt);
+
+                if(mDecisionRecorder)
+                    mDecisionRecorder->AddTransfer(now, fileToTransfer->GetId(), bestSrcReplica->GetStorageElement(), dstStorageElement, newReplica->mExpiresAt - now, mTransferDuration);
+                mTransferMgr->CreateTransfer(bestSrcReplica, newReplica, now, mTransferDuration);
+                numNewJobs += 1;
             }
             else
             {
                 //replica already exists
             }
         }
-        if(newJobs.second > 0)
-            schedule.push_back(newJobs);
+        if(numNewJobs > 0)
+            jobSlotInfo.AddJobs(now + mJobDuration, numNewJobs);
     }
 
     COutput::GetRef().QueueInserts(std::move(replicaInsertStmts));
@@ -819,14 +936,45 @@ void CHeartbeat::OnUpdate(const TickType now)
 	for (auto it : mProccessDurations)
 		if (it.first.size() > maxW)
 			maxW = it.first.size();
+	for (auto it : mCacheStats)
+		if (it.first.size() > maxW)
+			maxW = it.first.size();
 
     statusOutput << "  " << std::setw(maxW) << "Duration" << ": " << std::setw(6) << timeDiff.count() << "s\n";
     for(auto it : mProccessDurations)
     {
         statusOutput << "  " << std::setw(maxW) << it.first;
-        statusOutput << ": " << std::setw(6) << it.second->count();
-        statusOutput << "s ("<< std::setw(5) << (it.second->count() / timeDiff.count()) * 100 << "%)\n";
-        *(it.second) = std::chrono::duration<double>::zero();
+        std::chrono::duration<double>& duration = it.second->mUpdateDurationSummed;
+        statusOutput << ": " << std::setw(6) << duration.count();
+        statusOutput << "s ("<< std::setw(5) << (duration.count() / timeDiff.count()) * 100 << "%)\n";
+        duration = std::chrono::duration<double>::zero();
+    }
+    const COutput& output = COutput::GetRef();
+    std::uint64_t numInsertedRows = 0;
+    for(std::size_t i = 0; i < output.GetNumShards(); ++i)
+    {
+        const COutputShard& shard = output.GetShard(i);
+        const auto& insertQueue = shard.GetInsertQueue();
+        const std::string name = (output.GetNumShards() > 1) ? ("OutputQueue " + shard.GetName()) : "OutputQueue";
+        statusOutput << "  " << std::setw(maxW) << name << ": depth " << insertQueue.GetDepth() << "/" << insertQueue.GetCapacity();
+        statusOutput << "; max depth " << insertQueue.GetHighWaterMark();
+        statusOutput << "; " << insertQueue.GetNumStalls() << " stalls (" << insertQueue.GetStallDuration().count() << "s)";
+        statusOutput << "; transaction size " << shard.GetCurTransactionSize() << "\n";
+        numInsertedRows += shard.GetNumInsertedRows();
+    }
+
+    statusOutput << "  " << std::setw(maxW) << "OutputRows" << ": " << (numInsertedRows - mNumInsertedRowsLastUpdate) / timeDiff.count() << " rows/s\n";
+    mNumInsertedRowsLastUpdate = numInsertedRows;
+    for(auto it : mCacheStats)
+    {
+        SCacheStats& cacheStats = *(it.second);
+        const std::uint64_t numLookups = cacheStats.mNumHits + cacheStats.mNumUpdates + cacheStats.mNumMisses;
+        statusOutput << "  " << std::setw(maxW) << it.first;
+        const double lookupsPercent = (numLookups > 0) ? (100.0 / numLookups) : 0.0;
+        statusOutput << ": " << std::setw(6) << cacheStats.mNumHits * lookupsPercent << "% hits; ";
+        statusOutput << std::setw(6) << cacheStats.mNumUpdates * lookupsPercent << "% updates; ";
+        statusOutput << numLookups << " lookups\n";
+        cacheStats = SCacheStats();
     }
     std::cout << statusOutput.str() << std::endl;
 
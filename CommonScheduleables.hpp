@@ -1,7 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
+#include <queue>
 #include <unordered_map>
+#include <vector>
+
+#include "IBaseCloud.hpp"
 
 #include "constants.h"
 #include "CScheduleable.hpp"
@@ -10,15 +15,27 @@ class IBaseSim;
 class CRucio;
 class CStorageElement;
 class CLinkSelector;
+class COutputAggregator;
+class CTraceWriter;
+class ISite;
+struct SFile;
 struct SReplica;
 
 
 
+// hits kept the cached value, updates only had to compare new entries and misses recomputed it
+struct SCacheStats
+{
+    std::uint64_t mNumHits = 0;
+    std::uint64_t mNumUpdates = 0;
+    std::uint64_t mNumMisses = 0;
+};
+
+
+
 class CDataGenerator : public CScheduleable
 {
 private:
-    std::size_t mOutputQueryIdx;
-
     IBaseSim* mSim;
 
     std::normal_distribution<float> mNumFilesRNG {40, 1};
@@ -35,6 +52,9 @@ private:
 
 public:
     std::vector<CStorageElement*> mStorageElements;
+    std::shared_ptr<CTraceWriter> mDecisionRecorder;
+    std::shared_ptr<COutputAggregator> mAggregator;
+
     CDataGenerator(IBaseSim* sim, const std::uint32_t tickFreq, const TickType startTick=0);
 
     void OnUpdate(const TickType now) final;
@@ -58,9 +78,20 @@ class CBillingGenerator : public CScheduleable
 private:
     IBaseSim* mSim;
     std::uint32_t mTickFreq;
+    TickType mNextBillingTick;
+
+    // the costs are collected every mCostSeriesTickFreq ticks and written to the CloudCosts table.
+    // Zero disables the series, then the costs are only collected for the billing
+    std::uint32_t mCostSeriesTickFreq;
+
+    // costs of each cloud summed since the last billing
+    std::vector<SSiteCosts> mBillingCosts;
+    std::vector<SSiteCosts> mSiteCosts;
+
+    void PrintBilling(const TickType now);
 
 public:
-    CBillingGenerator(IBaseSim* sim, const std::uint32_t tickFreq=SECONDS_PER_MONTH, const TickType startTick=SECONDS_PER_MONTH);
+    CBillingGenerator(IBaseSim* sim, const std::uint32_t tickFreq=SECONDS_PER_MONTH, const TickType startTick=SECONDS_PER_MONTH, const std::uint32_t costSeriesTickFreq=0);
 
     void OnUpdate(const TickType now) final;
 };
@@ -69,8 +100,6 @@ public:
 class CTransferManager : public CScheduleable
 {
 private:
-    std::size_t mOutputQueryIdx;
-
     TickType mLastUpdated = 0;
     std::uint32_t mTickFreq;
 
@@ -93,6 +122,8 @@ public:
     std::uint32_t mNumCompletedTransfers = 0;
     TickType mSummedTransferDuration = 0;
 
+    std::shared_ptr<COutputAggregator> mAggregator;
+
 public:
     CTransferManager(const std::uint32_t tickFreq, const TickType startTick=0);
 
@@ -108,8 +139,6 @@ public:
 class CFixedTimeTransferManager : public CScheduleable
 {
 private:
-    std::size_t mOutputQueryIdx;
-
     TickType mLastUpdated = 0;
     std::uint32_t mTickFreq;
 
@@ -135,6 +164,8 @@ public:
     std::uint32_t mNumCompletedTransfers = 0;
     TickType mSummedTransferDuration = 0;
 
+    std::shared_ptr<COutputAggregator> mAggregator;
+
 public:
     CFixedTimeTransferManager(const std::uint32_t tickFreq, const TickType startTick=0);
 
@@ -182,6 +213,7 @@ public:
     std::shared_ptr<CBaseTransferNumGen> mTransferNumGen;
     std::vector<CStorageElement*> mSrcStorageElements;
     std::vector<CStorageElement*> mDstStorageElements;
+    std::shared_ptr<CTraceWriter> mDecisionRecorder;
 
 public:
     CUniformTransferGen(IBaseSim* sim,
@@ -205,6 +237,7 @@ public:
     std::shared_ptr<CBaseTransferNumGen> mTransferNumGen;
     std::vector<CStorageElement*> mSrcStorageElements;
     std::vector<CStorageElement*> mDstStorageElements;
+    std::shared_ptr<CTraceWriter> mDecisionRecorder;
 
 public:
     CExponentialTransferGen(IBaseSim* sim,
@@ -227,7 +260,9 @@ private:
 public:
     std::shared_ptr<CBaseTransferNumGen> mTransferNumGen;
     std::unordered_map<IdType, int> mSrcStorageElementIdToPrio;
+    std::shared_ptr<SCacheStats> mSrcSelectionCacheStats = std::make_shared<SCacheStats>();
     std::vector<CStorageElement*> mDstStorageElements;
+    std::shared_ptr<CTraceWriter> mDecisionRecorder;
 
 public:
     CSrcPrioTransferGen(IBaseSim* sim,
@@ -249,19 +284,44 @@ private:
 
 public:
 
-    struct SJobSlotInfo
+    class CJobSlotInfo
     {
+    private:
+        typedef std::pair<TickType, std::uint32_t> ScheduleEntryType;
+
+        //min-heap of (finishTick, numSlots) ordered by the earliest finish tick
+        std::priority_queue<ScheduleEntryType, std::vector<ScheduleEntryType>, std::greater<ScheduleEntryType>> mSchedule;
         std::uint32_t mNumMaxSlots;
-        std::vector<std::pair<TickType, std::uint32_t>> mSchedule;
+        std::uint32_t mNumUsedSlots = 0;
+
+    public:
+        CJobSlotInfo(const std::uint32_t numMaxSlots);
+
+        void ReleaseFinishedJobs(const TickType now);
+        void AddJobs(const TickType finishTick, const std::uint32_t numSlots);
+
+        inline auto GetNumMaxSlots() const -> std::uint32_t
+        {return mNumMaxSlots;}
+        inline auto GetNumUsedSlots() const -> std::uint32_t
+        {return mNumUsedSlots;}
+        inline auto GetNumFreeSlots() const -> std::uint32_t
+        {return mNumMaxSlots - mNumUsedSlots;}
     };
 
+    TickType mJobDuration;
+    TickType mTransferDuration;
+
     std::unordered_map<IdType, int> mSrcStorageElementIdToPrio;
-    std::vector<std::pair<CStorageElement*, SJobSlotInfo>> mDstInfo;
+    std::shared_ptr<SCacheStats> mSrcSelectionCacheStats = std::make_shared<SCacheStats>();
+    std::vector<std::pair<CStorageElement*, CJobSlotInfo>> mDstInfo;
+    std::shared_ptr<CTraceWriter> mDecisionRecorder;
 
 public:
     CJobSlotTransferGen(IBaseSim* sim,
                         std::shared_ptr<CFixedTimeTransferManager> transferMgr,
                         const std::uint32_t tickFreq,
+                        const TickType jobDuration=900,
+                        const TickType transferDuration=60,
                         const TickType startTick=0 );
 
     void OnUpdate(const TickType now) final;
@@ -277,9 +337,11 @@ private:
     std::uint32_t mTickFreq;
 
     std::chrono::high_resolution_clock::time_point mTimeLastUpdate;
+    std::uint64_t mNumInsertedRowsLastUpdate = 0;
 
 public:
-    std::unordered_map<std::string, std::chrono::duration<double>*> mProccessDurations;
+    std::unordered_map<std::string, std::shared_ptr<CScheduleable>> mProccessDurations;
+    std::unordered_map<std::string, std::shared_ptr<SCacheStats>> mCacheStats;
 
 public:
     CHeartbeat(IBaseSim* sim, std::shared_ptr<CFixedTimeTransferManager> g2cTransferMgr, std::shared_ptr<CTransferManager> c2cTransferMgr, const std::uint32_t tickFreq, const TickType startTick=0);
@@ -9,10 +9,21 @@
 
 #include "IConfigConsumer.hpp"
 
+class CLinkSelector;
 class ISite;
 
 
 
+// costs of a region accrued since the costs were collected the last time
+struct SSiteCosts
+{
+    IdType mSiteId = 0;
+    double mStorageCosts = 0;
+    double mNetworkCosts = 0;
+    std::uint64_t mTraffic = 0;
+    std::uint64_t mNumDoneTransfers = 0;
+};
+
 class IBaseCloud : public IConfigConsumer
 {
 private:
@@ -31,7 +42,16 @@ public:
                               double storagePriceCHF,
                               std::string&& skuId) -> ISite* = 0;
 
-	virtual auto ProcessBilling(TickType now) -> std::pair<double, std::pair<double, double>> = 0;
+	// creates a link with the bandwidth and price the cloud uses for it.
+	// Returns nullptr if none of both sites is a region of the cloud
+	virtual auto CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector* = 0;
+
+	// weight of the link CreateLinkSelector() would create, without creating it.
+	// Returns false if none of both sites is a region of the cloud
+	virtual bool GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const = 0;
+
+	// appends the costs of all regions accrued since the last call and resets them
+	virtual void CollectCosts(TickType now, std::vector<SSiteCosts>& siteCosts) = 0;
 	virtual void SetupDefaultCloud() = 0;
 
 	inline auto GetName() const -> const std::string&
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "constants.h"
+#include "json_fwd.hpp"
 
 #include "CScheduleable.hpp"
 
@@ -26,7 +27,8 @@ public:
     std::unique_ptr<CRucio> mRucio;
     std::vector<std::unique_ptr<IBaseCloud>> mClouds;
 
-    virtual void SetupDefaults() = 0;
+    // returns false if the simulation cannot run with the given profile
+    virtual bool SetupDefaults(const nlohmann::json& profileJson) = 0;
     virtual void Run(const TickType maxTick);
 
 protected:
@@ -1,13 +1,45 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "json_fwd.hpp"
 
 using json = nlohmann::json;
 
 
 
+// a grid site or cloud region as it is listed in the config. It is filled from a json object
+// or by the streaming parser of CConfigLoader, so both share the same attribute handling
+struct SSiteConfig
+{
+    std::unique_ptr<std::uint32_t> mMultiLocationIdx;
+    std::string mName;
+    std::string mLocationName;
+    std::string mSKUId;
+    double mStoragePrice = 0;
+    std::uint32_t mNumJobSlots = 0;
+    std::vector<std::string> mStorageElementNames;
+
+    void SetAttribute(const std::string& key, const json& value);
+    void AddStorageElement(const json& storageElementJson);
+};
+
+
+
 class IConfigConsumer
 {
 public:
     virtual bool TryConsumeConfig(const json& json) = 0;
+
+    // called for every entry of a "sites" or "regions" list while a config file is streamed.
+    // rootKey is the top level key of the list, e.g. "rucio" or "gcp"
+    virtual bool TryConsumeSiteConfig(const std::string& rootKey, SSiteConfig& siteConfig)
+    {
+        (void)rootKey;
+        (void)siteConfig;
+        return false;
+    }
 };
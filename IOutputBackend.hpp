@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class IInsertValuesContainer;
+
+
+
+struct SColumnDefinition
+{
+    std::string mName;
+    std::string mSQLType;
+};
+
+
+// receives the values of rows in column order. Backends that do not bind prepared
+// statements implement it, so insert values containers stay independent of them.
+// NULL is only supported in text columns
+class IRowWriter
+{
+public:
+    virtual ~IRowWriter() = default;
+
+    virtual auto GetNumColumns() const -> std::size_t = 0;
+
+    virtual void AppendValue(const int value) = 0;
+    virtual void AppendValue(const std::uint32_t value) = 0;
+    virtual void AppendValue(const std::uint64_t value) = 0;
+    virtual void AppendValue(const double value) = 0;
+    virtual void AppendValue(const char* const value, const std::size_t length) = 0;
+    virtual void AppendNull() = 0;
+    virtual void EndRow() = 0;
+
+    inline void AppendValue(const std::string& value)
+    {AppendValue(value.c_str(), value.size());}
+};
+
+
+// storage of the output tables. All calls happen either before the consumer was
+// started or from the consumer thread, so backends do not need to be thread safe
+class IOutputBackend
+{
+public:
+    virtual ~IOutputBackend() = default;
+
+    virtual bool CreateTable(const std::string& tableName, const std::vector<SColumnDefinition>& columns, const std::string& constraints) = 0;
+
+    // returns the idx that insert values containers use to refer to the table
+    virtual auto AddInsertStatement(const std::string& tableName) -> std::size_t = 0;
+
+    // row is a comma separated list of sql literals
+    virtual bool InsertRow(const std::string& tableName, const std::string& row) = 0;
+
+    virtual auto Insert(const std::size_t insertStatementIdx, IInsertValuesContainer& values) -> std::size_t = 0;
+
+    virtual void BeginTransaction() = 0;
+    virtual void EndTransaction() = 0;
+
+    // appends the rows of the tables of a closed backend of the same type
+    virtual bool MergeShard(const std::filesystem::path& shardFilePath, const std::vector<std::string>& tableNames) = 0;
+
+    virtual void Close() = 0;
+};
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 
 #include "ISite.hpp"
@@ -7,28 +8,75 @@
 
 
 
+static auto GetNewSiteIdx() -> std::uint32_t
+{
+    static std::uint32_t siteIdx = 0;
+    return siteIdx++;
+}
+
 ISite::ISite(const std::uint32_t multiLocationIdx, std::string&& name, std::string&& locationName)
 	: mId(GetNewId()),
       mName(std::move(name)),
       mLocationName(std::move(locationName)),
-      mMultiLocationIdx(multiLocationIdx)
+      mMultiLocationIdx(multiLocationIdx),
+      mSiteIdx(GetNewSiteIdx())
 {}
 
 ISite::~ISite() = default;
 
-auto ISite::CreateLinkSelector(ISite* const dstSite, const std::uint32_t bandwidth) -> CLinkSelector*
+auto ISite::GetUnlinkedWeight(const ISite* const dstSite) const -> double
 {
-    auto result = mDstSiteIdToLinkSelectorIdx.insert({dstSite->mId, mLinkSelectors.size()});
-    assert(result.second);
-    CLinkSelector* newLinkSelector = new CLinkSelector(bandwidth, this, dstSite);
-    mLinkSelectors.emplace_back(newLinkSelector);
-    return newLinkSelector;
+    double weight = 0;
+    if(mLinkRules != nullptr)
+        mLinkRules->GetLinkWeight(this, dstSite, weight);
+    return weight;
 }
 
-auto ISite::GetLinkSelector(const ISite* const dstSite) -> CLinkSelector*
+auto ISite::CreateLinkSelector(ISite* const dstSite, const std::uint32_t bandwidth) -> CLinkSelector*
 {
-    auto result = mDstSiteIdToLinkSelectorIdx.find(dstSite->mId);
-    if(result == mDstSiteIdToLinkSelectorIdx.end())
-        return nullptr;
-    return mLinkSelectors[result->second].get();
+    assert(GetLinkSelector(dstSite) == nullptr);
+    CLinkSelector* newLinkSelector = mLinkTable.CreateLinkSelector(bandwidth, this, dstSite);
+    mLinkSelectors.push_back(newLinkSelector);
+    const std::uint32_t linkIdx = newLinkSelector->GetLinkIdx();
+
+    const std::uint32_t dstSiteIdx = dstSite->mSiteIdx;
+    std::size_t rowSize = std::max<std::size_t>(dstSiteIdx + 1, mDenseLinkRow.size());
+    if(!mSparseLinkRowDstSiteIdxs.empty())
+        rowSize = std::max<std::size_t>(rowSize, mSparseLinkRowDstSiteIdxs.back() + 1);
+    const bool isDense = rowSize <= std::max<std::size_t>(LINK_ROW_MIN_DENSE_SIZE, mLinkSelectors.size() * LINK_ROW_DENSE_FACTOR);
+
+    if(isDense)
+    {
+        if(!mSparseLinkRowDstSiteIdxs.empty())
+        {
+            mDenseLinkRow.assign(mSparseLinkRowDstSiteIdxs.back() + 1, CLinkTable::NO_LINK_IDX);
+            for(std::size_t i = 0; i < mSparseLinkRowDstSiteIdxs.size(); ++i)
+                mDenseLinkRow[mSparseLinkRowDstSiteIdxs[i]] = mSparseLinkRow[i];
+            mSparseLinkRowDstSiteIdxs = std::vector<std::uint32_t>();
+            mSparseLinkRow = std::vector<std::uint32_t>();
+        }
+        if(dstSiteIdx >= mDenseLinkRow.size())
+            mDenseLinkRow.resize(dstSiteIdx + 1, CLinkTable::NO_LINK_IDX);
+        mDenseLinkRow[dstSiteIdx] = linkIdx;
+    }
+    else
+    {
+        if(mSparseLinkRowDstSiteIdxs.empty())
+        {
+            for(std::uint32_t idx = 0; idx < mDenseLinkRow.size(); ++idx)
+            {
+                if(mDenseLinkRow[idx] != CLinkTable::NO_LINK_IDX)
+                {
+                    mSparseLinkRowDstSiteIdxs.push_back(idx);
+                    mSparseLinkRow.push_back(mDenseLinkRow[idx]);
+                }
+            }
+            mDenseLinkRow = std::vector<std::uint32_t>();
+        }
+        auto pos = std::lower_bound(mSparseLinkRowDstSiteIdxs.begin(), mSparseLinkRowDstSiteIdxs.end(), dstSiteIdx);
+        mSparseLinkRow.insert(mSparseLinkRow.begin() + (pos - mSparseLinkRowDstSiteIdxs.begin()), linkIdx);
+        mSparseLinkRowDstSiteIdxs.insert(pos, dstSiteIdx);
+    }
+
+    return newLinkSelector;
 }
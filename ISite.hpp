@@ -2,12 +2,12 @@
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "constants.h"
 
-class CLinkSelector;
+#include "CLinkSelector.hpp"
+
 class CStorageElement;
 
 
@@ -18,6 +18,26 @@ class CStorageElement;
 // 3 = southamerica-east1
 // 4 = us
 
+// a link row stays dense as long as its size is at most this factor times its number of links
+#define LINK_ROW_DENSE_FACTOR (8)
+// rows up to this size are always dense
+#define LINK_ROW_MIN_DENSE_SIZE (1024)
+
+class ISite;
+
+// creates links on their first use, see ISite::GetOrCreateLinkSelector
+class ILinkRules
+{
+public:
+    virtual ~ILinkRules() = default;
+
+    // returns nullptr if there is no rule for the two sites
+    virtual auto CreateLinkSelector(ISite* const srcSite, ISite* const dstSite) -> CLinkSelector* = 0;
+
+    // weight the link created by CreateLinkSelector() would have. Returns false if there is no rule for the two sites
+    virtual bool GetLinkWeight(const ISite* const srcSite, const ISite* const dstSite, double& weight) const = 0;
+};
+
 class ISite
 {
 public:
@@ -38,10 +58,33 @@ public:
 	virtual auto CreateLinkSelector(ISite* const dstSite, const std::uint32_t bandwidth) -> CLinkSelector*;
     virtual auto CreateStorageElement(std::string&& name) -> CStorageElement* = 0;
 
-	auto GetLinkSelector(const ISite* const dstSite) -> CLinkSelector*;
+	inline auto GetLinkSelector(const ISite* const dstSite) const -> CLinkSelector*
+	{
+        const std::uint32_t linkIdx = GetLinkIdx(dstSite);
+        return (linkIdx != CLinkTable::NO_LINK_IDX) ? mLinkTable.GetLinkSelector(linkIdx) : nullptr;
+	}
+
+	// if link rules are set, a link that does not exist yet is created by them
+	inline auto GetOrCreateLinkSelector(ISite* const dstSite) -> CLinkSelector*
+	{
+        CLinkSelector* linkSelector = GetLinkSelector(dstSite);
+        if(linkSelector == nullptr && mLinkRules != nullptr)
+            linkSelector = mLinkRules->CreateLinkSelector(this, dstSite);
+        return linkSelector;
+	}
+
+	// weight of the link to dstSite. A link that does not exist yet is not created,
+	// its weight is taken from the link rules or is 0 if there are none
+	inline auto GetLinkWeight(const ISite* const dstSite) const -> double
+	{
+        const std::uint32_t linkIdx = GetLinkIdx(dstSite);
+        return (linkIdx != CLinkTable::NO_LINK_IDX) ? mLinkTable.GetWeight(linkIdx) : GetUnlinkedWeight(dstSite);
+	}
 
 	inline auto GetId() const -> IdType
 	{return mId;}
+	inline auto GetSiteIdx() const -> std::uint32_t
+	{return mSiteIdx;}
 	inline auto GetMultiLocationIdx() const -> std::uint32_t
 	{return mMultiLocationIdx;}
     inline auto GetName() const -> const std::string&
@@ -49,15 +92,51 @@ public:
     inline auto GetLocationName() const -> const std::string&
     {return mLocationName;}
 
-    std::vector<std::unique_ptr<CLinkSelector>> mLinkSelectors;
+    // links from this site, they are owned by mLinkTable
+    std::vector<CLinkSelector*> mLinkSelectors;
+
+    static inline ILinkRules* mLinkRules = nullptr;
+
+    // links of all sites
+    static inline CLinkTable mLinkTable;
+
+    // incremented whenever the weight of a link to this site changes
+    std::uint32_t mInLinkWeightVersion = 0;
 
 private:
 	IdType mId;
     std::string mName;
     std::string mLocationName;
     std::uint32_t mMultiLocationIdx;
-    
-protected:
-	std::unordered_map<IdType, std::size_t> mDstSiteIdToLinkSelectorIdx;
 
+    // dense idx of the site, the link rows of all sites are indexed by it
+    std::uint32_t mSiteIdx;
+
+    // link table idxs by dst site idx. The row is either dense or, if the site is linked to few of many sites,
+    // sorted by dst site idx. Only one of both is used at a time. The sparse row keeps the dst site
+    // idxs separate, so a lookup only searches through a few cache lines
+    std::vector<std::uint32_t> mDenseLinkRow;
+    std::vector<std::uint32_t> mSparseLinkRowDstSiteIdxs;
+    std::vector<std::uint32_t> mSparseLinkRow;
+
+    // returns CLinkTable::NO_LINK_IDX if there is no link to dstSite
+    inline auto GetLinkIdx(const ISite* const dstSite) const -> std::uint32_t
+    {
+        const std::uint32_t dstSiteIdx = dstSite->mSiteIdx;
+        if(mSparseLinkRowDstSiteIdxs.empty())
+            return (dstSiteIdx < mDenseLinkRow.size()) ? mDenseLinkRow[dstSiteIdx] : CLinkTable::NO_LINK_IDX;
+        // branchless binary search
+        const std::uint32_t* base = mSparseLinkRowDstSiteIdxs.data();
+        std::size_t numEntries = mSparseLinkRowDstSiteIdxs.size();
+        while(numEntries > 1)
+        {
+            const std::size_t half = numEntries / 2;
+            base = (base[half] <= dstSiteIdx) ? (base + half) : base;
+            numEntries -= half;
+        }
+        return (*base == dstSiteIdx) ? mSparseLinkRow[base - mSparseLinkRowDstSiteIdxs.data()] : CLinkTable::NO_LINK_IDX;
+    }
+
+    // weight of a link that does not exist yet, taken from the link rules or 0 if there are none
+    auto GetUnlinkedWeight(const ISite* const dstSite) const -> double;
 };
@@ -17,6 +17,7 @@ void SFile::Remove(const TickType now)
     for(const std::shared_ptr<SReplica>& replica : mReplicas)
         replica->OnRemoveByFile(now);
     mReplicas.clear();
+    ++mReplicaRemovalVersion;
 }
 
 auto SFile::RemoveExpiredReplicas(const TickType now) -> std::size_t
@@ -56,6 +57,8 @@ auto SFile::RemoveExpiredReplicas(const TickType now) -> std::size_t
         mReplicas[backIdx]->OnRemoveByFile(now);
         mReplicas.pop_back();
     }
+    if(numReplicas != mReplicas.size())
+        ++mReplicaRemovalVersion;
     return numReplicas - mReplicas.size();
 }
 
@@ -77,6 +80,8 @@ auto SReplica::Increase(std::uint32_t amount, const TickType now) -> std::uint32
     {
         amount = maxSize - mCurSize;
         newSize = maxSize;
+        if(amount > 0)
+            mCompletionIdx = ++(mFile->mNumReplicaCompletions);
     }
     mCurSize = static_cast<std::uint32_t>(newSize);
     mStorageElement->OnIncreaseReplica(amount, now);
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <limits>
 #include <memory>
 #include <vector>
 
 #include "constants.h"
 
+// max number of source replica selections cached per file
+#define SRC_SELECTION_CACHE_SIZE (4)
+
 class CStorageElement;
+class ISite;
 struct SReplica;
 
 
@@ -30,6 +35,32 @@ struct SFile
     std::vector<std::shared_ptr<SReplica>> mReplicas;
     TickType mExpiresAt;
 
+    // rank in the file popularity model (if the file was added to one)
+    std::size_t mPopularityRank = std::numeric_limits<std::size_t>::max();
+
+    // incremented whenever a replica completes
+    std::uint32_t mNumReplicaCompletions = 0;
+    // incremented whenever replicas are removed, which may reorder mReplicas
+    std::uint32_t mReplicaRemovalVersion = 0;
+
+    // source replica selections by dst site. A selection must be recomputed if the removal version
+    // or the weight version of the links to its dst site changed. Replicas completed after
+    // mNumReplicaCompletions only need to be compared. At most SRC_SELECTION_CACHE_SIZE selections
+    // are kept, further ones replace the existing ones round robin
+    struct SSrcSelection
+    {
+        const void* mSelector;
+        const ISite* mDstSite;
+        std::uint32_t mNumReplicaCompletions;
+        std::uint32_t mReplicaRemovalVersion;
+        std::uint32_t mLinkWeightVersion;
+        std::uint32_t mReplicaIdx;
+        int mPrio;
+        double mWeight;
+    };
+    std::vector<SSrcSelection> mSrcSelectionCache;
+    std::uint8_t mNextSrcSelectionToReplace = 0;
+
 private:
     IdType mId;
     std::uint32_t mSize;
@@ -66,6 +97,9 @@ struct SReplica
     std::size_t mIndexAtStorageElement;
     TickType mExpiresAt;
 
+    // value of mFile->mNumReplicaCompletions after this replica completed, 0 while incomplete
+    std::uint32_t mCompletionIdx = 0;
+
 private:
     IdType mId;
     SFile* mFile;
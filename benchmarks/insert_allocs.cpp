@@ -0,0 +1,110 @@
+// counts the heap allocations per row when rows are added to insert statement containers.
+// "boxed" is the former CInsertStatements layout with one heap allocated value per column,
+// "arena" is the current CInsertStatements that packs all values into one byte vector.
+// Build with: make benchmarks
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "COutput.hpp"
+
+
+
+static std::size_t gNumAllocs = 0;
+
+void* operator new(std::size_t size)
+{
+    ++gNumAllocs;
+    void* const ptr = std::malloc(size);
+    if(ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{std::free(ptr);}
+void operator delete(void* ptr, std::size_t) noexcept
+{std::free(ptr);}
+
+
+
+// the former layout of CInsertStatements
+class IBoxedValue
+{
+public:
+    virtual ~IBoxedValue() = default;
+};
+
+template<typename T>
+class CBoxedValue : public IBoxedValue
+{
+private:
+    T mValue;
+
+public:
+    CBoxedValue(const T& value)
+        : mValue(value)
+    {}
+};
+
+class CBoxedInsertStatements
+{
+private:
+    std::vector<std::unique_ptr<IBoxedValue>> mValues;
+
+public:
+    CBoxedInsertStatements(std::size_t numReserve)
+    {mValues.reserve(numReserve);}
+
+    template<typename T>
+    void AddValue(const T& value)
+    {mValues.emplace_back(new CBoxedValue<T>(value));}
+};
+
+
+
+// adds numRows rows of 4 integer columns and one string column and prints the allocations per row
+template<typename TStatements>
+void Run(const char* const name, const std::size_t numRows, const std::string& str)
+{
+    const std::size_t numAllocsBefore = gNumAllocs;
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    {
+        TStatements statements(numRows * 5);
+        for(std::uint64_t i = 0; i < numRows; ++i)
+        {
+            statements.AddValue(i);
+            statements.AddValue(i + 1);
+            statements.AddValue(static_cast<std::uint32_t>(i));
+            statements.AddValue(static_cast<double>(i));
+            statements.AddValue(str);
+        }
+    }
+    const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+    const std::size_t numAllocs = gNumAllocs - numAllocsBefore;
+    std::printf("%-6s string length %3zu: %8.3f allocations per row, %7.2f ns per row\n",
+                name, str.size(), static_cast<double>(numAllocs) / numRows, (duration.count() * 1e9) / numRows);
+}
+
+struct SArenaInsertStatements : public CInsertStatements
+{
+    SArenaInsertStatements(std::size_t numReserve)
+        : CInsertStatements(0, numReserve)
+    {}
+};
+
+int main()
+{
+    constexpr std::size_t numRows = 1000000;
+    for(const std::string& str : {std::string(), std::string("short"), std::string(64, 'x')})
+    {
+        Run<CBoxedInsertStatements>("boxed", numRows, str);
+        Run<SArenaInsertStatements>("arena", numRows, str);
+    }
+    return 0;
+}
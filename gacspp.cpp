@@ -9,8 +9,11 @@
 #include "CSimpleSim.hpp"
 
 
-int main()
+int main(int argc, char** argv)
 {
+    if(argc == 4 && std::string(argv[1]) == "--columnar-to-sqlite")
+        return CColumnarOutputBackend::ConvertToSQLite(argv[2], argv[3]) ? 0 : 1;
+
     COutput& output = COutput::GetRef();
 
     nlohmann::json configJson;
@@ -36,8 +39,9 @@ int main()
         filenameTimePrefix << std::put_time(std::localtime(&now), "%y%j_%H%M%S");
 
         std::string outputFilename;
+        std::string backendName = "sqlite";
 
-        auto outputConfig = configJson.find("output");
+        const auto outputConfig = configJson.find("output");
         if(outputConfig != configJson.end())
         {
             auto prop = outputConfig->find("keepInMemory");
@@ -59,6 +63,16 @@ int main()
             prop = outputConfig->find("filename");
             if(prop != outputConfig->end())
                 outputFilename = prop->get<std::string>();
+
+            prop = outputConfig->find("backend");
+            if(prop != outputConfig->end())
+                backendName = prop->get<std::string>();
+        }
+
+        if(backendName != "sqlite" && backendName != "columnar")
+        {
+            std::cout << "Unknown output backend: " << backendName << " (expected sqlite or columnar)" << std::endl;
+            return 1;
         }
 
         std::filesystem::path outputFilePath;
@@ -68,16 +82,115 @@ int main()
             outputFilePath = outputBaseDirPath / (filenameTimePrefix.str() + outputFilename);
         }
 
-        if (keepInMemory)
-            std::cout<<"DB in memory"<<std::endl;
-        if(!outputFilePath.empty())
-            std::cout<<"Output file: "<<outputFilePath<<std::endl;
+        const bool isColumnar = (backendName == "columnar");
+        if(isColumnar)
+        {
+            // the columnar output is a directory with one file per table
+            if(outputFilePath.empty())
+                outputFilePath = outputBaseDirPath / filenameTimePrefix.str();
+            outputFilePath.replace_extension(COLUMNAR_FILE_EXTENSION);
+            std::cout<<"Columnar output directory: "<<outputFilePath<<std::endl;
+        }
+        else
+        {
+            if (keepInMemory)
+                std::cout<<"DB in memory"<<std::endl;
+            if(!outputFilePath.empty())
+                std::cout<<"Output file: "<<outputFilePath<<std::endl;
+        }
+
+        auto createBackend = [&](const std::filesystem::path& filePath) -> std::unique_ptr<IOutputBackend>
+        {
+            if(isColumnar)
+            {
+                auto columnarBackend = std::make_unique<CColumnarOutputBackend>();
+                if(!columnarBackend->Open(filePath))
+                    return nullptr;
+                return columnarBackend;
+            }
+
+            auto sqliteBackend = std::make_unique<CSQLiteOutputBackend>();
+            if(outputConfig != configJson.end())
+            {
+                auto prop = outputConfig->find("segmentNumRows");
+                if(prop != outputConfig->end())
+                    sqliteBackend->SetSegmentNumRows(prop->get<std::size_t>());
+            }
+            if(!sqliteBackend->Open(filePath, keepInMemory))
+                return nullptr;
+            if(outputConfig != configJson.end())
+            {
+                for(const char* pragmaName : {"page_size", "journal_mode", "synchronous", "cache_size", "temp_store", "locking_mode"})
+                {
+                    auto prop = outputConfig->find(pragmaName);
+                    if(prop == outputConfig->end())
+                        continue;
+                    const std::string pragmaValue = prop->is_string() ? prop->get<std::string>() : prop->dump();
+                    if(!sqliteBackend->SetPragma(pragmaName, pragmaValue))
+                        std::cout << "Failed setting pragma " << pragmaName << " = " << pragmaValue << std::endl;
+                }
+
+                auto prop = outputConfig->find("numRowsPerInsert");
+                if(prop != outputConfig->end())
+                    sqliteBackend->SetNumRowsPerInsert(prop->get<std::size_t>());
+            }
+            return sqliteBackend;
+        };
 
-        if(!output.Initialise(outputFilePath, keepInMemory))
+        if(!output.Initialise(createBackend(outputFilePath), outputFilePath))
         {
             std::cout << "Failed initialising output component" << std::endl;
             return 1;
         }
+
+        if(outputConfig != configJson.end())
+        {
+            auto prop = outputConfig->find("transactionSize");
+            if(prop != outputConfig->end())
+                output.SetTransactionSize(prop->get<std::size_t>());
+
+            // e.g. "filters": {"Replicas": {"sampleRate": 0.01}, "Files": {"enabled": false}}
+            prop = outputConfig->find("filters");
+            if(prop != outputConfig->end())
+            {
+                for(const auto& [tableName, filterJson] : prop->items())
+                {
+                    COutputFilter filter;
+                    if(!filter.Load(filterJson))
+                    {
+                        std::cout << "Invalid output filter of " << tableName << std::endl;
+                        return 1;
+                    }
+                    output.SetFilter(tableName, filter);
+                }
+            }
+
+            prop = outputConfig->find("mergeShards");
+            if(prop != outputConfig->end())
+                output.SetMergeShards(prop->get<bool>());
+
+            // e.g. "shards": {"Transfers": 2} writes the transfers to two additional files in parallel
+            prop = outputConfig->find("shards");
+            if(prop != outputConfig->end())
+            {
+                std::filesystem::path shardBasePath = outputFilePath;
+                if(shardBasePath.empty())
+                    shardBasePath = outputBaseDirPath / (filenameTimePrefix.str() + "output.db");
+
+                for(const auto& [tableName, numShardsJson] : prop->items())
+                {
+                    const std::size_t numShards = numShardsJson.get<std::size_t>();
+                    for(std::size_t i = 0; i < numShards; ++i)
+                    {
+                        std::filesystem::path shardFilePath = shardBasePath.parent_path() / shardBasePath.stem();
+                        shardFilePath += "." + tableName + "." + std::to_string(i) + shardBasePath.extension().string();
+                        if(!output.AddShard(tableName, createBackend(shardFilePath), shardFilePath))
+                            std::cout << "Failed adding output shard " << shardFilePath << std::endl;
+                    }
+                    std::cout << "Output shards for " << tableName << ": " << numShards << std::endl;
+                }
+            }
+        }
     }
 
     TickType maxTick = 3600 * 24 * 30;
@@ -90,9 +203,17 @@ int main()
 
     //auto sim = std::make_unique<CSimpleSim>();
     auto sim = std::make_unique<CAdvancedSim>();
-    sim->SetupDefaults();
+    if(!sim->SetupDefaults(configJson))
+    {
+        std::cout << "Failed setting up the simulation" << std::endl;
+        return 1;
+    }
 
-    output.StartConsumer();
+    if(!output.StartConsumer())
+    {
+        std::cout << "Failed starting output consumer" << std::endl;
+        return 1;
+    }
     sim->Run(maxTick);
     output.Shutdown();
 
@@ -0,0 +1,89 @@
+// checks that the zipf file popularity only samples live files and stays fast if the
+// rank slots are sparse, e.g. if only files with high ranks are left.
+// Build and run with: make tests
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "CFilePopularity.hpp"
+#include "SFile.hpp"
+
+
+
+static int gNumFailures = 0;
+
+static void Check(const bool condition, const char* const description)
+{
+    if(!condition)
+    {
+        std::printf("FAILED: %s\n", description);
+        ++gNumFailures;
+    }
+}
+
+// adds numFiles files, keeps the files of every keepStride-th rank starting at keepOffset and samples them
+static void RunSparse(const std::size_t numFiles, const std::size_t keepStride, const std::size_t keepOffset, const bool expectCompactRanks)
+{
+    RNGEngineType rngEngine(42);
+    CZipfFilePopularity popularity(1.0);
+
+    std::vector<std::unique_ptr<SFile>> files;
+    for(std::size_t i = 0; i < numFiles; ++i)
+    {
+        files.emplace_back(std::make_unique<SFile>(1, 0));
+        popularity.AddFile(files.back().get(), rngEngine);
+    }
+
+    std::vector<std::size_t> removedRanks;
+    std::unordered_set<const SFile*> liveFiles;
+    for(const std::unique_ptr<SFile>& file : files)
+    {
+        if((file->mPopularityRank % keepStride) == keepOffset)
+            liveFiles.insert(file.get());
+        else
+            removedRanks.push_back(file->mPopularityRank);
+    }
+    popularity.RemoveFiles(removedRanks);
+    Check(popularity.GetNumFiles() == liveFiles.size(), "number of files after removal");
+
+    constexpr std::size_t numSamples = 100000;
+    std::size_t numInvalidSamples = 0;
+    const auto startTime = std::chrono::high_resolution_clock::now();
+    for(std::size_t i = 0; i < numSamples; ++i)
+        numInvalidSamples += (liveFiles.count(popularity.SampleFile(rngEngine)) == 0) ? 1 : 0;
+    const std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - startTime;
+    Check(numInvalidSamples == 0, "samples only return live files");
+
+    if(expectCompactRanks)
+    {
+        std::vector<bool> isRankUsed(liveFiles.size(), false);
+        for(const SFile* const file : liveFiles)
+            if(file->mPopularityRank < isRankUsed.size())
+                isRankUsed[file->mPopularityRank] = true;
+        bool areRanksCompact = true;
+        for(const bool isUsed : isRankUsed)
+            areRanksCompact = areRanksCompact && isUsed;
+        Check(areRanksCompact, "ranks are compacted after sampling free slots");
+    }
+
+    std::printf("%8zu slots, %6zu live files: %7.2f ns per sample\n",
+                numFiles, liveFiles.size(), (duration.count() * 1e9) / numSamples);
+}
+
+int main()
+{
+    // one live file at the highest rank
+    RunSparse(100000, 100000, 99999, true);
+    // every 1000th file is left, the most popular slot is free
+    RunSparse(100000, 1000, 999, true);
+    // every other file is left
+    RunSparse(100000, 2, 1, false);
+
+    if(gNumFailures > 0)
+        return 1;
+    std::printf("OK\n");
+    return 0;
+}